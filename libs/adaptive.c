@@ -0,0 +1,196 @@
+#include "adaptive.h"
+#include <stdlib.h>
+#include <math.h>
+#include <stdio.h>
+#include "tasks.h"
+#include "utility.h"
+#include "encode.h"
+
+// Dynamic range of the standard deviation in Sauvola's formula for 8-bit images
+#define SAUVOLA_R 128.0
+
+// Columns per task of the vertical pass: a whole cache line of each table row
+#define COLUMN_STRIPE 64
+
+static int alloc_integral_image(int width, int height, struct integral_image *integral) {
+    size_t count = (size_t)(width + 1) * (height + 1);
+    integral->width = width;
+    integral->height = height;
+    integral->sum = malloc(count * sizeof(unsigned long long));
+    integral->sqsum = malloc(count * sizeof(unsigned long long));
+    if (integral->sum == NULL || integral->sqsum == NULL) {
+        free_integral_image(integral);
+        return -1;
+    }
+    // Zero first row; the first column is written by the row pass
+    for (int x = 0; x <= width; x++) {
+        integral->sum[x] = 0;
+        integral->sqsum[x] = 0;
+    }
+    return 0;
+}
+
+void free_integral_image(struct integral_image *integral) {
+    free(integral->sum);
+    free(integral->sqsum);
+    integral->sum = NULL;
+    integral->sqsum = NULL;
+}
+
+struct integral_tile_ctx {
+    const unsigned char *gray_image;
+    struct integral_image *integral;
+};
+
+// Horizontal pass: running sums along each image row
+static void integral_row_tile(void *arg, int row_begin, int row_end) {
+    struct integral_tile_ctx *ctx = arg;
+    int width = ctx->integral->width;
+    size_t stride = (size_t)width + 1;
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char *row = ctx->gray_image + (size_t)y * width;
+        unsigned long long *sum = ctx->integral->sum + (y + 1) * stride;
+        unsigned long long *sqsum = ctx->integral->sqsum + (y + 1) * stride;
+        unsigned long long s = 0, sq = 0;
+        sum[0] = 0;
+        sqsum[0] = 0;
+        for (int x = 0; x < width; x++) {
+            s += row[x];
+            sq += (unsigned)row[x] * row[x];
+            sum[x + 1] = s;
+            sqsum[x + 1] = sq;
+        }
+    }
+}
+
+// Vertical pass over table columns [col_begin, col_end)
+static void integral_column_tile(void *arg, int col_begin, int col_end) {
+    struct integral_tile_ctx *ctx = arg;
+    size_t stride = (size_t)ctx->integral->width + 1;
+    for (int y = 2; y <= ctx->integral->height; y++) {
+        unsigned long long *sum = ctx->integral->sum + y * stride;
+        unsigned long long *sqsum = ctx->integral->sqsum + y * stride;
+        for (int x = col_begin; x < col_end; x++) {
+            sum[x] += sum[x - stride];
+            sqsum[x] += sqsum[x - stride];
+        }
+    }
+}
+
+int build_integral_image(const unsigned char *gray_image, int width, int height, struct integral_image *integral) {
+    if (alloc_integral_image(width, height, integral) != 0) return -1;
+    struct integral_tile_ctx ctx = { gray_image, integral };
+    integral_row_tile(&ctx, 0, height);
+    integral_column_tile(&ctx, 1, width + 1);
+    return 0;
+}
+
+int build_integral_image_omp(const unsigned char *gray_image, int width, int height, struct integral_image *integral) {
+    if (alloc_integral_image(width, height, integral) != 0) return -1;
+    struct integral_tile_ctx ctx = { gray_image, integral };
+    parallel_tiles(height, default_tile_rows(width), integral_row_tile, &ctx);
+    // Column stripes are independent of each other
+    parallel_tiles(width + 1, COLUMN_STRIPE, integral_column_tile, &ctx);
+    return 0;
+}
+
+struct adaptive_tile_ctx {
+    const unsigned char *gray_image;
+    unsigned char *binary_image;
+    const struct integral_image *integral;
+    int radius;
+    double k;
+};
+
+static void adaptive_tile(void *arg, int row_begin, int row_end) {
+    struct adaptive_tile_ctx *ctx = arg;
+    int width = ctx->integral->width;
+    int height = ctx->integral->height;
+    size_t stride = (size_t)width + 1;
+    const unsigned long long *sum = ctx->integral->sum;
+    const unsigned long long *sqsum = ctx->integral->sqsum;
+
+    for (int y = row_begin; y < row_end; y++) {
+        int y0 = y - ctx->radius < 0 ? 0 : y - ctx->radius;
+        int y1 = y + ctx->radius + 1 > height ? height : y + ctx->radius + 1;
+        size_t top = y0 * stride, bottom = y1 * stride;
+        for (int x = 0; x < width; x++) {
+            int x0 = x - ctx->radius < 0 ? 0 : x - ctx->radius;
+            int x1 = x + ctx->radius + 1 > width ? width : x + ctx->radius + 1;
+            double area = (double)(x1 - x0) * (y1 - y0);
+            double s = (double)(sum[bottom + x1] - sum[bottom + x0] - sum[top + x1] + sum[top + x0]);
+            double sq = (double)(sqsum[bottom + x1] - sqsum[bottom + x0] - sqsum[top + x1] + sqsum[top + x0]);
+            double mean = s / area;
+            double variance = sq / area - mean * mean;
+            double stddev = variance > 0 ? sqrt(variance) : 0.0;
+            double threshold = mean * (1.0 + ctx->k * (stddev / SAUVOLA_R - 1.0));
+            size_t idx = (size_t)y * width + x;
+            ctx->binary_image[idx] = ctx->gray_image[idx] > threshold ? 255 : 0;
+        }
+    }
+}
+
+void adaptive_threshold(const unsigned char *gray_image, unsigned char *binary_image,
+                        const struct integral_image *integral, int window, double k) {
+    struct adaptive_tile_ctx ctx = { gray_image, binary_image, integral, window / 2, k };
+    adaptive_tile(&ctx, 0, integral->height);
+}
+
+void adaptive_threshold_omp(const unsigned char *gray_image, unsigned char *binary_image,
+                            const struct integral_image *integral, int window, double k) {
+    struct adaptive_tile_ctx ctx = { gray_image, binary_image, integral, window / 2, k };
+    parallel_tiles(integral->height, default_tile_rows(integral->width), adaptive_tile, &ctx);
+}
+
+static void save_binary_image(const char *output_path, const unsigned char *binary_img, int width, int height,
+                              const struct encode_params *output, int parallel) {
+    if (create_parent_directories(output_path) != 0) return;
+    printf("Saving image to path: %s\n", output_path);
+    if (!write_png(output_path, width, height, 1, binary_img, width, output, parallel)) {
+        fprintf(stderr, "Error writing image %s\n", output_path);
+    }
+}
+
+void adaptive_serial(const unsigned char *gray_image, const char *filename, int window, double k, int width, int height,
+                     const struct encode_params *output) {
+    struct integral_image integral;
+    unsigned char *binary_img = (unsigned char *)malloc((size_t)width * height);
+    if (binary_img == NULL || build_integral_image(gray_image, width, height, &integral) != 0) {
+        fprintf(stderr, "Error allocating memory\n");
+        free(binary_img);
+        return;
+    }
+    adaptive_threshold(gray_image, binary_img, &integral, window, k);
+    free_integral_image(&integral);
+
+    char output_path[OUTPUT_PATH_MAX];
+    if (snprintf(output_path, sizeof(output_path), "output_folder/serial_adaptive%s", filename) >=
+            (int)sizeof(output_path)) {
+        fprintf(stderr, "Output path too long for %s\n", filename);
+    } else {
+        save_binary_image(output_path, binary_img, width, height, output, 0);
+    }
+    free(binary_img);
+}
+
+void adaptive_omp(const unsigned char *gray_image, const char *filename, int window, double k, int width, int height,
+                  const struct encode_params *output) {
+    struct integral_image integral;
+    unsigned char *binary_img = (unsigned char *)malloc((size_t)width * height);
+    if (binary_img == NULL || build_integral_image_omp(gray_image, width, height, &integral) != 0) {
+        fprintf(stderr, "Error allocating memory\n");
+        free(binary_img);
+        return;
+    }
+    adaptive_threshold_omp(gray_image, binary_img, &integral, window, k);
+    free_integral_image(&integral);
+
+    char output_path[OUTPUT_PATH_MAX];
+    if (snprintf(output_path, sizeof(output_path), "output_folder/omp_adaptive%s", filename) >=
+            (int)sizeof(output_path)) {
+        fprintf(stderr, "Output path too long for %s\n", filename);
+    } else {
+        save_binary_image(output_path, binary_img, width, height, output, 1);
+    }
+    free(binary_img);
+}
@@ -0,0 +1,38 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include "image.h"
+#include "encode.h"
+
+// Summed-area tables of a gray image and of its squares. Both are
+// (width + 1) x (height + 1) with a zero first row and column, so the sum over
+// any rectangle is four lookups.
+struct integral_image {
+    unsigned long long *sum;
+    unsigned long long *sqsum;
+    int width;
+    int height;
+};
+
+int build_integral_image(const unsigned char *gray_image, int width, int height, struct integral_image *integral);
+// Parallel build: every row is prefix-summed independently, then the columns
+// are accumulated top to bottom in stripes of adjacent columns
+int build_integral_image_omp(const unsigned char *gray_image, int width, int height, struct integral_image *integral);
+void free_integral_image(struct integral_image *integral);
+
+// Sauvola local threshold: a pixel is foreground (255) when it is above
+// mean * (1 + k * (stddev / 128 - 1)) of the window x window neighbourhood
+// around it, clipped at the image border
+void adaptive_threshold(const unsigned char *gray_image, unsigned char *binary_image,
+                        const struct integral_image *integral, int window, double k);
+void adaptive_threshold_omp(const unsigned char *gray_image, unsigned char *binary_image,
+                            const struct integral_image *integral, int window, double k);
+
+// Threshold a gray image and save it as output_folder/serial_adaptive<filename>
+// (or omp_adaptive) in the output container; filename starts with '/'
+void adaptive_serial(const unsigned char *gray_image, const char *filename, int window, double k, int width, int height,
+                     const struct encode_params *output);
+void adaptive_omp(const unsigned char *gray_image, const char *filename, int window, double k, int width, int height,
+                  const struct encode_params *output);
+
+#endif
@@ -0,0 +1,130 @@
+#include "bitmask.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "tasks.h"
+
+int bitmask_alloc(struct bitmask *mask, int width, int height) {
+    mask->width = width;
+    mask->height = height;
+    mask->words_per_row = (width + BITMASK_WORD_BITS - 1) / BITMASK_WORD_BITS;
+    mask->words = calloc((size_t)mask->words_per_row * height, sizeof(uint64_t));
+    return mask->words ? 0 : -1;
+}
+
+void bitmask_free(struct bitmask *mask) {
+    free(mask->words);
+    mask->words = NULL;
+}
+
+// Bits of the 64 pixels at row[0..63] above threshold; the byte compare is
+// signed, so both sides are biased by 0x80
+static uint64_t threshold_word(const unsigned char *row, int threshold) {
+#if defined(__AVX2__)
+    __m256i bias = _mm256_set1_epi8((char)0x80);
+    __m256i limit = _mm256_set1_epi8((char)(threshold ^ 0x80));
+    __m256i lo = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)row), bias);
+    __m256i hi = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(row + 32)), bias);
+    uint64_t low_bits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(lo, limit));
+    uint64_t high_bits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(hi, limit));
+    return low_bits | high_bits << 32;
+#elif defined(__SSE2__)
+    __m128i bias = _mm_set1_epi8((char)0x80);
+    __m128i limit = _mm_set1_epi8((char)(threshold ^ 0x80));
+    uint64_t bits = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(row + 16 * i)), bias);
+        bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpgt_epi8(v, limit)) << (16 * i);
+    }
+    return bits;
+#else
+    uint64_t bits = 0;
+    for (int b = 0; b < BITMASK_WORD_BITS; b++) bits |= (uint64_t)(row[b] > threshold) << b;
+    return bits;
+#endif
+}
+
+struct threshold_ctx {
+    const struct image_buffer *gray_image;
+    int threshold;
+    struct bitmask *mask;
+};
+
+static void threshold_tile(void *arg, int row_begin, int row_end) {
+    struct threshold_ctx *ctx = arg;
+    struct bitmask *mask = ctx->mask;
+    int full_words = mask->width / BITMASK_WORD_BITS;
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char *row = image_row(ctx->gray_image, y);
+        uint64_t *words = mask->words + (size_t)y * mask->words_per_row;
+        for (int j = 0; j < full_words; j++) {
+            words[j] = threshold_word(row + j * BITMASK_WORD_BITS, ctx->threshold);
+        }
+        if (full_words < mask->words_per_row) {
+            uint64_t bits = 0;
+            for (int x = full_words * BITMASK_WORD_BITS; x < mask->width; x++) {
+                bits |= (uint64_t)(row[x] > ctx->threshold) << (x % BITMASK_WORD_BITS);
+            }
+            words[full_words] = bits;
+        }
+    }
+}
+
+void threshold_to_bitmask(const struct image_buffer *gray_image, int threshold, struct bitmask *mask) {
+    struct threshold_ctx ctx = { gray_image, threshold, mask };
+    threshold_tile(&ctx, 0, mask->height);
+}
+
+void threshold_to_bitmask_omp(const struct image_buffer *gray_image, int threshold, struct bitmask *mask) {
+    struct threshold_ctx ctx = { gray_image, threshold, mask };
+    parallel_tiles(mask->height, default_tile_rows(mask->width), threshold_tile, &ctx);
+}
+
+struct convert_ctx {
+    unsigned char *image;
+    struct bitmask *mask;
+};
+
+static void pack_tile(void *arg, int row_begin, int row_end) {
+    struct convert_ctx *ctx = arg;
+    struct bitmask *mask = ctx->mask;
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char *row = ctx->image + (size_t)y * mask->width;
+        uint64_t *words = mask->words + (size_t)y * mask->words_per_row;
+        for (int j = 0; j < mask->words_per_row; j++) {
+            int count = mask->width - j * BITMASK_WORD_BITS;
+            if (count > BITMASK_WORD_BITS) count = BITMASK_WORD_BITS;
+            uint64_t bits = 0;
+            for (int b = 0; b < count; b++) {
+                bits |= (uint64_t)(row[j * BITMASK_WORD_BITS + b] != 0) << b;
+            }
+            words[j] = bits;
+        }
+    }
+}
+
+static void unpack_tile(void *arg, int row_begin, int row_end) {
+    struct convert_ctx *ctx = arg;
+    struct bitmask *mask = ctx->mask;
+    for (int y = row_begin; y < row_end; y++) {
+        unsigned char *row = ctx->image + (size_t)y * mask->width;
+        const uint64_t *words = mask->words + (size_t)y * mask->words_per_row;
+        for (int x = 0; x < mask->width; x++) {
+            row[x] = (words[x / BITMASK_WORD_BITS] >> (x % BITMASK_WORD_BITS)) & 1 ? 255 : 0;
+        }
+    }
+}
+
+void pack_bitmask(const unsigned char *image, struct bitmask *mask, int parallel) {
+    struct convert_ctx ctx = { (unsigned char *)image, mask };
+    if (parallel) parallel_tiles(mask->height, default_tile_rows(mask->width), pack_tile, &ctx);
+    else pack_tile(&ctx, 0, mask->height);
+}
+
+void unpack_bitmask(const struct bitmask *mask, unsigned char *image, int parallel) {
+    struct convert_ctx ctx = { image, (struct bitmask *)mask };
+    if (parallel) parallel_tiles(mask->height, default_tile_rows(mask->width), unpack_tile, &ctx);
+    else unpack_tile(&ctx, 0, mask->height);
+}
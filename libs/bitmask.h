@@ -0,0 +1,39 @@
+#ifndef BITMASK_H
+#define BITMASK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "image.h"
+
+#define BITMASK_WORD_BITS 64
+
+// Binary image packed 64 pixels per word: pixel x of row y is bit x % 64 of
+// words[y * words_per_row + x / 64]. Bits past the width are always zero.
+struct bitmask {
+    uint64_t *words;
+    int width;
+    int height;
+    int words_per_row;
+};
+
+static inline int bitmask_get(const struct bitmask *mask, int x, int y) {
+    return (int)(mask->words[(size_t)y * mask->words_per_row + x / BITMASK_WORD_BITS] >>
+                 (x % BITMASK_WORD_BITS)) & 1;
+}
+
+// Allocates a cleared mask. Returns -1 when it cannot be allocated.
+int bitmask_alloc(struct bitmask *mask, int width, int height);
+void bitmask_free(struct bitmask *mask);
+
+// Sets the pixels of the 1-channel gray_image brighter than threshold. Compares
+// 16 or 32 pixels at a time and collects the results with a byte movemask
+// where SSE2/AVX2 is available.
+void threshold_to_bitmask(const struct image_buffer *gray_image, int threshold, struct bitmask *mask);
+void threshold_to_bitmask_omp(const struct image_buffer *gray_image, int threshold, struct bitmask *mask);
+
+// Conversions from and to 8-bit images (nonzero in, 0/255 out), split into
+// row tiles when parallel is set
+void pack_bitmask(const unsigned char *image, struct bitmask *mask, int parallel);
+void unpack_bitmask(const struct bitmask *mask, unsigned char *image, int parallel);
+
+#endif
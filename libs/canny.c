@@ -0,0 +1,204 @@
+#include "canny.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "sobel.h"
+#include "convolve.h"
+#include "tasks.h"
+
+// Classes of the non-maximum suppressed map
+#define EDGE_NONE   0
+#define EDGE_WEAK   1
+#define EDGE_STRONG 2
+
+struct canny_ctx {
+    const unsigned char *smoothed;
+    unsigned short *magnitude;
+    unsigned char *direction;
+    unsigned char *classes;
+    int *parent;
+    unsigned char *strong_root;
+    unsigned char *edge_image;
+    int width;
+    int height;
+    int low;
+    int high;
+};
+
+static void gradient_tile(void *arg, int row_begin, int row_end) {
+    struct canny_ctx *ctx = arg;
+    struct image_buffer smoothed = image_wrap((unsigned char *)ctx->smoothed, ctx->width, ctx->height, 1, 0);
+    sobel_gradient_rows(&smoothed, ctx->magnitude, ctx->direction, row_begin, row_end);
+}
+
+// Keeps a pixel only where its magnitude peaks across the edge, then sorts it
+// into weak or strong by the two thresholds
+static void suppress_tile(void *arg, int row_begin, int row_end) {
+    struct canny_ctx *ctx = arg;
+    int width = ctx->width;
+    for (int y = row_begin; y < row_end; y++) {
+        unsigned char *classes = ctx->classes + (size_t)y * width;
+        memset(classes, EDGE_NONE, width);
+        if (y == 0 || y == ctx->height - 1) continue;
+
+        const unsigned short *m = ctx->magnitude + (size_t)y * width;
+        const unsigned char *direction = ctx->direction + (size_t)y * width;
+        for (int x = 1; x < width - 1; x++) {
+            int value = m[x];
+            if (value < ctx->low) continue;
+
+            int before, after;
+            switch (direction[x]) {
+            case SOBEL_DIRECTION_HORIZONTAL:
+                before = m[x - 1];          after = m[x + 1];
+                break;
+            case SOBEL_DIRECTION_DIAGONAL:
+                before = m[x - width - 1];  after = m[x + width + 1];
+                break;
+            case SOBEL_DIRECTION_VERTICAL:
+                before = m[x - width];      after = m[x + width];
+                break;
+            default:
+                before = m[x - width + 1];  after = m[x + width - 1];
+                break;
+            }
+            // Strict on one side so a plateau two pixels wide keeps one of them
+            if (value > before && value >= after) {
+                classes[x] = value >= ctx->high ? EDGE_STRONG : EDGE_WEAK;
+            }
+        }
+    }
+}
+
+static int find_root(int *parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// Read-only find for the parallel passes once every union is done
+static int find_root_const(const int *parent, int i) {
+    while (parent[i] != i) i = parent[i];
+    return i;
+}
+
+// Links two components, keeping the smaller index as root
+static void union_roots(int *parent, int a, int b) {
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    if (a < b) parent[b] = a;
+    else if (b < a) parent[a] = b;
+}
+
+// Joins candidate pixel (x, y) with the candidates above it and to its left
+static void link_pixel(struct canny_ctx *ctx, int x, int y, int link_above) {
+    int width = ctx->width;
+    size_t i = (size_t)y * width + x;
+    if (x > 0 && ctx->classes[i - 1]) union_roots(ctx->parent, i, i - 1);
+    if (!link_above) return;
+    for (int dx = -1; dx <= 1; dx++) {
+        if (x + dx < 0 || x + dx >= width) continue;
+        if (ctx->classes[i - width + dx]) union_roots(ctx->parent, i, i - width + dx);
+    }
+}
+
+// Union-find over the candidates of one tile; links stay inside the tile
+static void label_tile(void *arg, int row_begin, int row_end) {
+    struct canny_ctx *ctx = arg;
+    int width = ctx->width;
+    for (int y = row_begin; y < row_end; y++) {
+        for (int x = 0; x < width; x++) {
+            size_t i = (size_t)y * width + x;
+            ctx->parent[i] = i;
+            if (ctx->classes[i]) link_pixel(ctx, x, y, y > row_begin);
+        }
+    }
+}
+
+static void mark_strong_tile(void *arg, int row_begin, int row_end) {
+    struct canny_ctx *ctx = arg;
+    size_t end = (size_t)row_end * ctx->width;
+    for (size_t i = (size_t)row_begin * ctx->width; i < end; i++) {
+        if (ctx->classes[i] == EDGE_STRONG) {
+            int root = find_root_const(ctx->parent, i);
+            #pragma omp atomic write
+            ctx->strong_root[root] = 1;
+        }
+    }
+}
+
+static void output_tile(void *arg, int row_begin, int row_end) {
+    struct canny_ctx *ctx = arg;
+    size_t end = (size_t)row_end * ctx->width;
+    for (size_t i = (size_t)row_begin * ctx->width; i < end; i++) {
+        int edge = ctx->classes[i] && ctx->strong_root[find_root_const(ctx->parent, i)];
+        ctx->edge_image[i] = edge ? 255 : 0;
+    }
+}
+
+static int run_canny(const unsigned char *gray_image, unsigned char *edge_image,
+                     int width, int height, const struct canny_params *params, int parallel) {
+    size_t pixels = (size_t)width * height;
+    unsigned char *smoothed = NULL;
+    struct canny_ctx ctx = { gray_image, malloc(pixels * sizeof(unsigned short)), malloc(pixels), malloc(pixels),
+                             malloc(pixels * sizeof(int)), calloc(pixels, 1), edge_image,
+                             width, height, params->low, params->high };
+    int status = 0;
+    if (!ctx.magnitude || !ctx.direction || !ctx.classes || !ctx.parent || !ctx.strong_root) status = -1;
+
+    struct kernel_1d kernel;
+    if (status == 0 && params->sigma > 0) {
+        smoothed = malloc(pixels);
+        if (smoothed == NULL || make_gaussian_kernel(params->sigma, &kernel) != 0) {
+            status = -1;
+        } else if (parallel) {
+            convolve_separable_omp(gray_image, smoothed, width, height, 1, &kernel, &kernel, BORDER_REPLICATE);
+        } else {
+            convolve_separable(gray_image, smoothed, width, height, 1, &kernel, &kernel, BORDER_REPLICATE);
+        }
+        ctx.smoothed = smoothed;
+    }
+
+    if (status != 0) {
+        fprintf(stderr, "Error allocating memory\n");
+    } else if (!parallel) {
+        gradient_tile(&ctx, 0, height);
+        suppress_tile(&ctx, 0, height);
+        label_tile(&ctx, 0, height);
+        mark_strong_tile(&ctx, 0, height);
+        output_tile(&ctx, 0, height);
+    } else {
+        int tile_rows = default_tile_rows(width);
+        parallel_tiles(height, tile_rows, gradient_tile, &ctx);
+        parallel_tiles(height, tile_rows, suppress_tile, &ctx);
+        parallel_tiles(height, tile_rows, label_tile, &ctx);
+        // Stitch the tiles: the first row of each tile links into the row above it
+        for (int y = tile_rows; y < height; y += tile_rows) {
+            for (int x = 0; x < width; x++) {
+                if (ctx.classes[(size_t)y * width + x]) link_pixel(&ctx, x, y, 1);
+            }
+        }
+        parallel_tiles(height, tile_rows, mark_strong_tile, &ctx);
+        parallel_tiles(height, tile_rows, output_tile, &ctx);
+    }
+
+    free(smoothed);
+    free(ctx.magnitude);
+    free(ctx.direction);
+    free(ctx.classes);
+    free(ctx.parent);
+    free(ctx.strong_root);
+    return status;
+}
+
+int canny_edges(const unsigned char *gray_image, unsigned char *edge_image,
+                int width, int height, const struct canny_params *params) {
+    return run_canny(gray_image, edge_image, width, height, params, 0);
+}
+
+int canny_edges_omp(const unsigned char *gray_image, unsigned char *edge_image,
+                    int width, int height, const struct canny_params *params) {
+    return run_canny(gray_image, edge_image, width, height, params, 1);
+}
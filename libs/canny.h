@@ -0,0 +1,24 @@
+#ifndef CANNY_H
+#define CANNY_H
+
+#include "image.h"
+
+struct canny_params {
+    double sigma;   // Gaussian smoothing before the gradients, 0 = none
+    int low;        // gradient magnitude kept when linked to a strong edge
+    int high;       // gradient magnitude that starts an edge
+};
+
+// Canny edge detection of a gray image into a 0/255 edge map: Gaussian
+// smoothing, Sobel gradients, non-maximum suppression along the gradient
+// direction and hysteresis. Returns -1 when a buffer cannot be allocated.
+int canny_edges(const unsigned char *gray_image, unsigned char *edge_image,
+                int width, int height, const struct canny_params *params);
+
+// Same result with every stage split into row tiles. Hysteresis labels the
+// candidate pixels of each tile with a union-find, links the labels across
+// tile seams and keeps every component that contains a strong pixel.
+int canny_edges_omp(const unsigned char *gray_image, unsigned char *edge_image,
+                    int width, int height, const struct canny_params *params);
+
+#endif
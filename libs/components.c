@@ -0,0 +1,397 @@
+#include "components.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include "tasks.h"
+#include "utility.h"
+
+int parse_component_format(const char *name, enum component_format *format) {
+    if (!strcmp(name, "csv")) *format = COMPONENTS_CSV;
+    else if (!strcmp(name, "bin")) *format = COMPONENTS_BINARY;
+    else return -1;
+    return 0;
+}
+
+static size_t find_root(size_t *parent, size_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// Read-only find for the parallel passes once every union is done
+static size_t find_root_const(const size_t *parent, size_t i) {
+    while (parent[i] != i) i = parent[i];
+    return i;
+}
+
+// Keeps the smaller index as root, so every root is the first pixel of its
+// component in raster order
+static void union_roots(size_t *parent, size_t a, size_t b) {
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    if (a < b) parent[b] = a;
+    else if (b < a) parent[a] = b;
+}
+
+static void add_pixel(struct component_stats *stats, int x, int y) {
+    if (stats->area == 0) {
+        stats->min_x = stats->max_x = x;
+        stats->min_y = stats->max_y = y;
+    } else {
+        if (x < stats->min_x) stats->min_x = x;
+        if (x > stats->max_x) stats->max_x = x;
+        if (y < stats->min_y) stats->min_y = y;
+        if (y > stats->max_y) stats->max_y = y;
+    }
+    stats->area++;
+    stats->sum_x += x;
+    stats->sum_y += y;
+}
+
+static void merge_stats(struct component_stats *into, const struct component_stats *from) {
+    if (from->area == 0) return;
+    if (into->area == 0) {
+        *into = *from;
+        return;
+    }
+    if (from->min_x < into->min_x) into->min_x = from->min_x;
+    if (from->max_x > into->max_x) into->max_x = from->max_x;
+    if (from->min_y < into->min_y) into->min_y = from->min_y;
+    if (from->max_y > into->max_y) into->max_y = from->max_y;
+    into->area += from->area;
+    into->sum_x += from->sum_x;
+    into->sum_y += from->sum_y;
+}
+
+// Statistics of components rooted in an earlier tile, keyed by component id
+struct foreign_table {
+    int *ids;
+    struct component_stats *stats;
+    int capacity;   // power of two, -1 ids are free slots
+    int used;
+};
+
+static int foreign_init(struct foreign_table *table, int capacity) {
+    table->capacity = capacity;
+    table->used = 0;
+    table->ids = malloc(capacity * sizeof(int));
+    table->stats = calloc(capacity, sizeof(struct component_stats));
+    if (table->ids == NULL || table->stats == NULL) return -1;
+    memset(table->ids, 0xff, capacity * sizeof(int));
+    return 0;
+}
+
+static void foreign_free(struct foreign_table *table) {
+    free(table->ids);
+    free(table->stats);
+}
+
+static struct component_stats *foreign_lookup(struct foreign_table *table, int id) {
+    if (2 * (table->used + 1) > table->capacity) {
+        struct foreign_table grown;
+        if (foreign_init(&grown, 2 * table->capacity) != 0) {
+            foreign_free(&grown);
+            return NULL;
+        }
+        for (int i = 0; i < table->capacity; i++) {
+            if (table->ids[i] >= 0) *foreign_lookup(&grown, table->ids[i]) = table->stats[i];
+        }
+        foreign_free(table);
+        *table = grown;
+    }
+    unsigned int slot = ((unsigned int)id * 2654435761u) & (table->capacity - 1);
+    while (table->ids[slot] >= 0 && table->ids[slot] != id) {
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    if (table->ids[slot] < 0) {
+        table->ids[slot] = id;
+        table->used++;
+    }
+    return &table->stats[slot];
+}
+
+struct label_ctx {
+    const struct bitmask *mask;
+    size_t *parent;     // pixel index, only foreground pixels are initialized
+    int *ids;           // component id, stored at root pixels
+    int width;
+    int height;
+    int tile_rows;
+    size_t *root_counts;    // per tile
+    int *first_ids;     // per tile
+    struct component_stats *stats;
+    struct foreign_table *foreign;  // per tile
+    int failed;
+};
+
+// Visits the foreground pixels of row y in order, skipping empty words
+#define FOR_EACH_SET_PIXEL(mask, y, x) \
+    for (int word_ = 0; word_ < (mask)->words_per_row; word_++) \
+        for (uint64_t bits_ = (mask)->words[(size_t)(y) * (mask)->words_per_row + word_]; bits_; bits_ &= bits_ - 1) \
+            for (int x = word_ * BITMASK_WORD_BITS + __builtin_ctzll(bits_), once_ = 1; once_; once_ = 0)
+
+// Joins foreground pixel (x, y) with the foreground pixels above it and to its left
+static void link_pixel(struct label_ctx *ctx, int x, int y, int link_above) {
+    int width = ctx->width;
+    size_t i = (size_t)y * width + x;
+    if (x > 0 && bitmask_get(ctx->mask, x - 1, y)) union_roots(ctx->parent, i, i - 1);
+    if (!link_above) return;
+    for (int dx = -1; dx <= 1; dx++) {
+        if (x + dx < 0 || x + dx >= width) continue;
+        if (bitmask_get(ctx->mask, x + dx, y - 1)) union_roots(ctx->parent, i, i - width + dx);
+    }
+}
+
+// Union-find of one tile with links kept inside it
+static void label_tile(void *arg, int row_begin, int row_end) {
+    struct label_ctx *ctx = arg;
+    for (int y = row_begin; y < row_end; y++) {
+        FOR_EACH_SET_PIXEL(ctx->mask, y, x) {
+            size_t i = (size_t)y * ctx->width + x;
+            ctx->parent[i] = i;
+            link_pixel(ctx, x, y, y > row_begin);
+        }
+    }
+}
+
+static void count_roots_tile(void *arg, int row_begin, int row_end) {
+    struct label_ctx *ctx = arg;
+    size_t count = 0;
+    for (int y = row_begin; y < row_end; y++) {
+        FOR_EACH_SET_PIXEL(ctx->mask, y, x) {
+            size_t i = (size_t)y * ctx->width + x;
+            // Wraps past INT_MAX roots, which run_labeling then rejects
+            if (ctx->parent[i] == i) ctx->ids[i] = (int)count++;
+        }
+    }
+    ctx->root_counts[row_begin / ctx->tile_rows] = count;
+}
+
+// Gathers the statistics of one tile once root ids are global: components rooted here go straight to
+// their global entry, which no other tile writes; the rest to the tile's table
+static void stats_tile(void *arg, int row_begin, int row_end) {
+    struct label_ctx *ctx = arg;
+    int tile = row_begin / ctx->tile_rows;
+    size_t tile_start = (size_t)row_begin * ctx->width;
+    struct foreign_table *foreign = &ctx->foreign[tile];
+    // Neighbouring pixels mostly share a component, so remember the last lookup
+    size_t cached_root = (size_t)-1;
+    struct component_stats *cached = NULL;
+
+    for (int y = row_begin; y < row_end; y++) {
+        FOR_EACH_SET_PIXEL(ctx->mask, y, x) {
+            size_t root = find_root_const(ctx->parent, (size_t)y * ctx->width + x);
+            if (root >= tile_start) {
+                add_pixel(&ctx->stats[ctx->ids[root]], x, y);
+                continue;
+            }
+            if (root != cached_root) {
+                cached = foreign_lookup(foreign, ctx->ids[root]);
+                cached_root = root;
+            }
+            if (cached == NULL) {
+                ctx->failed = 1;
+                return;
+            }
+            add_pixel(cached, x, y);
+        }
+    }
+}
+
+// Rebases the root ids of one tile to global ids
+static void number_tile(void *arg, int row_begin, int row_end) {
+    struct label_ctx *ctx = arg;
+    int first_id = ctx->first_ids[row_begin / ctx->tile_rows];
+    for (int y = row_begin; y < row_end; y++) {
+        FOR_EACH_SET_PIXEL(ctx->mask, y, x) {
+            size_t i = (size_t)y * ctx->width + x;
+            if (ctx->parent[i] == i) ctx->ids[i] += first_id;
+        }
+    }
+}
+
+static int run_labeling(const struct bitmask *mask, struct component_list *components, int parallel) {
+    int width = mask->width, height = mask->height;
+    components->items = NULL;
+    components->count = 0;
+    size_t pixels = (size_t)width * height;
+    int tile_rows = parallel ? default_tile_rows(width) : (height > 0 ? height : 1);
+    int tiles = (height + tile_rows - 1) / tile_rows;
+
+    struct label_ctx ctx = { mask, malloc(pixels * sizeof(size_t)), malloc(pixels * sizeof(int)),
+                             width, height, tile_rows, calloc(tiles + 1, sizeof(size_t)), calloc(tiles + 1, sizeof(int)),
+                             NULL, calloc(tiles + 1, sizeof(struct foreign_table)), 0 };
+    int status = ctx.parent && ctx.ids && ctx.root_counts && ctx.first_ids && ctx.foreign ? 0 : -1;
+
+    if (status == 0) {
+        if (parallel) {
+            parallel_tiles(height, tile_rows, label_tile, &ctx);
+            // Stitch the tiles: the first row of each tile links into the row above it
+            for (int y = tile_rows; y < height; y += tile_rows) {
+                FOR_EACH_SET_PIXEL(mask, y, x) link_pixel(&ctx, x, y, 1);
+            }
+            parallel_tiles(height, tile_rows, count_roots_tile, &ctx);
+        } else {
+            label_tile(&ctx, 0, height);
+            count_roots_tile(&ctx, 0, height);
+        }
+
+        // Component ids and component_list.count are ints
+        size_t total = 0;
+        for (int t = 0; t < tiles; t++) {
+            ctx.first_ids[t] = (int)total;
+            total += ctx.root_counts[t];
+        }
+        if (total > INT_MAX) {
+            fprintf(stderr, "Too many components to label: %zu\n", total);
+            status = -1;
+        } else {
+            components->count = (int)total;
+            ctx.stats = calloc(total + 1, sizeof(struct component_stats));
+            if (ctx.stats == NULL) status = -1;
+        }
+        for (int t = 0; t < tiles && status == 0; t++) {
+            if (foreign_init(&ctx.foreign[t], 64) != 0) status = -1;
+        }
+    }
+
+    if (status == 0) {
+        if (parallel) {
+            parallel_tiles(height, tile_rows, number_tile, &ctx);
+            parallel_tiles(height, tile_rows, stats_tile, &ctx);
+        } else {
+            stats_tile(&ctx, 0, height);
+        }
+        for (int t = 0; t < tiles; t++) {
+            for (int slot = 0; slot < ctx.foreign[t].capacity; slot++) {
+                int id = ctx.foreign[t].ids[slot];
+                if (id >= 0) merge_stats(&ctx.stats[id], &ctx.foreign[t].stats[slot]);
+            }
+        }
+        if (ctx.failed) status = -1;
+    }
+
+    if (status == 0) {
+        components->items = ctx.stats;
+    } else {
+        fprintf(stderr, "Error allocating memory\n");
+        free(ctx.stats);
+        components->count = 0;
+    }
+    for (int t = 0; ctx.foreign && t < tiles; t++) foreign_free(&ctx.foreign[t]);
+    free(ctx.foreign);
+    free(ctx.parent);
+    free(ctx.ids);
+    free(ctx.root_counts);
+    free(ctx.first_ids);
+    return status;
+}
+
+int label_bitmask(const struct bitmask *mask, struct component_list *components) {
+    return run_labeling(mask, components, 0);
+}
+
+int label_bitmask_omp(const struct bitmask *mask, struct component_list *components) {
+    return run_labeling(mask, components, 1);
+}
+
+static int label_image(const unsigned char *binary_image, int width, int height,
+                       struct component_list *components, int parallel) {
+    struct bitmask mask;
+    if (bitmask_alloc(&mask, width, height) != 0) {
+        fprintf(stderr, "Error allocating memory\n");
+        components->items = NULL;
+        components->count = 0;
+        return -1;
+    }
+    pack_bitmask(binary_image, &mask, parallel);
+    int status = run_labeling(&mask, components, parallel);
+    bitmask_free(&mask);
+    return status;
+}
+
+int label_components(const unsigned char *binary_image, int width, int height, struct component_list *components) {
+    return label_image(binary_image, width, height, components, 0);
+}
+
+int label_components_omp(const unsigned char *binary_image, int width, int height, struct component_list *components) {
+    return label_image(binary_image, width, height, components, 1);
+}
+
+void free_component_list(struct component_list *components) {
+    free(components->items);
+    components->items = NULL;
+    components->count = 0;
+}
+
+static int write_components_csv(FILE *file, const struct component_list *components) {
+    fprintf(file, "label,area,min_x,min_y,max_x,max_y,centroid_x,centroid_y\n");
+    for (int i = 0; i < components->count; i++) {
+        const struct component_stats *c = &components->items[i];
+        fprintf(file, "%d,%llu,%d,%d,%d,%d,%.2f,%.2f\n", i + 1, c->area, c->min_x, c->min_y, c->max_x, c->max_y,
+                (double)c->sum_x / c->area, (double)c->sum_y / c->area);
+    }
+    return ferror(file) ? -1 : 0;
+}
+
+static void put_u32(unsigned char *out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+static void put_u64(unsigned char *out, uint64_t value) {
+    for (int i = 0; i < 8; i++) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+// "CCL2", uint32 count, then per component: uint64 area, uint32 min_x, min_y,
+// max_x, max_y and float centroid x, y; all little endian, 32 bytes per record.
+// CCL1 had uint16 corners and a uint32 area, too narrow past 65535 pixels a side.
+static int write_components_binary(FILE *file, const struct component_list *components) {
+    unsigned char header[8] = { 'C', 'C', 'L', '2' };
+    put_u32(header + 4, (uint32_t)components->count);
+    fwrite(header, 1, sizeof(header), file);
+    for (int i = 0; i < components->count; i++) {
+        const struct component_stats *c = &components->items[i];
+        unsigned char record[32];
+        float centroid[2] = { (float)((double)c->sum_x / c->area), (float)((double)c->sum_y / c->area) };
+        uint32_t centroid_bits[2];
+        memcpy(centroid_bits, centroid, sizeof(centroid));
+        put_u64(record, c->area);
+        put_u32(record + 8, (uint32_t)c->min_x);
+        put_u32(record + 12, (uint32_t)c->min_y);
+        put_u32(record + 16, (uint32_t)c->max_x);
+        put_u32(record + 20, (uint32_t)c->max_y);
+        put_u32(record + 24, centroid_bits[0]);
+        put_u32(record + 28, centroid_bits[1]);
+        fwrite(record, 1, sizeof(record), file);
+    }
+    return ferror(file) ? -1 : 0;
+}
+
+int write_component_sidecar(const char *image_path, const struct component_list *components,
+                            enum component_format format) {
+    if (format == COMPONENTS_NONE) return 0;
+
+    // Appended rather than replacing the extension: img.jpg and img.png share a stem
+    char path[OUTPUT_PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s%s", image_path, format == COMPONENTS_CSV ? ".csv" : ".ccl") >=
+        (int)sizeof(path)) {
+        fprintf(stderr, "Output path too long: %s\n", image_path);
+        return -1;
+    }
+
+    FILE *file = fopen(path, format == COMPONENTS_CSV ? "w" : "wb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    printf("Saving %d components to %s\n", components->count, path);
+    int status = format == COMPONENTS_CSV ? write_components_csv(file, components)
+                                          : write_components_binary(file, components);
+    if (fclose(file) != 0) status = -1;
+    if (status != 0) fprintf(stderr, "Error writing %s\n", path);
+    return status;
+}
@@ -0,0 +1,55 @@
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include <stddef.h>
+#include "bitmask.h"
+
+// Sidecar written next to a labeled image
+enum component_format {
+    COMPONENTS_NONE,
+    COMPONENTS_CSV,     // <image>.csv, one line per component
+    COMPONENTS_BINARY   // <image>.ccl, 32-byte little-endian records
+};
+
+struct component_params {
+    enum component_format format;   // --components
+    int skip_image;                 // --no-image: write only the sidecar
+};
+
+struct component_stats {
+    unsigned long long area;
+    int min_x, min_y, max_x, max_y;
+    unsigned long long sum_x, sum_y;    // centroid = sum / area
+};
+
+// Components are numbered in raster order of their first pixel
+struct component_list {
+    struct component_stats *items;
+    int count;
+};
+
+// Parses "csv" or "bin". Returns 0 on success, -1 otherwise.
+int parse_component_format(const char *name, enum component_format *format);
+
+// 8-connected labeling of the nonzero pixels of an 8-bit mask, collecting area,
+// bounding box and centroid sums per component. Returns -1 on allocation failure.
+int label_components(const unsigned char *binary_image, int width, int height, struct component_list *components);
+
+// Block-based version: every row tile runs its own union-find, the tile seams
+// are merged, and statistics are gathered per tile with components that spill
+// over from an earlier tile merged at the end
+int label_components_omp(const unsigned char *binary_image, int width, int height, struct component_list *components);
+
+// The same on a packed mask; the 8-bit versions pack first. Empty words are
+// skipped, so sparse masks cost little more than their foreground.
+int label_bitmask(const struct bitmask *mask, struct component_list *components);
+int label_bitmask_omp(const struct bitmask *mask, struct component_list *components);
+
+void free_component_list(struct component_list *components);
+
+// Writes the sidecar of image_path in the requested format, appending .csv or
+// .ccl to it. Returns 0 on success, -1 on a write error.
+int write_component_sidecar(const char *image_path, const struct component_list *components,
+                            enum component_format format);
+
+#endif
@@ -0,0 +1,280 @@
+#include "convolve.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+#include "tasks.h"
+
+// Fractional bits kept in the intermediate rows between the two passes
+#define INTERMEDIATE_BITS 8
+#define VERTICAL_SHIFT (KERNEL_SHIFT - INTERMEDIATE_BITS)
+#define HORIZONTAL_SHIFT (KERNEL_SHIFT + INTERMEDIATE_BITS)
+
+int parse_border_mode(const char *name, enum border_mode *mode) {
+    if (!strcmp(name, "zero")) *mode = BORDER_ZERO;
+    else if (!strcmp(name, "replicate")) *mode = BORDER_REPLICATE;
+    else if (!strcmp(name, "reflect")) *mode = BORDER_REFLECT;
+    else return -1;
+    return 0;
+}
+
+// Index read for position i of a line of n pixels, or -1 for a zero pixel
+static int border_index(int i, int n, enum border_mode border) {
+    if (i >= 0 && i < n) return i;
+    switch (border) {
+    case BORDER_ZERO:
+        return -1;
+    case BORDER_REPLICATE:
+        return i < 0 ? 0 : n - 1;
+    case BORDER_REFLECT:
+    default:
+        if (n == 1) return 0;
+        // Reflection has period 2 * (n - 1)
+        i %= 2 * (n - 1);
+        if (i < 0) i += 2 * (n - 1);
+        return i < n ? i : 2 * (n - 1) - i;
+    }
+}
+
+int make_gaussian_kernel(double sigma, struct kernel_1d *kernel) {
+    int radius = (int)ceil(3.0 * sigma);
+    if (radius < 1) radius = 1;
+    if (radius > MAX_KERNEL_RADIUS) return -1;
+
+    double weights[2 * MAX_KERNEL_RADIUS + 1];
+    double total = 0.0;
+    for (int i = -radius; i <= radius; i++) {
+        weights[i + radius] = exp(-(double)(i * i) / (2.0 * sigma * sigma));
+        total += weights[i + radius];
+    }
+
+    // Round every tap, then give the rounding error to the center so the
+    // kernel sums to exactly one and flat areas keep their value
+    int sum = 0;
+    kernel->radius = radius;
+    for (int i = 0; i <= 2 * radius; i++) {
+        kernel->taps[i] = (int)lround(weights[i] / total * KERNEL_ONE);
+        sum += kernel->taps[i];
+    }
+    kernel->taps[radius] += KERNEL_ONE - sum;
+    return 0;
+}
+
+struct separable_tile_ctx {
+    const unsigned char *input_image;
+    unsigned char *output_image;
+    int width;
+    int height;
+    int channels;
+    const struct kernel_1d *vertical;
+    const struct kernel_1d *horizontal;
+    enum border_mode border;
+};
+
+static void separable_tile(void *arg, int row_begin, int row_end) {
+    struct separable_tile_ctx *ctx = arg;
+    int channels = ctx->channels;
+    int row_length = ctx->width * channels;
+    int vradius = ctx->vertical->radius;
+    int hradius = ctx->horizontal->radius;
+    int pad = hradius * channels;
+
+    int *acc = malloc((size_t)row_length * sizeof(int));
+    unsigned short *line = malloc((size_t)(row_length + 2 * pad) * sizeof(unsigned short));
+    if (acc == NULL || line == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        free(acc);
+        free(line);
+        return;
+    }
+
+    for (int y = row_begin; y < row_end; y++) {
+        // Vertical pass: weighted sum of the source rows around y
+        memset(acc, 0, (size_t)row_length * sizeof(int));
+        for (int k = -vradius; k <= vradius; k++) {
+            int source = border_index(y + k, ctx->height, ctx->border);
+            if (source < 0) continue;
+            const unsigned char *row = ctx->input_image + (size_t)source * row_length;
+            int tap = ctx->vertical->taps[k + vradius];
+            #pragma omp simd
+            for (int i = 0; i < row_length; i++) {
+                acc[i] += tap * row[i];
+            }
+        }
+        unsigned short *center = line + pad;
+        #pragma omp simd
+        for (int i = 0; i < row_length; i++) {
+            int value = (acc[i] + (1 << (VERTICAL_SHIFT - 1))) >> VERTICAL_SHIFT;
+            center[i] = value < 0 ? 0 : value > 0xffff ? 0xffff : value;
+        }
+
+        // Extend the intermediate row by hradius pixels on both sides
+        for (int x = 1; x <= hradius; x++) {
+            int left = border_index(-x, ctx->width, ctx->border);
+            int right = border_index(ctx->width - 1 + x, ctx->width, ctx->border);
+            for (int c = 0; c < channels; c++) {
+                center[-x * channels + c] = left < 0 ? 0 : center[left * channels + c];
+                center[(ctx->width - 1 + x) * channels + c] = right < 0 ? 0 : center[right * channels + c];
+            }
+        }
+
+        // Horizontal pass: tap k reads the padded row shifted by k pixels
+        memset(acc, 0, (size_t)row_length * sizeof(int));
+        for (int k = 0; k <= 2 * hradius; k++) {
+            const unsigned short *shifted = line + k * channels;
+            int tap = ctx->horizontal->taps[k];
+            #pragma omp simd
+            for (int i = 0; i < row_length; i++) {
+                acc[i] += tap * shifted[i];
+            }
+        }
+        unsigned char *out = ctx->output_image + (size_t)y * row_length;
+        #pragma omp simd
+        for (int i = 0; i < row_length; i++) {
+            int value = (acc[i] + (1 << (HORIZONTAL_SHIFT - 1))) >> HORIZONTAL_SHIFT;
+            out[i] = value < 0 ? 0 : value > 255 ? 255 : value;
+        }
+    }
+
+    free(acc);
+    free(line);
+}
+
+void convolve_separable(const unsigned char *input_image, unsigned char *output_image,
+                        int width, int height, int channels,
+                        const struct kernel_1d *vertical, const struct kernel_1d *horizontal,
+                        enum border_mode border) {
+    struct separable_tile_ctx ctx = { input_image, output_image, width, height, channels,
+                                      vertical, horizontal, border };
+    separable_tile(&ctx, 0, height);
+}
+
+void convolve_separable_omp(const unsigned char *input_image, unsigned char *output_image,
+                            int width, int height, int channels,
+                            const struct kernel_1d *vertical, const struct kernel_1d *horizontal,
+                            enum border_mode border) {
+    struct separable_tile_ctx ctx = { input_image, output_image, width, height, channels,
+                                      vertical, horizontal, border };
+    parallel_tiles(height, default_tile_rows((long)width * channels), separable_tile, &ctx);
+}
+
+struct box_tile_ctx {
+    const unsigned char *input_image;
+    unsigned char *output_image;
+    int width;
+    int height;
+    int channels;
+    int radius;
+    enum border_mode border;
+};
+
+// Adds (sign 1) or removes (sign -1) source row y to the column sums
+static void accumulate_row(const struct box_tile_ctx *ctx, unsigned int *columns, int y, int sign) {
+    int source = border_index(y, ctx->height, ctx->border);
+    if (source < 0) return;
+    int row_length = ctx->width * ctx->channels;
+    const unsigned char *row = ctx->input_image + (size_t)source * row_length;
+    #pragma omp simd
+    for (int i = 0; i < row_length; i++) {
+        columns[i] += sign * row[i];
+    }
+}
+
+static void box_tile(void *arg, int row_begin, int row_end) {
+    struct box_tile_ctx *ctx = arg;
+    int channels = ctx->channels;
+    int width = ctx->width;
+    int radius = ctx->radius;
+    int row_length = width * channels;
+    int pad = radius * channels;
+    unsigned int area = (unsigned int)(2 * radius + 1) * (2 * radius + 1);
+
+    // columns: running vertical sums, line: the same padded horizontally
+    unsigned int *columns = calloc((size_t)row_length, sizeof(unsigned int));
+    unsigned int *line = malloc((size_t)(row_length + 2 * pad) * sizeof(unsigned int));
+    if (columns == NULL || line == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        free(columns);
+        free(line);
+        return;
+    }
+
+    // Each tile seeds its own column sums, then slides them down one row at a time
+    for (int k = -radius; k <= radius; k++) {
+        accumulate_row(ctx, columns, row_begin + k, 1);
+    }
+
+    for (int y = row_begin; y < row_end; y++) {
+        if (y > row_begin) {
+            accumulate_row(ctx, columns, y + radius, 1);
+            accumulate_row(ctx, columns, y - radius - 1, -1);
+        }
+
+        unsigned int *center = line + pad;
+        memcpy(center, columns, (size_t)row_length * sizeof(unsigned int));
+        for (int x = 1; x <= radius; x++) {
+            int left = border_index(-x, width, ctx->border);
+            int right = border_index(width - 1 + x, width, ctx->border);
+            for (int c = 0; c < channels; c++) {
+                center[-x * channels + c] = left < 0 ? 0 : columns[left * channels + c];
+                center[(width - 1 + x) * channels + c] = right < 0 ? 0 : columns[right * channels + c];
+            }
+        }
+
+        // Horizontal running sum per channel: add the entering column, drop the leaving one
+        unsigned char *out = ctx->output_image + (size_t)y * row_length;
+        for (int c = 0; c < channels; c++) {
+            unsigned int sum = 0;
+            for (int k = 0; k <= 2 * radius; k++) {
+                sum += line[k * channels + c];
+            }
+            out[c] = (unsigned char)((sum + area / 2) / area);
+            for (int x = 1; x < width; x++) {
+                sum += line[(x + 2 * radius) * channels + c] - line[(x - 1) * channels + c];
+                out[x * channels + c] = (unsigned char)((sum + area / 2) / area);
+            }
+        }
+    }
+
+    free(columns);
+    free(line);
+}
+
+void box_filter(const unsigned char *input_image, unsigned char *output_image,
+                int width, int height, int channels, int radius, enum border_mode border) {
+    struct box_tile_ctx ctx = { input_image, output_image, width, height, channels, radius, border };
+    box_tile(&ctx, 0, height);
+}
+
+void box_filter_omp(const unsigned char *input_image, unsigned char *output_image,
+                    int width, int height, int channels, int radius, enum border_mode border) {
+    struct box_tile_ctx ctx = { input_image, output_image, width, height, channels, radius, border };
+    // Seeding costs 2 * radius + 1 rows per tile, so keep tiles well above that
+    int tile_rows = default_tile_rows((long)width * channels);
+    if (tile_rows < 8 * radius) tile_rows = 8 * radius;
+    parallel_tiles(height, tile_rows, box_tile, &ctx);
+}
+
+int blur_image(const unsigned char *input_image, unsigned char *output_image,
+               int width, int height, int channels, const struct blur_params *params) {
+    if (params->box_radius > 0) {
+        box_filter(input_image, output_image, width, height, channels, params->box_radius, params->border);
+        return 0;
+    }
+    struct kernel_1d kernel;
+    if (make_gaussian_kernel(params->sigma, &kernel) != 0) return -1;
+    convolve_separable(input_image, output_image, width, height, channels, &kernel, &kernel, params->border);
+    return 0;
+}
+
+int blur_image_omp(const unsigned char *input_image, unsigned char *output_image,
+                   int width, int height, int channels, const struct blur_params *params) {
+    if (params->box_radius > 0) {
+        box_filter_omp(input_image, output_image, width, height, channels, params->box_radius, params->border);
+        return 0;
+    }
+    struct kernel_1d kernel;
+    if (make_gaussian_kernel(params->sigma, &kernel) != 0) return -1;
+    convolve_separable_omp(input_image, output_image, width, height, channels, &kernel, &kernel, params->border);
+    return 0;
+}
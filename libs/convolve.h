@@ -0,0 +1,67 @@
+#ifndef CONVOLVE_H
+#define CONVOLVE_H
+
+#include <stddef.h>
+
+// Kernel taps are fixed point with KERNEL_SHIFT fractional bits. The absolute
+// values of a kernel's taps must sum to at most KERNEL_ONE (smoothing kernels),
+// which keeps every accumulator of the 8-bit path inside 32 bits.
+#define KERNEL_SHIFT 14
+#define KERNEL_ONE (1 << KERNEL_SHIFT)
+#define MAX_KERNEL_RADIUS 63
+
+// Keeps the 32-bit window sums of the box filter from overflowing
+#define MAX_BOX_RADIUS 1024
+
+// How pixels outside the image are read
+enum border_mode {
+    BORDER_ZERO,        // 0
+    BORDER_REPLICATE,   // aaa|abcd|ddd
+    BORDER_REFLECT      // cb|abcd|cb (mirrored about the edge pixel)
+};
+
+struct kernel_1d {
+    int radius;
+    int taps[2 * MAX_KERNEL_RADIUS + 1];
+};
+
+struct blur_params {
+    double sigma;               // Gaussian standard deviation in pixels
+    int box_radius;             // > 0: box filter of this radius instead of the Gaussian
+    enum border_mode border;
+};
+
+// Parses "zero", "replicate" or "reflect". Returns 0 on success, -1 otherwise.
+int parse_border_mode(const char *name, enum border_mode *mode);
+
+// Normalized Gaussian of radius ceil(3 * sigma). Returns -1 when that radius
+// exceeds MAX_KERNEL_RADIUS.
+int make_gaussian_kernel(double sigma, struct kernel_1d *kernel);
+
+// Separable convolution of an interleaved 8-bit image with channels channels:
+// a vertical pass per output row into a 16-bit intermediate row, then a
+// horizontal pass. Both inner loops run over the whole interleaved row and are
+// vectorized with omp simd.
+void convolve_separable(const unsigned char *input_image, unsigned char *output_image,
+                        int width, int height, int channels,
+                        const struct kernel_1d *vertical, const struct kernel_1d *horizontal,
+                        enum border_mode border);
+void convolve_separable_omp(const unsigned char *input_image, unsigned char *output_image,
+                            int width, int height, int channels,
+                            const struct kernel_1d *vertical, const struct kernel_1d *horizontal,
+                            enum border_mode border);
+
+// Mean over a (2 * radius + 1)^2 window with running sums: the cost per pixel
+// does not depend on radius
+void box_filter(const unsigned char *input_image, unsigned char *output_image,
+                int width, int height, int channels, int radius, enum border_mode border);
+void box_filter_omp(const unsigned char *input_image, unsigned char *output_image,
+                    int width, int height, int channels, int radius, enum border_mode border);
+
+// Gaussian or box blur as selected by params. Returns -1 when the Gaussian is too wide.
+int blur_image(const unsigned char *input_image, unsigned char *output_image,
+               int width, int height, int channels, const struct blur_params *params);
+int blur_image_omp(const unsigned char *input_image, unsigned char *output_image,
+                   int width, int height, int channels, const struct blur_params *params);
+
+#endif
@@ -0,0 +1,326 @@
+#include "decode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#include "png_decode.h"
+
+// What a NULL params decodes with: the whole image at full size
+static const struct decode_params default_decode = { 1, { 1.0, RESIZE_AUTO }, { 0, 0, 0, 0 } };
+
+int is_jpeg_file(const char *path) {
+    const char *ext = strrchr(path, '.');
+    return ext && (strcasecmp(ext, ".jpg") == 0 || strcasecmp(ext, ".jpeg") == 0);
+}
+
+int algorithm_uses_luma(const char *algorithm) {
+    return !strcmp(algorithm, "grayscale") || !strcmp(algorithm, "sobel") || !strcmp(algorithm, "otsu") ||
+           !strcmp(algorithm, "adaptive") || !strcmp(algorithm, "canny") ||
+           !strcmp(algorithm, "morph") || !strcmp(algorithm, "median") ||
+           !strcmp(algorithm, "equalize") || !strcmp(algorithm, "hough");
+}
+
+// libjpeg reports fatal errors through error_exit, which must not return
+struct jpeg_error_ctx {
+    struct jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+    struct jpeg_error_ctx *err = (struct jpeg_error_ctx *)cinfo->err;
+    longjmp(err->jump, 1);
+}
+
+static unsigned char *load_jpeg(const char *path, int *width, int *height, int *channels,
+                                int desired_channels, int luma_only, int scale_denom) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_ctx err;
+    unsigned char *volatile pixels = NULL;
+    unsigned char *volatile scanline = NULL;
+
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = jpeg_error_exit;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(file);
+        free(pixels);
+        free(scanline);
+        return NULL;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, file);
+    jpeg_read_header(&cinfo, TRUE);
+
+    if (luma_only || desired_channels == 1 || desired_channels == 2) {
+        // Only the Y component is entropy-decoded into pixels
+        cinfo.out_color_space = JCS_GRAYSCALE;
+    } else if (desired_channels != 0 || cinfo.jpeg_color_space != JCS_GRAYSCALE) {
+        cinfo.out_color_space = JCS_RGB;
+    }
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale_denom;
+
+    jpeg_start_decompress(&cinfo);
+
+    int out_width = cinfo.output_width;
+    int out_height = cinfo.output_height;
+    int decoded_channels = cinfo.output_components;
+    // libjpeg has no alpha, so 2 and 4 channels are added to each decoded row
+    int out_channels = !luma_only && desired_channels != 0 ? desired_channels : decoded_channels;
+    size_t stride = (size_t)out_width * out_channels;
+    pixels = (unsigned char *)malloc(stride * out_height);
+    if (out_channels != decoded_channels) scanline = (unsigned char *)malloc((size_t)out_width * decoded_channels);
+    if (pixels == NULL || (out_channels != decoded_channels && scanline == NULL)) {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(file);
+        free(pixels);
+        free(scanline);
+        return NULL;
+    }
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+        unsigned char *out_row = pixels + cinfo.output_scanline * stride;
+        JSAMPROW row = scanline != NULL ? scanline : out_row;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+        if (scanline != NULL) convert_channels(scanline, decoded_channels, out_row, out_channels, out_width);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(file);
+    free(scanline);
+
+    *width = out_width;
+    *height = out_height;
+    *channels = out_channels;
+    return pixels;
+}
+
+// Raw inputs handed out as their mapping, so release_image can unmap them
+struct mapped_image {
+    struct raw_image raw;
+    struct mapped_image *next;
+};
+
+static struct mapped_image *mapped_images = NULL;
+
+void release_image(unsigned char *pixels) {
+    struct mapped_image *found = NULL;
+    if (pixels == NULL) return;
+    #pragma omp critical(mapped_images)
+    {
+        for (struct mapped_image **link = &mapped_images; *link != NULL; link = &(*link)->next) {
+            if ((*link)->raw.pixels == pixels) {
+                found = *link;
+                *link = found->next;
+                break;
+            }
+        }
+    }
+    if (found == NULL) {
+        stbi_image_free(pixels);
+        return;
+    }
+    close_raw_image(&found->raw);
+    free(found);
+}
+
+void convert_channels(const unsigned char *in, int in_channels, unsigned char *out, int out_channels, int width) {
+    for (int x = 0; x < width; x++, in += in_channels, out += out_channels) {
+        int r = in[0], g = in_channels >= 3 ? in[1] : in[0], b = in_channels >= 3 ? in[2] : in[0];
+        int a = in_channels == 2 ? in[1] : in_channels == 4 ? in[3] : 255;
+        int y = in_channels >= 3 ? (r * 77 + g * 150 + b * 29) >> 8 : r;
+        switch (out_channels) {
+            case 1: out[0] = (unsigned char)y; break;
+            case 2: out[0] = (unsigned char)y; out[1] = (unsigned char)a; break;
+            case 3: out[0] = (unsigned char)r; out[1] = (unsigned char)g; out[2] = (unsigned char)b; break;
+            default: out[0] = (unsigned char)r; out[1] = (unsigned char)g; out[2] = (unsigned char)b;
+                     out[3] = (unsigned char)a; break;
+        }
+    }
+}
+
+// Whole file, or only the blocks or tiles under crop when it is given
+static unsigned char *load_raw(const char *path, int *width, int *height, int *channels, int desired_channels,
+                               const struct region_params *crop, int parallel) {
+    struct raw_image raw;
+    int status = crop ? read_raw_region(path, crop->x, crop->y, crop->width, crop->height, &raw, parallel)
+                      : open_raw_image(path, &raw, parallel);
+    if (status != 0) return NULL;
+    int out_channels = desired_channels ? desired_channels : raw.channels;
+    size_t row_bytes = (size_t)raw.width * out_channels;
+    *width = raw.width;
+    *height = raw.height;
+    *channels = out_channels;
+
+    if (out_channels == raw.channels && raw.stride == row_bytes) {
+        // Rows are already packed: no copy at all
+        if (raw.map == NULL) return raw.pixels;
+        struct mapped_image *mapped = malloc(sizeof(*mapped));
+        if (mapped != NULL) {
+            mapped->raw = raw;
+            #pragma omp critical(mapped_images)
+            {
+                mapped->next = mapped_images;
+                mapped_images = mapped;
+            }
+            return raw.pixels;
+        }
+    }
+
+    unsigned char *pixels = malloc(row_bytes * raw.height);
+    for (int y = 0; pixels != NULL && y < raw.height; y++) {
+        const unsigned char *in = raw.pixels + (size_t)y * raw.stride;
+        if (out_channels == raw.channels) memcpy(pixels + (size_t)y * row_bytes, in, row_bytes);
+        else convert_channels(in, raw.channels, pixels + (size_t)y * row_bytes, out_channels, raw.width);
+    }
+    close_raw_image(&raw);
+    return pixels;
+}
+
+static unsigned char *decode_image(const char *path, int *width, int *height, int *channels,
+                                   int desired_channels, int luma_only, const struct decode_params *params,
+                                   int parallel) {
+    if (is_raw_file(path)) {
+        // No codec to skip: channels are converted only when desired_channels asks
+        return load_raw(path, width, height, channels, desired_channels, NULL, parallel);
+    }
+    if (is_jpeg_file(path)) {
+        unsigned char *pixels = load_jpeg(path, width, height, channels, desired_channels, luma_only,
+                                          params->jpeg_scale_denom);
+        if (pixels != NULL) return pixels;
+        // Colour spaces libjpeg cannot convert (e.g. CMYK): fall back to stb_image
+    } else if (is_png_file(path)) {
+        // Luma on one thread keeps streaming two rows at a time; everything
+        // else overlaps inflate with unfiltering, or decodes our own pieces
+        int wanted = luma_only ? 1 : desired_channels;
+        unsigned char *pixels = NULL;
+        if (wanted != 1 || parallel) {
+            pixels = load_png(path, width, height, channels, wanted, parallel);
+        }
+        if (pixels == NULL && wanted == 1 && (pixels = load_png_luma(path, width, height)) != NULL) *channels = 1;
+        if (pixels != NULL) return pixels;
+        // Interlaced, palette or low bit depth PNGs: fall back to stb_image
+    }
+
+    int file_channels;
+    unsigned char *pixels = stbi_load(path, width, height, &file_channels, desired_channels);
+    if (pixels != NULL) *channels = desired_channels ? desired_channels : file_channels;
+    return pixels;
+}
+
+// Clips the region to a width x height image and grows it by halo on every
+// side that has pixels to spare; inner receives the region within grown
+static int clip_region(const struct region_params *region, int width, int height, int halo,
+                       struct region_params *grown, struct region_params *inner) {
+    int x0 = region->x, y0 = region->y;
+    int x1 = region->x + region->width < width ? region->x + region->width : width;
+    int y1 = region->y + region->height < height ? region->y + region->height : height;
+    if (x0 >= x1 || y0 >= y1) {
+        fprintf(stderr, "Region %dx%d at (%d, %d) lies outside the %dx%d image\n",
+                region->width, region->height, region->x, region->y, width, height);
+        return -1;
+    }
+    grown->x = x0 - halo > 0 ? x0 - halo : 0;
+    grown->y = y0 - halo > 0 ? y0 - halo : 0;
+    grown->width = (x1 + halo < width ? x1 + halo : width) - grown->x;
+    grown->height = (y1 + halo < height ? y1 + halo : height) - grown->y;
+    *inner = (struct region_params){ x0 - grown->x, y0 - grown->y, x1 - x0, y1 - y0 };
+    return 0;
+}
+
+// Raw files read only what the region overlaps; other formats have to be
+// decoded whole and cropped
+static unsigned char *decode_region(const char *path, int halo, int *width, int *height, int *channels,
+                                    int desired_channels, int luma_only, const struct decode_params *params,
+                                    struct region_params *inner, int parallel) {
+    int full_width, full_height, full_channels;
+    struct region_params grown;
+    if (is_raw_file(path)) {
+        if (!raw_image_info(path, &full_width, &full_height, &full_channels) ||
+            clip_region(&params->region, full_width, full_height, halo, &grown, inner) != 0) {
+            return NULL;
+        }
+        return load_raw(path, width, height, channels, desired_channels, &grown, parallel);
+    }
+
+    unsigned char *full = decode_image(path, &full_width, &full_height, channels, desired_channels, luma_only,
+                                       params, parallel);
+    if (full == NULL) return NULL;
+    if (clip_region(&params->region, full_width, full_height, halo, &grown, inner) != 0) {
+        release_image(full);
+        return NULL;
+    }
+    size_t row_bytes = (size_t)grown.width * *channels;
+    unsigned char *pixels = malloc(row_bytes * grown.height);
+    for (int y = 0; pixels != NULL && y < grown.height; y++) {
+        memcpy(pixels + (size_t)y * row_bytes,
+               full + ((size_t)(grown.y + y) * full_width + grown.x) * *channels, row_bytes);
+    }
+    release_image(full);
+    *width = grown.width;
+    *height = grown.height;
+    return pixels;
+}
+
+void region_size(const struct region_params *region, int width, int height, int *region_width, int *region_height) {
+    if (region->width == 0) {
+        *region_width = width;
+        *region_height = height;
+        return;
+    }
+    int x1 = region->x + region->width < width ? region->x + region->width : width;
+    int y1 = region->y + region->height < height ? region->y + region->height : height;
+    *region_width = x1 > region->x ? x1 - region->x : 0;
+    *region_height = y1 > region->y ? y1 - region->y : 0;
+}
+
+unsigned char *load_image(const char *path, int *width, int *height, int *channels,
+                          int desired_channels, int luma_only, const struct decode_params *params, int parallel) {
+    return load_image_region(path, 0, width, height, channels, desired_channels, luma_only, params, NULL, parallel);
+}
+
+int load_image_buffer(const char *path, struct image_buffer *image, int desired_channels, int luma_only,
+                      const struct decode_params *params, int parallel) {
+    int width, height, channels;
+    unsigned char *pixels = load_image(path, &width, &height, &channels, desired_channels, luma_only, params,
+                                       parallel);
+    if (pixels == NULL) return -1;
+    *image = image_wrap(pixels, width, height, channels, 0);
+    image->flags = IMAGE_LOADED;
+    return 0;
+}
+
+unsigned char *load_image_region(const char *path, int halo, int *width, int *height, int *channels,
+                                 int desired_channels, int luma_only, const struct decode_params *params,
+                                 struct region_params *inner, int parallel) {
+    if (params == NULL) params = &default_decode;
+    struct region_params unused;
+    unsigned char *pixels = params->region.width > 0
+        ? decode_region(path, halo, width, height, channels, desired_channels, luma_only, params,
+                        inner ? inner : &unused, parallel)
+        : decode_image(path, width, height, channels, desired_channels, luma_only, params, parallel);
+
+    if (pixels != NULL && params->resize.scale != 1.0) {
+        int out_width, out_height;
+        unsigned char *resized = resize_image(pixels, *width, *height, *channels, &params->resize,
+                                              &out_width, &out_height, parallel);
+        release_image(pixels);
+        pixels = resized;
+        if (resized != NULL) {
+            *width = out_width;
+            *height = out_height;
+        }
+    }
+    // --roi and --scale are exclusive, so only a whole image can have been resized
+    if (pixels != NULL && inner != NULL && params->region.width == 0) {
+        *inner = (struct region_params){ 0, 0, *width, *height };
+    }
+    return pixels;
+}
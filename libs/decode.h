@@ -0,0 +1,72 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include "image.h"
+#include "resize.h"
+#include "rawimage.h"
+
+// Region of interest (--roi) in decoded pixels, before --scale; a width of 0
+// means the whole image
+struct region_params {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// How every input is decoded and reduced before an algorithm sees it
+struct decode_params {
+    int jpeg_scale_denom;           // --jpeg-scale: DCT-domain downscaling of JPEGs, 1, 2, 4 or 8
+    struct resize_params resize;    // --scale: resize after decoding (and any JPEG DCT scaling)
+    struct region_params region;    // --roi: restrict to this region, clipped to each image
+};
+
+// Loads an image, like stbi_load, but *channels receives the number of
+// channels of the returned buffer (desired_channels when it is non-zero).
+// With luma_only set the caller only needs the luma plane: JPEG files are
+// then decoded straight to one channel by libjpeg, skipping chroma IDCT,
+// upsampling and colour conversion, and PNG files are converted to luma row
+// by row while they are unfiltered (png_decode.c). Anything those paths
+// cannot handle goes through stb_image and honours desired_channels only.
+// Raw containers (.raw) whose rows need no padding removed or channel
+// conversion are returned as the file mapping itself.
+// The image is then cropped and resized per params; NULL decodes it whole
+// and at full size. parallel lets raw inflate, PNG decoding and the resize
+// run as tile tasks, for omp and mpi runs. The buffer is released with
+// release_image.
+unsigned char *load_image(const char *path, int *width, int *height, int *channels,
+                          int desired_channels, int luma_only, const struct decode_params *params, int parallel);
+
+// load_image into a packed image_buffer that image_free hands back to
+// release_image. Returns -1 when the image cannot be loaded.
+int load_image_buffer(const char *path, struct image_buffer *image, int desired_channels, int luma_only,
+                      const struct decode_params *params, int parallel);
+
+// Size of what load_image returns for a width x height image under region.
+// Tiled and other raw files read only the blocks under a region; other
+// formats are decoded whole and cropped.
+void region_size(const struct region_params *region, int width, int height, int *region_width, int *region_height);
+
+// load_image with the region grown by halo pixels on each side where the
+// image has them, so neighbourhood kernels see real pixels along the region
+// border. *inner receives the region within the returned buffer, which is
+// what the caller should write out.
+unsigned char *load_image_region(const char *path, int halo, int *width, int *height, int *channels,
+                                 int desired_channels, int luma_only, const struct decode_params *params,
+                                 struct region_params *inner, int parallel);
+
+// Frees a buffer from load_image, unmapping it if it is a raw file mapping;
+// anything else goes to stbi_image_free
+void release_image(unsigned char *pixels);
+
+// Converts width pixels between channel counts with stb_image's rules: luma
+// from RGB with its weights, gray replicated into RGB, alpha dropped or set opaque
+void convert_channels(const unsigned char *in, int in_channels, unsigned char *out, int out_channels, int width);
+
+// Returns 1 if path has a .jpg/.jpeg extension
+int is_jpeg_file(const char *path);
+
+// Returns 1 if algorithm only ever looks at the luma plane of its input
+int algorithm_uses_luma(const char *algorithm);
+
+#endif
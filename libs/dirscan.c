@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+#include "dirscan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+const char *const image_extensions[] = { ".png", ".jpg", ".jpeg", ".raw", NULL };
+
+// Layout of the records returned by getdents64
+struct linux_dirent64 {
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+int has_extension(const char *filename, const char *const *extensions) {
+    const char *ext = strrchr(filename, '.');
+    if (!ext) return 0;
+    for (int i = 0; extensions[i] != NULL; i++) {
+        if (strcasecmp(ext, extensions[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+void file_list_init(struct file_list *list) {
+    memset(list, 0, sizeof(*list));
+}
+
+int file_list_append(struct file_list *list, const char *name) {
+    size_t length = strlen(name) + 1;
+    if (list->arena_used + length > list->arena_capacity) {
+        size_t capacity = list->arena_capacity ? list->arena_capacity * 2 : 64 * 1024;
+        while (capacity < list->arena_used + length) capacity *= 2;
+        char *arena = (char *)realloc(list->arena, capacity);
+        if (arena == NULL) return -1;
+        list->arena = arena;
+        list->arena_capacity = capacity;
+    }
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 1024;
+        size_t *offsets = (size_t *)realloc(list->offsets, capacity * sizeof(size_t));
+        if (offsets == NULL) return -1;
+        list->offsets = offsets;
+        list->capacity = capacity;
+    }
+    memcpy(list->arena + list->arena_used, name, length);
+    list->offsets[list->count++] = list->arena_used;
+    list->arena_used += length;
+    return 0;
+}
+
+int file_list_finish(struct file_list *list) {
+    // The arena no longer moves, so hand out stable pointers
+    free(list->names);
+    list->names = (char **)malloc((list->count > 0 ? list->count : 1) * sizeof(char *));
+    if (list->names == NULL) return -1;
+    for (int i = 0; i < list->count; i++) {
+        list->names[i] = list->arena + list->offsets[i];
+    }
+    return 0;
+}
+
+// Regular files only; symlinks and filesystems without d_type need a stat
+static int is_regular(int dir_fd, const char *name, unsigned char d_type) {
+    if (d_type == DT_REG) return 1;
+    if (d_type != DT_UNKNOWN && d_type != DT_LNK) return 0;
+    struct stat st;
+    return fstatat(dir_fd, name, &st, 0) == 0 && S_ISREG(st.st_mode);
+}
+
+// Real directories only, so symlink loops cannot make a walk recurse forever
+static int is_directory(int dir_fd, const char *name, unsigned char d_type) {
+    if (d_type == DT_DIR) return strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+    if (d_type != DT_UNKNOWN) return 0;
+    struct stat st;
+    return strcmp(name, ".") != 0 && strcmp(name, "..") != 0 &&
+           fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+}
+
+int scan_directory(const char *folder, const char *const *extensions, struct file_list *list) {
+    return scan_directory_entries(folder, extensions, list, NULL);
+}
+
+int scan_directory_entries(const char *folder, const char *const *extensions,
+                           struct file_list *list, struct file_list *subdirs) {
+    file_list_init(list);
+    if (subdirs != NULL) file_list_init(subdirs);
+
+    int dir_fd = open(folder, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) {
+        return -1;
+    }
+
+    char *buffer = (char *)malloc(SCAN_BUFFER_SIZE);
+    if (buffer == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        close(dir_fd);
+        return -1;
+    }
+    int status = 0;
+    while (status == 0) {
+        long nread = syscall(SYS_getdents64, dir_fd, buffer, SCAN_BUFFER_SIZE);
+        if (nread <= 0) {
+            // A failed read mid-listing would leave a silently partial list
+            if (nread < 0) {
+                perror("getdents64");
+                status = -1;
+            }
+            break;
+        }
+        for (long pos = 0; pos < nread && status == 0;) {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *)(buffer + pos);
+            pos += entry->d_reclen;
+            // Filter by extension before anything that may cost a syscall
+            if (has_extension(entry->d_name, extensions) &&
+                is_regular(dir_fd, entry->d_name, entry->d_type)) {
+                status = file_list_append(list, entry->d_name);
+            } else if (subdirs != NULL && is_directory(dir_fd, entry->d_name, entry->d_type)) {
+                status = file_list_append(subdirs, entry->d_name);
+            }
+        }
+    }
+    free(buffer);
+    close(dir_fd);
+
+    if (status == 0) status = file_list_finish(list);
+    if (status == 0 && subdirs != NULL) status = file_list_finish(subdirs);
+    if (status != 0) {
+        free_file_list(list);
+        if (subdirs != NULL) free_file_list(subdirs);
+        return -1;
+    }
+    return 0;
+}
+
+void free_file_list(struct file_list *list) {
+    free(list->arena);
+    free(list->offsets);
+    free(list->names);
+    memset(list, 0, sizeof(*list));
+}
@@ -0,0 +1,46 @@
+#ifndef DIRSCAN_H
+#define DIRSCAN_H
+
+#include <stddef.h>
+
+// Size of the buffer handed to each getdents64 call
+#define SCAN_BUFFER_SIZE (1 << 20)
+
+// Names of the matching files of one directory scan. All names live back to
+// back (NUL-terminated) in a single arena, which is also the packed layout the
+// MPI drivers scatter, so no per-entry allocations are made.
+struct file_list {
+    char *arena;
+    size_t arena_used;
+    size_t arena_capacity;
+    size_t *offsets;    // start of every name inside arena
+    char **names;       // pointers into arena, valid once the scan has finished
+    int count;
+    int capacity;
+};
+
+// NULL-terminated extension sets accepted by the readers
+extern const char *const image_extensions[];
+
+// Lists the regular files in folder whose extension is in extensions (case
+// insensitive). Returns 0 on success, -1 if the folder cannot be read or the
+// list cannot be allocated; on failure list is left empty.
+int scan_directory(const char *folder, const char *const *extensions, struct file_list *list);
+
+// Same as scan_directory but also lists the subdirectories of folder into
+// subdirs (symlinked directories are not followed)
+int scan_directory_entries(const char *folder, const char *const *extensions,
+                           struct file_list *files, struct file_list *subdirs);
+
+// Building a list by hand: init, append names, then finish to fill names.
+// append and finish return 0 on success, -1 if memory runs out.
+void file_list_init(struct file_list *list);
+int file_list_append(struct file_list *list, const char *name);
+int file_list_finish(struct file_list *list);
+
+// Returns 1 if filename ends in one of extensions
+int has_extension(const char *filename, const char *const *extensions);
+
+void free_file_list(struct file_list *list);
+
+#endif
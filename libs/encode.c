@@ -0,0 +1,454 @@
+#include "encode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "tasks.h"
+#include "utility.h"
+
+// Most levels below the full image: enough to take 2^31 pixels down to one
+#define MAX_PYRAMID_LEVELS 31
+
+// What a NULL params writes: a plain PNG
+static const struct encode_params default_encode = { OUTPUT_PNG, { 0, 32 } };
+
+int parse_output_format(const char *name, enum output_format *format) {
+    if (!strcmp(name, "png")) *format = OUTPUT_PNG;
+    else if (!strcmp(name, "raw")) *format = OUTPUT_RAW;
+    else if (!strcmp(name, "raw-lz")) *format = OUTPUT_RAW_LZ;
+    else if (!strcmp(name, "tiled")) *format = OUTPUT_TILED;
+    else return -1;
+    return 0;
+}
+
+// PNG encoding. Rows are filtered as independent tasks, then the zlib stream
+// is deflated in pieces of about PNG_PIECE_BYTES, pigz-style: every piece is
+// a raw deflate stream ended with a sync flush at a byte boundary, so the
+// pieces concatenate into one stream whose Adler-32 is combined from theirs.
+// Each piece goes out as its own IDAT chunk. Pieces do not reach back into
+// the one before, neither through the deflate window nor through the filter
+// of their first row, and a private dpIX chunk records their rows, so
+// load_png (png_decode.c) can inflate them in parallel too. Piece boundaries
+// depend on the image alone, so serial and parallel runs write the same bytes.
+#define PNG_PIECE_BYTES (1024 * 1024)
+
+// Rows per deflate piece for scanlines of line_bytes (filter byte included)
+static int png_piece_rows(size_t line_bytes) {
+    return line_bytes < PNG_PIECE_BYTES ? (int)(PNG_PIECE_BYTES / line_bytes) : 1;
+}
+
+static void put_be32(unsigned char *p, unsigned int value) {
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+static int write_chunk(FILE *file, const char type[4], const unsigned char *data, unsigned int length) {
+    unsigned char header[8], trailer[4];
+    put_be32(header, length);
+    memcpy(header + 4, type, 4);
+    uLong crc = crc32(crc32(0L, Z_NULL, 0), (const Bytef *)type, 4);
+    if (length > 0) crc = crc32(crc, data, length);
+    put_be32(trailer, (unsigned int)crc);
+    return fwrite(header, 1, 8, file) == 8 && (length == 0 || fwrite(data, 1, length, file) == length) &&
+           fwrite(trailer, 1, 4, file) == 4;
+}
+
+static int paeth(int a, int b, int c) {
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+// Filters one row with type (1 sub, 2 up, 3 average, 4 Paeth, else none)
+// against prior, which is all zeros above the first row
+static void filter_row(int type, const unsigned char *row, const unsigned char *prior, size_t row_bytes,
+                       int bpp, unsigned char *out) {
+    for (size_t i = 0; i < row_bytes; i++) {
+        int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+        int c = i >= (size_t)bpp ? prior[i - bpp] : 0;
+        int b = prior[i];
+        int predicted;
+        switch (type) {
+            case 1: predicted = a; break;
+            case 2: predicted = b; break;
+            case 3: predicted = (a + b) >> 1; break;
+            case 4: predicted = paeth(a, b, c); break;
+            default: predicted = 0; break;
+        }
+        out[i] = (unsigned char)(row[i] - predicted);
+    }
+}
+
+struct png_filter_ctx {
+    const unsigned char *data;
+    size_t stride;
+    size_t row_bytes;
+    int bpp;
+    unsigned char *filtered;    // (1 + row_bytes) per row
+    const unsigned char *zeros;
+    int piece_rows;             // the first row of every piece only uses filters 0 and 1
+};
+
+// Picks each row's filter like stb_image_write: the smallest sum of the
+// filtered bytes taken as signed. Rows starting a piece skip the filters that
+// read the row above.
+static void png_filter_tile(void *arg, int row_begin, int row_end) {
+    struct png_filter_ctx *ctx = arg;
+    size_t line_bytes = ctx->row_bytes + 1;
+    unsigned char *trial = malloc(ctx->row_bytes);
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char *row = ctx->data + (size_t)y * ctx->stride;
+        const unsigned char *prior = y > 0 ? row - ctx->stride : ctx->zeros;
+        unsigned char *line = ctx->filtered + (size_t)y * line_bytes;
+        if (trial == NULL) {
+            // No scratch row to compare in: leave the row unfiltered
+            line[0] = 0;
+            memcpy(line + 1, row, ctx->row_bytes);
+            continue;
+        }
+        unsigned long best_cost = (unsigned long)-1;
+        int types = y % ctx->piece_rows == 0 ? 2 : 5;
+        for (int type = 0; type < types; type++) {
+            filter_row(type, row, prior, ctx->row_bytes, ctx->bpp, trial);
+            unsigned long cost = 0;
+            for (size_t i = 0; i < ctx->row_bytes; i++) cost += abs((signed char)trial[i]);
+            if (cost < best_cost) {
+                best_cost = cost;
+                line[0] = (unsigned char)type;
+                memcpy(line + 1, trial, ctx->row_bytes);
+            }
+        }
+    }
+    free(trial);
+}
+
+struct png_piece {
+    unsigned char *out;     // IDAT payload: zlib header on the first piece, deflate data
+    size_t size;
+    uLong adler;            // of the filtered bytes the piece covers
+    size_t in_size;
+    int ok;
+};
+
+struct png_deflate_ctx {
+    const unsigned char *filtered;
+    size_t line_bytes;
+    int height;
+    int rows_per_piece;
+    struct png_piece *pieces;
+    int count;
+};
+
+static void png_deflate_tile(void *arg, int begin, int end) {
+    struct png_deflate_ctx *ctx = arg;
+    for (int i = begin; i < end; i++) {
+        struct png_piece *piece = &ctx->pieces[i];
+        int first_row = i * ctx->rows_per_piece;
+        int rows = ctx->height - first_row < ctx->rows_per_piece ? ctx->height - first_row : ctx->rows_per_piece;
+        const unsigned char *in = ctx->filtered + (size_t)first_row * ctx->line_bytes;
+        piece->in_size = (size_t)rows * ctx->line_bytes;
+        piece->adler = adler32(adler32(0L, Z_NULL, 0), in, piece->in_size);
+        piece->ok = 0;
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) continue;
+        // Room for the zlib header and the 5-byte empty block of the sync flush,
+        // plus the Adler-32 write_png_file appends to the last piece
+        size_t bound = deflateBound(&stream, piece->in_size) + 16;
+        piece->out = malloc(bound + 4);
+        if (piece->out != NULL) {
+            size_t header = 0;
+            if (i == 0) {
+                piece->out[0] = 0x78;   // deflate, 32 KB window
+                piece->out[1] = 0x9C;   // default level, no preset dictionary
+                header = 2;
+            }
+            stream.next_in = (Bytef *)in;
+            stream.avail_in = (uInt)piece->in_size;
+            stream.next_out = piece->out + header;
+            stream.avail_out = (uInt)(bound - header);
+            int status = deflate(&stream, i == ctx->count - 1 ? Z_FINISH : Z_SYNC_FLUSH);
+            piece->ok = stream.avail_in == 0 && (i == ctx->count - 1 ? status == Z_STREAM_END : status == Z_OK);
+            piece->size = header + stream.total_out;
+        }
+        deflateEnd(&stream);
+    }
+}
+
+// Writes the signature, IHDR, the IDAT pieces and IEND
+static int write_png_file(const char *path, int width, int height, int bit_depth, int color_type,
+                          const struct png_deflate_ctx *ctx) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) return 0;
+    static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    unsigned char ihdr[13];
+    put_be32(ihdr, (unsigned int)width);
+    put_be32(ihdr + 4, (unsigned int)height);
+    ihdr[8] = (unsigned char)bit_depth;
+    ihdr[9] = (unsigned char)color_type;
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    unsigned char pieces[4];
+    put_be32(pieces, (unsigned int)ctx->rows_per_piece);
+    int status = fwrite(signature, 1, 8, file) == 8 && write_chunk(file, "IHDR", ihdr, 13) &&
+                 write_chunk(file, "dpIX", pieces, 4);
+
+    uLong adler = adler32(0L, Z_NULL, 0);
+    for (int i = 0; status && i < ctx->count; i++) {
+        const struct png_piece *piece = &ctx->pieces[i];
+        adler = adler32_combine(adler, piece->adler, (z_off_t)piece->in_size);
+        if (i < ctx->count - 1) {
+            status = write_chunk(file, "IDAT", piece->out, (unsigned int)piece->size);
+            continue;
+        }
+        // The stream's Adler-32 trails the last piece
+        unsigned char trailer[4];
+        put_be32(trailer, (unsigned int)adler);
+        memcpy(piece->out + piece->size, trailer, 4);
+        status = write_chunk(file, "IDAT", piece->out, (unsigned int)piece->size + 4);
+    }
+    status = status && write_chunk(file, "IEND", NULL, 0);
+    return fclose(file) == 0 && status;
+}
+
+// Deflates rows of line_bytes (filter type byte first) into a PNG
+static int deflate_png(const char *path, int width, int height, int bit_depth, int color_type,
+                       const unsigned char *filtered, size_t line_bytes, int parallel) {
+    struct png_deflate_ctx ctx = { filtered, line_bytes, height, png_piece_rows(line_bytes), NULL, 0 };
+    ctx.count = (height + ctx.rows_per_piece - 1) / ctx.rows_per_piece;
+    ctx.pieces = calloc(ctx.count, sizeof(struct png_piece));
+    if (ctx.pieces == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        return 0;
+    }
+    if (parallel) parallel_tiles(ctx.count, 1, png_deflate_tile, &ctx);
+    else png_deflate_tile(&ctx, 0, ctx.count);
+
+    int status = 1;
+    for (int i = 0; i < ctx.count; i++) status = status && ctx.pieces[i].ok;
+    if (status) status = write_png_file(path, width, height, bit_depth, color_type, &ctx);
+    for (int i = 0; i < ctx.count; i++) free(ctx.pieces[i].out);
+    free(ctx.pieces);
+    return status;
+}
+
+// 8-bit PNG of 1 to 4 interleaved channels, like stbi_write_png
+static int encode_png(const char *path, int width, int height, int channels, const void *data, int stride_bytes,
+                      int parallel) {
+    static const int color_types[5] = { 0, 0, 4, 2, 6 };
+    size_t row_bytes = (size_t)width * channels;
+    unsigned char *filtered = malloc((row_bytes + 1) * height);
+    unsigned char *zeros = calloc(row_bytes, 1);
+    int status = 0;
+    if (filtered == NULL || zeros == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+    } else {
+        struct png_filter_ctx ctx = { data, (size_t)stride_bytes, row_bytes, channels, filtered, zeros,
+                                      png_piece_rows(row_bytes + 1) };
+        if (parallel) parallel_tiles(height, default_tile_rows((long)row_bytes), png_filter_tile, &ctx);
+        else png_filter_tile(&ctx, 0, height);
+        status = deflate_png(path, width, height, 8, color_types[channels], filtered, row_bytes + 1, parallel);
+    }
+    free(filtered);
+    free(zeros);
+    return status;
+}
+
+// One file in the configured container. Raw outputs keep the input name and
+// append .raw, so img.jpg and img.png stay apart and the next run picks them up.
+static int encode_image(const char *path, int width, int height, int channels, const void *data, int stride_bytes,
+                        enum output_format format, int parallel) {
+    if (format == OUTPUT_PNG) return encode_png(path, width, height, channels, data, stride_bytes, parallel);
+    char raw_path[OUTPUT_PATH_MAX];
+    if (snprintf(raw_path, sizeof(raw_path), is_raw_file(path) ? "%s" : "%s.raw", path) >= (int)sizeof(raw_path)) {
+        fprintf(stderr, "Output path too long: %s\n", path);
+        return 0;
+    }
+    enum raw_compression compression = format == OUTPUT_RAW_LZ ? RAW_LZ
+                                     : format == OUTPUT_TILED ? RAW_LZ_TILES : RAW_UNCOMPRESSED;
+    return write_raw_image(raw_path, width, height, channels, data, stride_bytes, compression, parallel);
+}
+
+struct pyramid_level {
+    unsigned char *pixels;
+    int width;
+    int height;
+    int stride;
+    int rows_done;
+};
+
+// One row of the next level from two rows of the previous one (lower may be
+// NULL on an odd last row); an odd last column averages what it covers
+static void reduce_row(const unsigned char *upper, const unsigned char *lower, int width, int channels,
+                       unsigned char *out, int out_width) {
+    int pairs = width / 2;
+    if (lower != NULL) {
+        for (int x = 0; x < pairs; x++) {
+            for (int c = 0; c < channels; c++) {
+                int i = 2 * x * channels + c;
+                out[x * channels + c] = (unsigned char)((upper[i] + upper[i + channels] +
+                                                         lower[i] + lower[i + channels] + 2) >> 2);
+            }
+        }
+    } else {
+        for (int x = 0; x < pairs; x++) {
+            for (int c = 0; c < channels; c++) {
+                int i = 2 * x * channels + c;
+                out[x * channels + c] = (unsigned char)((upper[i] + upper[i + channels] + 1) >> 1);
+            }
+        }
+    }
+    if (out_width > pairs) {
+        for (int c = 0; c < channels; c++) {
+            int i = 2 * pairs * channels + c;
+            int total = upper[i] + (lower ? lower[i] : 0), count = lower ? 2 : 1;
+            out[pairs * channels + c] = (unsigned char)((total + count / 2) / count);
+        }
+    }
+}
+
+// Emits the next row of level + 1 once its two source rows of level exist,
+// then lets the levels below catch up, so each row is reduced while the rows
+// it came from are still in cache
+static void cascade(struct pyramid_level *levels, int level, int count, int channels) {
+    while (level + 1 < count) {
+        struct pyramid_level *from = &levels[level], *to = &levels[level + 1];
+        int row = to->rows_done;
+        int needed = 2 * row + 2 < from->height ? 2 * row + 2 : from->height;
+        if (row >= to->height || from->rows_done < needed) return;
+        const unsigned char *upper = from->pixels + (size_t)(2 * row) * from->stride;
+        const unsigned char *lower = 2 * row + 1 < from->height ? upper + from->stride : NULL;
+        reduce_row(upper, lower, from->width, channels, to->pixels + (size_t)row * to->stride, to->width);
+        to->rows_done++;
+        level++;
+    }
+}
+
+struct encode_ctx {
+    const char *path;
+    struct pyramid_level *levels;
+    int channels;
+    enum output_format format;
+    int parallel;
+    int *results;
+};
+
+static void encode_level_tile(void *arg, int begin, int end) {
+    struct encode_ctx *ctx = arg;
+    for (int i = begin; i < end; i++) {
+        struct pyramid_level *level = &ctx->levels[i];
+        // Level paths are built here rather than kept per level, so the
+        // array of levels stays small on the caller's stack
+        char suffix[16], level_path[OUTPUT_PATH_MAX];
+        snprintf(suffix, sizeof(suffix), "_L%d", i);
+        if (i > 0 && suffixed_output_path(level_path, sizeof(level_path), ctx->path, suffix) != 0) {
+            fprintf(stderr, "Output path too long: %s\n", ctx->path);
+            ctx->results[i] = 0;
+            continue;
+        }
+        ctx->results[i] = encode_image(i > 0 ? level_path : ctx->path, level->width, level->height,
+                                       ctx->channels, level->pixels, level->stride, ctx->format, ctx->parallel);
+        if (i > 0 && !ctx->results[i]) fprintf(stderr, "Error writing image %s\n", level_path);
+    }
+}
+
+static int write_pyramid(const char *path, int width, int height, int channels, const void *data, int stride_bytes,
+                         const struct encode_params *params, int parallel) {
+    struct pyramid_level levels[MAX_PYRAMID_LEVELS + 1];
+    int count = 1;
+    levels[0] = (struct pyramid_level){ (unsigned char *)data, width, height, stride_bytes, 0 };
+
+    int status = 1;
+    while (count <= MAX_PYRAMID_LEVELS) {
+        int next_width = (levels[count - 1].width + 1) / 2, next_height = (levels[count - 1].height + 1) / 2;
+        if ((next_width > next_height ? next_width : next_height) < params->pyramid.min_size ||
+            (next_width == levels[count - 1].width && next_height == levels[count - 1].height)) {
+            break;
+        }
+        struct pyramid_level *level = &levels[count];
+        *level = (struct pyramid_level){ malloc((size_t)next_width * next_height * channels),
+                                         next_width, next_height, next_width * channels, 0 };
+        if (level->pixels == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+            status = 0;
+            break;
+        }
+        count++;
+    }
+
+    if (status) {
+        // Single pass over the full image: every source row pair feeds the
+        // whole chain before the next pair is read
+        for (int row = 0; row < height; row++) {
+            levels[0].rows_done = row + 1;
+            cascade(levels, 0, count, channels);
+        }
+
+        // PNG encoding dominates, so every level including the full image is its own task
+        int results[MAX_PYRAMID_LEVELS + 1];
+        struct encode_ctx ctx = { path, levels, channels, params->format, parallel, results };
+        if (parallel) parallel_tiles(count, 1, encode_level_tile, &ctx);
+        else encode_level_tile(&ctx, 0, count);
+        status = results[0];
+    }
+
+    for (int i = 1; i < count; i++) free(levels[i].pixels);
+    return status;
+}
+
+int write_png(const char *path, int width, int height, int channels, const void *data, int stride_bytes,
+              const struct encode_params *params, int parallel) {
+    if (params == NULL) params = &default_encode;
+    if (params->pyramid.enabled) {
+        return write_pyramid(path, width, height, channels, data, stride_bytes, params, parallel);
+    }
+    return encode_image(path, width, height, channels, data, stride_bytes, params->format, parallel);
+}
+
+// The mask keeps pixel x in bit x % 8 of its byte, PNG in bit 7 - x % 8
+static unsigned char reverse_bits(unsigned char b) {
+    b = (unsigned char)((b & 0xF0) >> 4 | (b & 0x0F) << 4);
+    b = (unsigned char)((b & 0xCC) >> 2 | (b & 0x33) << 2);
+    return (unsigned char)((b & 0xAA) >> 1 | (b & 0x55) << 1);
+}
+
+int write_png_1bit(const char *path, const struct bitmask *mask, const struct encode_params *params, int parallel) {
+    if (params == NULL) params = &default_encode;
+    if (params->pyramid.enabled || params->format != OUTPUT_PNG) {
+        // Levels are averaged and raw files hold bytes, so both need the 8-bit image
+        unsigned char *image = malloc((size_t)mask->width * mask->height);
+        if (image == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+            return 0;
+        }
+        unpack_bitmask(mask, image, parallel);
+        int status = write_png(path, mask->width, mask->height, 1, image, mask->width, params, parallel);
+        free(image);
+        return status;
+    }
+
+    // Filter type 0 on every row: filters rarely help on 1-bit data
+    size_t row_bytes = ((size_t)mask->width + 7) / 8;
+    size_t raw_size = (row_bytes + 1) * mask->height;
+    unsigned char reversed[256];
+    for (int b = 0; b < 256; b++) reversed[b] = reverse_bits((unsigned char)b);
+    unsigned char *raw = malloc(raw_size);
+    if (raw == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        return 0;
+    }
+    for (int y = 0; y < mask->height; y++) {
+        unsigned char *row = raw + (size_t)y * (row_bytes + 1);
+        const uint64_t *words = mask->words + (size_t)y * mask->words_per_row;
+        row[0] = 0;
+        for (size_t i = 0; i < row_bytes; i++) {
+            row[1 + i] = reversed[(words[i / 8] >> (8 * (i % 8))) & 0xFF];
+        }
+    }
+
+    int status = deflate_png(path, mask->width, mask->height, 1, 0, raw, row_bytes + 1, parallel);
+    free(raw);
+    return status;
+}
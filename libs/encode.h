@@ -0,0 +1,43 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include "image.h"
+#include "bitmask.h"
+#include "rawimage.h"
+
+// Container every output is written in
+enum output_format {
+    OUTPUT_PNG,
+    OUTPUT_RAW,     // rawimage.h, uncompressed: the next run maps it without copying
+    OUTPUT_RAW_LZ,  // rawimage.h with LZ4-style blocks
+    OUTPUT_TILED    // rawimage.h with LZ4-style tiles, for --roi reads
+};
+
+struct pyramid_params {
+    int enabled;    // --pyramid: also write every 2x reduction of each output
+    int min_size;   // smallest longer side a level may have
+};
+
+// How every output is written: --format and --pyramid
+struct encode_params {
+    enum output_format format;
+    struct pyramid_params pyramid;
+};
+
+int parse_output_format(const char *name, enum output_format *format);
+
+// Writes an output image, like stbi_write_png (nonzero on success), or as a
+// raw container at path + ".raw" per params->format; NULL params writes a
+// plain PNG. PNGs are filtered and deflated in row pieces, as concurrent
+// tasks when parallel is set. With a pyramid configured the half-size levels
+// are built from the in-memory image and written next to it as <name>_L1,
+// _L2, ..., each level its own task when parallel.
+int write_png(const char *path, int width, int height, int channels, const void *data, int stride_bytes,
+              const struct encode_params *params, int parallel);
+
+// Writes a packed mask as a 1-bit grayscale PNG (nonzero on success), an
+// eighth of the rows to filter and deflate of the 8-bit image. With a pyramid
+// or a raw output format the mask is unpacked and written through write_png.
+int write_png_1bit(const char *path, const struct bitmask *mask, const struct encode_params *params, int parallel);
+
+#endif
@@ -0,0 +1,228 @@
+#include "equalize.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "tasks.h"
+
+// Fixed-point scale of the CLAHE interpolation weights
+#define WEIGHT_BITS 8
+#define WEIGHT_ONE (1 << WEIGHT_BITS)
+
+int parse_contrast_mode(const char *name, enum contrast_mode *mode) {
+    if (!strcmp(name, "global")) *mode = CONTRAST_GLOBAL;
+    else if (!strcmp(name, "clahe")) *mode = CONTRAST_CLAHE;
+    else return -1;
+    return 0;
+}
+
+void equalization_lut(const unsigned long long histogram[HISTOGRAM_BINS], unsigned long long count,
+                      unsigned char lut[HISTOGRAM_BINS]) {
+    // The darkest occupied level maps to 0 so the full output range is used
+    unsigned long long lowest = 0;
+    for (int v = 0; v < HISTOGRAM_BINS && lowest == 0; v++) lowest = histogram[v];
+
+    unsigned long long cumulative = 0;
+    for (int v = 0; v < HISTOGRAM_BINS; v++) {
+        cumulative += histogram[v];
+        if (count <= lowest) {
+            lut[v] = (unsigned char)v;  // a single level: leave the plane alone
+        } else {
+            unsigned long long above = cumulative > lowest ? cumulative - lowest : 0;
+            lut[v] = (unsigned char)((above * 255 + (count - lowest) / 2) / (count - lowest));
+        }
+    }
+}
+
+// Caps every bin at limit and spreads the clipped counts evenly over all
+// bins, the remainder one count per bin from the bottom
+static void clip_histogram(unsigned long long histogram[HISTOGRAM_BINS], unsigned long long limit) {
+    unsigned long long excess = 0;
+    for (int v = 0; v < HISTOGRAM_BINS; v++) {
+        if (histogram[v] > limit) {
+            excess += histogram[v] - limit;
+            histogram[v] = limit;
+        }
+    }
+    unsigned long long share = excess / HISTOGRAM_BINS, remainder = excess % HISTOGRAM_BINS;
+    for (int v = 0; v < HISTOGRAM_BINS; v++) {
+        histogram[v] += share + (v < (int)remainder);
+    }
+}
+
+struct clahe_ctx {
+    const unsigned char *src;
+    unsigned char *dst;
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+    double clip_limit;
+    unsigned char *luts;        // HISTOGRAM_BINS per tile, row-major
+    // Per column: left tile, right tile and weight of the right one
+    int *column_tile;
+    int *column_next;
+    int *column_weight;
+};
+
+// Tile t covers [t * size / tiles, (t + 1) * size / tiles)
+static int tile_start(int t, int size, int tiles) {
+    return (int)((long long)t * size / tiles);
+}
+
+static void clahe_lut_tile(void *arg, int begin, int end) {
+    struct clahe_ctx *ctx = arg;
+    for (int t = begin; t < end; t++) {
+        int tx = t % ctx->tiles_x, ty = t / ctx->tiles_x;
+        int x0 = tile_start(tx, ctx->width, ctx->tiles_x), x1 = tile_start(tx + 1, ctx->width, ctx->tiles_x);
+        int y0 = tile_start(ty, ctx->height, ctx->tiles_y), y1 = tile_start(ty + 1, ctx->height, ctx->tiles_y);
+        unsigned long long histogram[HISTOGRAM_BINS];
+        unsigned long long count = (unsigned long long)(x1 - x0) * (y1 - y0);
+        histogram_compute_serial(ctx->src + (size_t)y0 * ctx->width + x0, x1 - x0, y1 - y0, ctx->width, histogram);
+        if (ctx->clip_limit > 0) {
+            unsigned long long limit = (unsigned long long)(ctx->clip_limit * count / HISTOGRAM_BINS);
+            clip_histogram(histogram, limit > 0 ? limit : 1);
+        }
+        equalization_lut(histogram, count, ctx->luts + (size_t)t * HISTOGRAM_BINS);
+    }
+}
+
+// Position of pixel p between tile centers: the tile whose center is at or
+// before it, the next one and the fixed-point weight of the next one. Pixels
+// before the first or after the last center use that tile alone.
+static void locate_between_centers(int p, int size, int tiles, int *tile, int *next, int *weight) {
+    double position = (p + 0.5) * tiles / size - 0.5;
+    if (position <= 0) {
+        *tile = *next = 0;
+        *weight = 0;
+    } else if (position >= tiles - 1) {
+        *tile = *next = tiles - 1;
+        *weight = 0;
+    } else {
+        *tile = (int)position;
+        *next = *tile + 1;
+        *weight = (int)((position - *tile) * WEIGHT_ONE + 0.5);
+    }
+}
+
+// Bilinear blend of the four surrounding tile curves, in fixed point. The
+// column tiles and weights are precomputed, so each row is one gather-heavy
+// loop the compiler can vectorize.
+static void clahe_rows(void *arg, int row_begin, int row_end) {
+    struct clahe_ctx *ctx = arg;
+    int width = ctx->width;
+    for (int y = row_begin; y < row_end; y++) {
+        int top, bottom, wy;
+        locate_between_centers(y, ctx->height, ctx->tiles_y, &top, &bottom, &wy);
+        const unsigned char *top_luts = ctx->luts + (size_t)top * ctx->tiles_x * HISTOGRAM_BINS;
+        const unsigned char *bottom_luts = ctx->luts + (size_t)bottom * ctx->tiles_x * HISTOGRAM_BINS;
+        const unsigned char *in = ctx->src + (size_t)y * width;
+        unsigned char *out = ctx->dst + (size_t)y * width;
+        const int *column_tile = ctx->column_tile, *column_next = ctx->column_next, *column_weight = ctx->column_weight;
+
+        #pragma omp simd
+        for (int x = 0; x < width; x++) {
+            int left = column_tile[x] * HISTOGRAM_BINS + in[x];
+            int right = column_next[x] * HISTOGRAM_BINS + in[x];
+            int wx = column_weight[x];
+            int upper = top_luts[left] * (WEIGHT_ONE - wx) + top_luts[right] * wx;
+            int lower = bottom_luts[left] * (WEIGHT_ONE - wx) + bottom_luts[right] * wx;
+            out[x] = (unsigned char)((upper * (WEIGHT_ONE - wy) + lower * wy + (1 << (2 * WEIGHT_BITS - 1)))
+                                     >> (2 * WEIGHT_BITS));
+        }
+    }
+}
+
+static int clahe(const unsigned char *input_image, unsigned char *output_image, int width, int height,
+                 const struct contrast_params *params, int parallel) {
+    int tiles_x = params->tiles_x < width ? params->tiles_x : width;
+    int tiles_y = params->tiles_y < height ? params->tiles_y : height;
+    struct clahe_ctx ctx = { input_image, output_image, width, height, tiles_x, tiles_y, params->clip_limit,
+                             malloc((size_t)tiles_x * tiles_y * HISTOGRAM_BINS),
+                             malloc(width * sizeof(int)), malloc(width * sizeof(int)), malloc(width * sizeof(int)) };
+    int status = 0;
+    if (ctx.luts == NULL || ctx.column_tile == NULL || ctx.column_next == NULL || ctx.column_weight == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        status = -1;
+    } else {
+        for (int x = 0; x < width; x++) {
+            locate_between_centers(x, width, tiles_x, &ctx.column_tile[x], &ctx.column_next[x],
+                                   &ctx.column_weight[x]);
+        }
+        if (parallel) {
+            // One task per tile curve, then row tiles for the interpolation
+            parallel_tiles(tiles_x * tiles_y, 1, clahe_lut_tile, &ctx);
+            parallel_tiles(height, default_tile_rows(width), clahe_rows, &ctx);
+        } else {
+            clahe_lut_tile(&ctx, 0, tiles_x * tiles_y);
+            clahe_rows(&ctx, 0, height);
+        }
+    }
+    free(ctx.luts);
+    free(ctx.column_tile);
+    free(ctx.column_next);
+    free(ctx.column_weight);
+    return status;
+}
+
+struct lut_ctx {
+    const unsigned char *src;
+    unsigned char *dst;
+    int width;
+    const unsigned char *lut;
+};
+
+static void lut_rows(void *arg, int row_begin, int row_end) {
+    struct lut_ctx *ctx = arg;
+    size_t end = (size_t)row_end * ctx->width;
+    for (size_t i = (size_t)row_begin * ctx->width; i < end; i++) ctx->dst[i] = ctx->lut[ctx->src[i]];
+}
+
+static int run_equalize(const unsigned char *input_image, unsigned char *output_image,
+                        int width, int height, const struct contrast_params *params, int parallel) {
+    if (params->mode == CONTRAST_CLAHE) {
+        return clahe(input_image, output_image, width, height, params, parallel);
+    }
+    if (params->mode == CONTRAST_NONE) {
+        memcpy(output_image, input_image, (size_t)width * height);
+        return 0;
+    }
+
+    unsigned long long histogram[HISTOGRAM_BINS];
+    unsigned char lut[HISTOGRAM_BINS];
+    if (parallel) histogram_compute(input_image, width, height, width, histogram);
+    else histogram_compute_serial(input_image, width, height, width, histogram);
+    equalization_lut(histogram, (unsigned long long)width * height, lut);
+
+    struct lut_ctx ctx = { input_image, output_image, width, lut };
+    if (parallel) parallel_tiles(height, default_tile_rows(width), lut_rows, &ctx);
+    else lut_rows(&ctx, 0, height);
+    return 0;
+}
+
+int equalize_image(const unsigned char *input_image, unsigned char *output_image,
+                   int width, int height, const struct contrast_params *params) {
+    return run_equalize(input_image, output_image, width, height, params, 0);
+}
+
+int equalize_image_omp(const unsigned char *input_image, unsigned char *output_image,
+                       int width, int height, const struct contrast_params *params) {
+    return run_equalize(input_image, output_image, width, height, params, 1);
+}
+
+int contrast_prefilter(unsigned char *image, int width, int height, const struct contrast_params *params,
+                       int parallel) {
+    if (params == NULL || params->mode == CONTRAST_NONE) return 0;
+    if (params->mode == CONTRAST_GLOBAL) {
+        // A pure lookup, so it can run in place
+        return run_equalize(image, image, width, height, params, parallel);
+    }
+    unsigned char *normalized = malloc((size_t)width * height);
+    if (normalized == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        return -1;
+    }
+    int status = run_equalize(image, normalized, width, height, params, parallel);
+    if (status == 0) memcpy(image, normalized, (size_t)width * height);
+    free(normalized);
+    return status;
+}
@@ -0,0 +1,42 @@
+#ifndef EQUALIZE_H
+#define EQUALIZE_H
+
+#include <stddef.h>
+#include "histogram.h"
+
+enum contrast_mode {
+    CONTRAST_NONE,
+    CONTRAST_GLOBAL,    // one equalization curve for the whole plane
+    CONTRAST_CLAHE      // contrast-limited curves per tile, interpolated between tile centers
+};
+
+#define MAX_CLAHE_TILES 64
+
+struct contrast_params {
+    enum contrast_mode mode;
+    int tiles_x;            // CLAHE grid, clamped to the image size
+    int tiles_y;
+    double clip_limit;      // CLAHE bin limit as a multiple of the mean bin count, 0 = unlimited
+};
+
+// Parses "global" or "clahe". Returns 0 on success, -1 otherwise.
+int parse_contrast_mode(const char *name, enum contrast_mode *mode);
+
+// Equalization curve of a histogram over count pixels: level v maps to its
+// cumulative share of the pixels above the first occupied level, scaled to 0-255
+void equalization_lut(const unsigned long long histogram[HISTOGRAM_BINS], unsigned long long count,
+                      unsigned char lut[HISTOGRAM_BINS]);
+
+// Contrast normalization of an 8-bit plane per params->mode (a copy for
+// CONTRAST_NONE). The CLAHE tile curves are built as independent tasks and the
+// interpolation runs on row tiles. Both return -1 when a buffer cannot be allocated.
+int equalize_image(const unsigned char *input_image, unsigned char *output_image,
+                   int width, int height, const struct contrast_params *params);
+int equalize_image_omp(const unsigned char *input_image, unsigned char *output_image,
+                       int width, int height, const struct contrast_params *params);
+
+// Pre-stage: normalizes image in place; params may be NULL or CONTRAST_NONE
+int contrast_prefilter(unsigned char *image, int width, int height, const struct contrast_params *params,
+                       int parallel);
+
+#endif
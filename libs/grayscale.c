@@ -1,84 +1,123 @@
 #include "grayscale.h"
+#include "encode.h"
 
-void grayscale_serial(unsigned char *buffer, unsigned char *output, int width, int height, int channels, const char *output_folder, const char *original_file) {
-    for (int i = 0; i < width * height; i++) {
-        int idx = i * channels;
-        unsigned char gray = (unsigned char)(0.299 * buffer[idx] + 0.587 * buffer[idx + 1] + 0.114 * buffer[idx + 2]);
-        output[idx] = output[idx + 1] = output[idx + 2] = gray; // Set RGB to grayscale
-        if (channels == 4) output[idx + 3] = buffer[idx + 3];  // Preserve alpha channel if present
+struct grayscale_tile_ctx {
+    const struct image_buffer *input;
+    struct image_buffer *output;
+};
+
+static void grayscale_tile(void *arg, int row_begin, int row_end) {
+    struct grayscale_tile_ctx *ctx = arg;
+    int width = ctx->input->width;
+    int channels = ctx->input->channels;
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char *buffer = image_row(ctx->input, y);
+        unsigned char *output = image_row(ctx->output, y);
+        for (int x = 0; x < width; x++) {
+            size_t idx = (size_t)x * channels;
+            unsigned char gray = (unsigned char)(0.299 * buffer[idx] + 0.587 * buffer[idx + 1] + 0.114 * buffer[idx + 2]);
+            output[idx] = output[idx + 1] = output[idx + 2] = gray; // Set RGB to grayscale
+            if (channels == 4) output[idx + 3] = buffer[idx + 3];  // Preserve alpha channel if present
+        }
     }
+}
+
+void grayscale_serial(const struct image_buffer *input, struct image_buffer *output, const char *output_folder, const char *original_file,
+                      const struct encode_params *encode) {
+    // Luma-only decodes are already grayscale
+    if (input->channels < 3) {
+        save_image(output_folder, original_file, input, encode, 0);
+        return;
+    }
+    struct grayscale_tile_ctx ctx = { input, output };
+    grayscale_tile(&ctx, 0, input->height);
      // Save the grayscaled image
-    save_image(output_folder, original_file, output, width, height, channels);
+    save_image(output_folder, original_file, output, encode, 0);
 }
 
-void grayscale_openmp(unsigned char *buffer, unsigned char *output, int width, int height, int channels, const char* output_folder, const char *original_file) {
-    #pragma omp parallel for
-    for (int i = 0; i < width * height; i++) {
-        int idx = i * channels;
-        unsigned char gray = (unsigned char)(0.299 * buffer[idx] + 0.587 * buffer[idx + 1] + 0.114 * buffer[idx + 2]);
-        output[idx] = output[idx + 1] = output[idx + 2] = gray; // Set RGB to grayscale
-        if (channels == 4) output[idx + 3] = buffer[idx + 3];  // Preserve alpha channel if present
+void grayscale_openmp(const struct image_buffer *input, struct image_buffer *output, const char* output_folder, const char *original_file,
+                      const struct encode_params *encode) {
+    // Luma-only decodes are already grayscale
+    if (input->channels < 3) {
+        save_image(output_folder, original_file, input, encode, 1);
+        return;
     }
+    struct grayscale_tile_ctx ctx = { input, output };
+    parallel_tiles(input->height, default_tile_rows(input->width), grayscale_tile, &ctx);
 
-    save_image(output_folder, original_file, output, width, height, channels);
+    save_image(output_folder, original_file, output, encode, 1);
 }
 
-void process_image_mpi(const char *filename, const char *input_folder) {
-     int rank;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-
-    // Print which rank is processing which image
-    printf("Rank %d is processing image: %s\n", rank, filename);
-    fflush(stdout);
+// Gray plane of an MPI run: one channel, the plain mean of R, G and B
+struct gray_plane_tile_ctx {
+    const struct image_buffer *input;
+    struct image_buffer *gray;
+};
 
-    char input_path[256];
-    sprintf(input_path, "%s/%s", input_folder, filename);
+static void gray_plane_tile(void *arg, int row_begin, int row_end) {
+    struct gray_plane_tile_ctx *ctx = arg;
+    int width = ctx->input->width;
+    int channels = ctx->input->channels;
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char *row = image_row(ctx->input, y);
+        unsigned char *gray_row = image_row(ctx->gray, y);
+        if (channels == 1) { // JPEG inputs arrive as the luma plane already
+            memcpy(gray_row, row, width);
+            continue;
+        }
+        for (int x = 0; x < width; x++) {
+            size_t idx = (size_t)x * channels;
+            int r = row[idx];
+            int g = row[idx + 1];
+            int b = row[idx + 2];
+            gray_row[x] = (r + g + b) / 3;
+        }
+    }
+}
 
-    int width, height, channels;
-    unsigned char *img = stbi_load(input_path, &width, &height, &channels, 0);
-    if (img == NULL) {
+void process_image_mpi(const char *input_path, const char *output_path, const struct decode_params *decode,
+                       const struct encode_params *encode) {
+    struct image_buffer img;
+    if (load_image_buffer(input_path, &img, 0, 1, decode, 1) != 0) {
         fprintf(stderr, "Error loading image %s\n", input_path);
         return;
     }
 
     // Convert to grayscale
-    size_t img_size = width * height * channels;
-    unsigned char *gray_img = (unsigned char *)malloc(width * height);
-
-    #pragma omp for
-    for (size_t i = 0; i < width * height; i++) {
-        int idx = i * channels;
-        int r = img[idx];
-        int g = img[idx + 1];
-        int b = img[idx + 2];
-        gray_img[i] = (r + g + b) / 3;
+    struct image_buffer gray_img;
+    if (image_alloc(&gray_img, img.width, img.height, 1) != 0) {
+        fprintf(stderr, "Error allocating memory\n");
+        image_free(&img);
+        return;
     }
 
+    struct gray_plane_tile_ctx ctx = { &img, &gray_img };
+    parallel_tiles(img.height, default_tile_rows(img.width), gray_plane_tile, &ctx);
+
     // Save the grayscale image
-    char output_path[256];
-    create_output_directory("output_folder/grayscale_mpi/");
-    sprintf(output_path, "output_folder/grayscale_mpi/%s", filename);
-    stbi_write_png(output_path, width, height, 1, gray_img, width);
+    write_png(output_path, gray_img.width, gray_img.height, 1, gray_img.data, gray_img.stride, encode, 1);
 
     // Clean up
-    stbi_image_free(img);
-    free(gray_img);
+    image_free(&img);
+    image_free(&gray_img);
 }
 
 
-void save_image(const char *output_folder, const char *original_file, unsigned char *output, int width, int height, int channels) {
-    // Create the output folder if it doesn't exist
-    struct stat st = {0};
-    if (stat(output_folder, &st) == -1) {
-        mkdir(output_folder, 0700);  // Create directory with permissions
+void save_image(const char *output_folder, const char *original_file, const struct image_buffer *image,
+                const struct encode_params *encode, int parallel) {
+    // Generate the output file path
+    char output_file[OUTPUT_PATH_MAX];
+    if (snprintf(output_file, sizeof(output_file), "%s/%s", output_folder, original_file) >= (int)sizeof(output_file)) {
+        fprintf(stderr, "Error: Output path too long for %s\n", original_file);
+        return;
     }
 
-    // Generate the output file path
-    char output_file[1024];
-    snprintf(output_file, sizeof(output_file), "%s/%s", output_folder, original_file);
+    // Create the output folder (and any mirrored subdirectories) if they don't exist
+    if (create_parent_directories(output_file) != 0) return;
 
     // Save the image as PNG
-    if (!stbi_write_png(output_file, width, height, channels, output, width * channels)) {
+    if (!write_png(output_file, image->width, image->height, image->channels, image->data, image->stride,
+                   encode, parallel)) {
         fprintf(stderr, "Error: Failed to save image %s\n", output_file);
     } else {
         printf("Image saved: %s\n", output_file);
@@ -10,15 +10,24 @@
 #include "mpi/mpi.h"
 #include <string.h>
 #include "utility.h"
+#include "tasks.h"
+#include "decode.h"
+#include "encode.h"
 
-// Serial Grayscale Function
-void grayscale_serial(unsigned char *buffer, unsigned char *output, int width, int height, int channels, const char *output_folder, const char *original_file);
+// Serial Grayscale Function; output has the input's size and channels
+void grayscale_serial(const struct image_buffer *input, struct image_buffer *output, const char *output_folder, const char *original_file,
+                      const struct encode_params *encode);
 
 // OpenMP Grayscale Function
-void grayscale_openmp(unsigned char *buffer, unsigned char *output, int width, int height, int channels, const char* output_folder, const char *original_file);
+void grayscale_openmp(const struct image_buffer *input, struct image_buffer *output, const char* output_folder, const char *original_file,
+                      const struct encode_params *encode);
 
-void save_image(const char *output_folder, const char *original_file, unsigned char *output, int width, int height, int channels);
+// parallel compresses the output with tile tasks
+void save_image(const char *output_folder, const char *original_file, const struct image_buffer *image,
+                const struct encode_params *encode, int parallel);
 
-void process_image_mpi(const char *filename, const char *input_folder);
+// Converts input_path to grayscale for one MPI rank and writes it to output_path
+void process_image_mpi(const char *input_path, const char *output_path, const struct decode_params *decode,
+                       const struct encode_params *encode);
  
 #endif // GRAYSCALE_H
\ No newline at end of file
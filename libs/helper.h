@@ -10,20 +10,70 @@
 #include "sobel.h"
 #include "negative.h"
 #include "otsu.h"
+#include "adaptive.h"
+#include "convolve.h"
+#include "canny.h"
+#include "morphology.h"
+#include "median.h"
+#include "equalize.h"
+#include "hough.h"
+#include "planner.h"
+#include "dirscan.h"
+#include "walk.h"
+#include "options.h"
+#include "encode.h"
+
+// Builds the paths of one input: folder_path/file_name, the "/file_name" the
+// per-algorithm savers append to their own folder, and
+// output_folder/<algorithm>_<mode>/file_name. Returns -1, with a message, when
+// one of them does not fit in OUTPUT_PATH_MAX.
+static int build_image_paths(const char *folder_path, const char *file_name, const char *algorithm,
+                             const char *mode, char *image_path, char *image_name, char *output_dir) {
+    if (snprintf(image_path, OUTPUT_PATH_MAX, "%s/%s", folder_path, file_name) >= OUTPUT_PATH_MAX ||
+        snprintf(image_name, OUTPUT_PATH_MAX, "/%s", file_name) >= OUTPUT_PATH_MAX ||
+        snprintf(output_dir, OUTPUT_PATH_MAX, "output_folder/%s_%s/%s", algorithm, mode, file_name) >=
+            OUTPUT_PATH_MAX) {
+        fprintf(stderr, "Error: Path too long, skipping %s\n", file_name);
+        return -1;
+    }
+    return 0;
+}
 
-void process_image_serial(const char *image_path, const char *image_processing_algorithm, int otsu_threshold) {
+// file_name is relative to folder_path and may contain subdirectories,
+// which are mirrored under the output folder
+void process_image_serial(const char *folder_path, const char *file_name, const char *image_processing_algorithm,
+                          const struct run_options *options) {
     int width, height, channel;
+    char image_path[OUTPUT_PATH_MAX], image_name[OUTPUT_PATH_MAX], output_dir[OUTPUT_PATH_MAX];
+    if (build_image_paths(folder_path, file_name, image_processing_algorithm, "serial", image_path, image_name,
+                          output_dir) != 0) {
+        return;
+    }
     // This function reads the image and stores the widht, height, channel into the variables we defined.
-    unsigned char *img, *sobel_img;
+    unsigned char *img = NULL, *sobel_img = NULL;
+    struct region_params roi;
     if (!strcmp(image_processing_algorithm, "sobel")) 
     {
         printf("Sobel algorithm chosen!\n");
-        sobel_img = stbi_load(image_path, &width, &height, &channel, 1);
+        // With --roi, read the pixels the 3x3 (and median) window needs around it
+        sobel_img = load_image_region(image_path, 1 + options->median_radius, &width, &height, &channel, 1, 1,
+                                      &options->decode, &roi, 0);
+    }
+    else if (!strcmp(image_processing_algorithm, "adaptive") || !strcmp(image_processing_algorithm, "canny") ||
+             !strcmp(image_processing_algorithm, "morph") || !strcmp(image_processing_algorithm, "median") ||
+             !strcmp(image_processing_algorithm, "equalize") || !strcmp(image_processing_algorithm, "hough"))
+    {
+        img = load_image(image_path, &width, &height, &channel, 1, 1, &options->decode, 0);
+    }
+    else if (!strcmp(image_processing_algorithm, "blur") || !strcmp(image_processing_algorithm, "convert"))
+    {
+        img = load_image(image_path, &width, &height, &channel, 0, 0, &options->decode, 0);
     }
     else
     {
-        img = stbi_load(image_path, &width, &height, &channel, 3);
-        channel = 3; // force 3 channels
+        // 3 channels, or only the luma plane of a JPEG for grayscale/otsu
+        img = load_image(image_path, &width, &height, &channel, 3, algorithm_uses_luma(image_processing_algorithm),
+                         &options->decode, 0);
     }
 
     if (img == NULL && sobel_img == NULL) {
@@ -31,83 +81,222 @@ void process_image_serial(const char *image_path, const char *image_processing_a
         return;
     }
 
-    unsigned char *output = (unsigned char *)malloc(width * height * channel);
-    const char* image_name = strrchr(image_path, '/');
-    char output_dir_name[256];
-    sprintf(output_dir_name, "output_folder/%s_serial", image_processing_algorithm);
-    const char* output_dir = strcat(output_dir_name, image_name);
     printf("Loaded image: %s\n", image_path);
 
     // Perform some processing here
     if (!strcmp(image_processing_algorithm, "grayscale")) 
     {
         printf("Image loaded having (width: %d, height: %d, channels: %d)\n", width, height, channel);
-        grayscale_serial(img, output, width, height, channel, "grayscale", image_name);
-        stbi_image_free(img);
-        stbi_image_free(output);
+        struct image_buffer input = image_wrap(img, width, height, channel, 0), gray;
+        if (image_alloc(&gray, width, height, channel) == 0) {
+            grayscale_serial(&input, &gray, "grayscale", image_name, &options->encode);
+            image_free(&gray);
+        } else {
+            fprintf(stderr, "Error allocating memory\n");
+        }
+        release_image(img);
     }
     else if (!strcmp(image_processing_algorithm, "sobel")) 
     {
-        sobel_filter(sobel_img, output, width, height);
-        // Save the image
-        printf("Saving image to: %s\n", output_dir);
-        create_output_directory("output_folder/sobel_serial/");
-        stbi_write_png(output_dir, width, height, 1, output, width);
-        stbi_image_free(sobel_img);
-        stbi_image_free(output);
+        median_prefilter(sobel_img, width, height, options->median_radius, 0);
+        struct image_buffer input = image_wrap(sobel_img, width, height, 1, 0), edges;
+        if (image_alloc(&edges, width, height, 1) == 0) {
+            sobel_filter(&input, &edges);
+            // Save the image
+            printf("Saving image to: %s\n", output_dir);
+            if (create_parent_directories(output_dir) == 0) {
+                write_png(output_dir, roi.width, roi.height, 1, image_row(&edges, roi.y) + roi.x, edges.stride,
+                          &options->encode, 0);
+            }
+            image_free(&edges);
+        } else {
+            fprintf(stderr, "Error allocating memory\n");
+        }
+        release_image(sobel_img);
     }
     else if (!strcmp(image_processing_algorithm, "negative"))
     {
-        negative_serial(img, output, width, height, channel);
-        // save the negative image
-        printf("Saving image to %s\n", output_dir);
-        create_output_directory("output_folder/negative_serial/");
-        stbi_write_png(output_dir, width, height, channel, output, width * channel);
-        stbi_image_free(output);
-        stbi_image_free(img);
+        struct image_buffer input = image_wrap(img, width, height, channel, 0), negative;
+        if (image_alloc(&negative, width, height, channel) == 0) {
+            negative_serial(&input, &negative);
+            // save the negative image
+            printf("Saving image to %s\n", output_dir);
+            if (create_parent_directories(output_dir) == 0) {
+                write_png(output_dir, width, height, channel, negative.data, negative.stride, &options->encode, 0);
+            }
+            image_free(&negative);
+        } else {
+            fprintf(stderr, "Error allocating memory\n");
+        }
+        release_image(img);
     }
     else if (!strcmp(image_processing_algorithm, "otsu"))
     {
-        create_output_directory("output_folder/serial_otsu");
-        otsu_serial(img, image_name, otsu_threshold, width, height, channel);
+        struct otsu_stages stages = { options->median_radius, &options->contrast, &options->morph, &options->components,
+                                      &options->encode };
+        struct image_buffer input = image_wrap(img, width, height, channel, 0);
+        input.flags = IMAGE_LOADED;
+        otsu_serial(&input, image_name, &options->otsu, &stages);
+    }
+    else if (!strcmp(image_processing_algorithm, "adaptive"))
+    {
+        adaptive_serial(img, image_name, options->adaptive_window, options->adaptive_k, width, height,
+                        &options->encode);
+        release_image(img);
+    }
+    else if (!strcmp(image_processing_algorithm, "canny"))
+    {
+        unsigned char *output = (unsigned char *)malloc((size_t)width * height);
+        if (output == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+        } else if (canny_edges(img, output, width, height, &options->canny) == 0) {
+            printf("Saving image to %s\n", output_dir);
+            if (create_parent_directories(output_dir) == 0) {
+                write_png(output_dir, width, height, 1, output, width, &options->encode, 0);
+            }
+        }
+        release_image(img);
+        free(output);
+    }
+    else if (!strcmp(image_processing_algorithm, "morph"))
+    {
+        unsigned char *output = (unsigned char *)malloc((size_t)width * height);
+        if (output == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+        } else if (morph_gray(img, output, width, height, &options->morph) == 0) {
+            printf("Saving image to %s\n", output_dir);
+            if (create_parent_directories(output_dir) == 0) {
+                write_png(output_dir, width, height, 1, output, width, &options->encode, 0);
+            }
+        }
+        release_image(img);
+        free(output);
+    }
+    else if (!strcmp(image_processing_algorithm, "median"))
+    {
+        unsigned char *output = (unsigned char *)malloc((size_t)width * height);
+        if (output == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+        } else if (median_filter(img, output, width, height, options->median_radius) == 0) {
+            printf("Saving image to %s\n", output_dir);
+            if (create_parent_directories(output_dir) == 0) {
+                write_png(output_dir, width, height, 1, output, width, &options->encode, 0);
+            }
+        }
+        release_image(img);
+        free(output);
+    }
+    else if (!strcmp(image_processing_algorithm, "equalize"))
+    {
+        unsigned char *output = (unsigned char *)malloc((size_t)width * height);
+        if (output == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+        } else if (equalize_image(img, output, width, height, &options->contrast) == 0) {
+            printf("Saving image to %s\n", output_dir);
+            if (create_parent_directories(output_dir) == 0) {
+                write_png(output_dir, width, height, 1, output, width, &options->encode, 0);
+            }
+        }
+        release_image(img);
+        free(output);
+    }
+    else if (!strcmp(image_processing_algorithm, "hough"))
+    {
+        // Only the line parameters are saved, next to where the image would go
+        struct hough_result *lines = malloc(sizeof(struct hough_result));
+        if (lines != NULL && hough_lines(img, width, height, &options->hough, lines) == 0) {
+            char lines_path[OUTPUT_PATH_MAX];
+            if (snprintf(lines_path, sizeof(lines_path), "%s.csv", output_dir) >= (int)sizeof(lines_path) ||
+                create_parent_directories(lines_path) != 0) {
+                fprintf(stderr, "Error: Path too long, skipping %s\n", file_name);
+            } else {
+                printf("Saving %d lines to %s\n", lines->count, lines_path);
+                write_hough_lines(lines_path, lines);
+            }
+        }
+        free(lines);
+        release_image(img);
+    }
+    else if (!strcmp(image_processing_algorithm, "blur"))
+    {
+        unsigned char *output = (unsigned char *)malloc((size_t)width * height * channel);
+        if (output == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+        } else if (blur_image(img, output, width, height, channel, &options->blur) == 0) {
+            printf("Saving image to %s\n", output_dir);
+            if (create_parent_directories(output_dir) == 0) {
+                write_png(output_dir, width, height, channel, output, width * channel, &options->encode, 0);
+            }
+        }
+        release_image(img);
+        free(output);
+    }
+    else if (!strcmp(image_processing_algorithm, "convert"))
+    {
+        // Pixels unchanged, written in the --format container
+        printf("Saving image to %s\n", output_dir);
+        if (create_parent_directories(output_dir) == 0) {
+            write_png(output_dir, width, height, channel, img, width * channel, &options->encode, 0);
+        }
+        release_image(img);
     }
 
 }
 
-void read_images_from_folder_serial(const char *folder_path, const char *image_processing_algorithm, int otsu_threshold) {
-    struct dirent *entry;
+struct folder_job {
+    const char *folder_path;
+    const char *image_processing_algorithm;
+    const struct run_options *options;
+    struct schedule_plan *tree_plan;    // recursive OpenMP runs: the directory plans' loads, summed
+};
+
+static void process_directory_serial(void *ctx, const char *relative_dir, struct file_list *files) {
+    struct folder_job *job = ctx;
+    for (int i = 0; i < files->count; i++) {
+        char file_name[OUTPUT_PATH_MAX];
+        if (join_relative_path(file_name, sizeof(file_name), relative_dir, files->names[i]) != 0) {
+            fprintf(stderr, "Error: Path too long, skipping %s/%s\n", relative_dir, files->names[i]);
+            continue;
+        }
+        process_image_serial(job->folder_path, file_name, job->image_processing_algorithm, job->options);
+    }
+}
 
-    DIR *dp = opendir(folder_path);
-    if (dp == NULL) {
-        perror("Error opening the directory\n");
+void read_images_from_folder_serial(const char *folder_path, const char *image_processing_algorithm,
+                                    const struct run_options *options) {
+    struct folder_job job = { folder_path, image_processing_algorithm, options };
+
+    if (options->recursive) {
+        // A single worker walks the tree depth first and processes as it goes
+        walk_directory_tree(folder_path, image_extensions, 1, process_directory_serial, &job);
         return;
     }
 
-    while ((entry = readdir(dp))) {
-        if (entry->d_type == DT_REG) {
-            const char *file_name = entry->d_name; // Get the file name
-            const char *extension = strrchr(file_name, '.');
-
-            if (extension && strcmp(extension, ".png") == 0) {
-                char full_path[1024];
-                snprintf(full_path, sizeof(full_path), "%s/%s", folder_path, file_name);
-                process_image_serial(full_path, image_processing_algorithm, otsu_threshold);
-            }
-        }
+    struct file_list files;
+    if (scan_directory(folder_path, image_extensions, &files) != 0) {
+        perror("Error opening the directory\n");
+        return;
     }
 
-    closedir(dp);
+    process_directory_serial(&job, "", &files);
+
+    free_file_list(&files);
 }
 
-void process_image_omp(const char* image_path, const char* image_processing_algorithm, int otsu_threshold) {
+// file_name is relative to folder_path and may contain subdirectories,
+// which are mirrored under the output folder
+void process_image_omp(const char *folder_path, const char *file_name, const char* image_processing_algorithm,
+                       const struct run_options *options) {
     int width, height, channels;
-    const char* image_name = strrchr(image_path, '/');
-    char output_dir_name[256];
-    sprintf(output_dir_name, "output_folder/%s_omp", image_processing_algorithm);
+    char image_path[OUTPUT_PATH_MAX], image_name[OUTPUT_PATH_MAX], output_dir[OUTPUT_PATH_MAX];
+    if (build_image_paths(folder_path, file_name, image_processing_algorithm, "omp", image_path, image_name,
+                          output_dir) != 0) {
+        return;
+    }
 
     if (!strcmp(image_processing_algorithm, "grayscale"))
     {
-        unsigned char *img = stbi_load(image_path, &width, &height, &channels, 0);
+        unsigned char *img = load_image(image_path, &width, &height, &channels, 0, 1, &options->decode, 1);
         if (img == NULL) {
             fprintf(stderr, "Error: Could not load image %s\n", image_path);
             return;
@@ -116,18 +305,24 @@ void process_image_omp(const char* image_path, const char* image_processing_algo
         printf("Thread %d: Loaded image: %s (Width: %d, Height: %d, Channels: %d)\n",
            omp_get_thread_num(), image_path, width, height, channels);
         
-        unsigned char *output = (unsigned char *)malloc(width * height * channels);
-        grayscale_openmp(img, output, width, height, channels, "output_folder/grayscale_omp", image_name);
-        stbi_image_free(img);  // Free memory when done
-        stbi_image_free(output);
+        struct image_buffer input = image_wrap(img, width, height, channels, 0), gray;
+        if (image_alloc(&gray, width, height, channels) == 0) {
+            grayscale_openmp(&input, &gray, "output_folder/grayscale_omp", image_name, &options->encode);
+            image_free(&gray);
+        } else {
+            fprintf(stderr, "Error allocating memory\n");
+        }
+        release_image(img);  // Free memory when done
     }
     else if (!strcmp(image_processing_algorithm, "sobel"))
     {
-        unsigned char *sobel_img = stbi_load(image_path, &width, &height, &channels, 1);
+        struct region_params roi;
+        unsigned char *sobel_img = load_image_region(image_path, 1 + options->median_radius, &width, &height,
+                                                     &channels, 1, 1, &options->decode, &roi, 1);
 
         if (sobel_img == NULL) {
             fprintf(stderr, "Error: Could not load image %s\n", image_path);
-            stbi_image_free(sobel_img);
+            release_image(sobel_img);
             return;
         }
 
@@ -135,22 +330,29 @@ void process_image_omp(const char* image_path, const char* image_processing_algo
            omp_get_thread_num(), image_path, width, height, channels);
 
 
-        unsigned char *output = (unsigned char*)malloc(width * height);
-        sobel_filter_omp(sobel_img, output, width, height);
-        create_output_directory(output_dir_name);
-        const char* output_dir = strcat(output_dir_name, image_name);
-        printf("Saving to %s\n", output_dir);
-        stbi_write_png(output_dir, width, height, 1, output, width);
+        median_prefilter(sobel_img, width, height, options->median_radius, 1);
+        struct image_buffer input = image_wrap(sobel_img, width, height, 1, 0), edges;
+        if (image_alloc(&edges, width, height, 1) == 0) {
+            sobel_filter_omp(&input, &edges);
+            if (create_parent_directories(output_dir) == 0) {
+                printf("Saving to %s\n", output_dir);
+                write_png(output_dir, roi.width, roi.height, 1, image_row(&edges, roi.y) + roi.x, edges.stride,
+                          &options->encode, 1);
+            }
+            image_free(&edges);
+        } else {
+            fprintf(stderr, "Error allocating memory\n");
+        }
 
-        stbi_image_free(sobel_img);
+        release_image(sobel_img);
     }
     else if (!strcmp(image_processing_algorithm, "negative"))
     {
-        unsigned char *negative_image = stbi_load(image_path, &width, &height, &channels, 0);
+        unsigned char *negative_image = load_image(image_path, &width, &height, &channels, 0, 0, &options->decode, 1);
 
         if (negative_image == NULL) {
             fprintf(stderr, "Error: Could not load image %s\n", image_path);
-            stbi_image_free(negative_image);
+            release_image(negative_image);
             return;
         }
 
@@ -158,621 +360,688 @@ void process_image_omp(const char* image_path, const char* image_processing_algo
            omp_get_thread_num(), image_path, width, height, channels);
 
 
-        unsigned char *output = (unsigned char*)malloc(width * height * channels);
-        negative_omp(negative_image, output, width, height, channels);
-        create_output_directory(output_dir_name);
-        const char* output_dir = strcat(output_dir_name, image_name);
-        printf("Saving to %s\n", output_dir);
-        stbi_write_png(output_dir, width, height, channels, output, width * channels);
+        struct image_buffer input = image_wrap(negative_image, width, height, channels, 0), negative;
+        if (image_alloc(&negative, width, height, channels) == 0) {
+            negative_omp(&input, &negative);
+            if (create_parent_directories(output_dir) == 0) {
+                printf("Saving to %s\n", output_dir);
+                write_png(output_dir, width, height, channels, negative.data, negative.stride, &options->encode, 1);
+            }
+            image_free(&negative);
+        } else {
+            fprintf(stderr, "Error allocating memory\n");
+        }
 
-        stbi_image_free(negative_image);
-        stbi_image_free(output);
+        release_image(negative_image);
     }
     else if (!strcmp(image_processing_algorithm, "otsu"))
     {
-        unsigned char *img = stbi_load(image_path, &width, &height, &channels, 0);
-        create_output_directory("output_folder/omp_otsu");
-        otsu_omp(img, image_name, otsu_threshold, width, height, channels);
+        struct image_buffer img;
+        if (load_image_buffer(image_path, &img, 0, 1, &options->decode, 1) != 0) {
+            fprintf(stderr, "Error: Could not load image %s\n", image_path);
+            return;
+        }
+        struct otsu_stages stages = { options->median_radius, &options->contrast, &options->morph, &options->components,
+                                      &options->encode };
+        otsu_omp(&img, image_name, &options->otsu, &stages);
     }
-}
-
-void read_images_from_folder_omp(const char *folder_path, const char *image_processing_algorithm, int otsu_threshold) {
-
-    struct dirent **file_list;
-    int n_files = scandir(folder_path, &file_list, NULL, alphasort);
-
-    if (n_files < 0) {
-        perror("Error opening the directory");
-        return;
+    else if (!strcmp(image_processing_algorithm, "adaptive"))
+    {
+        unsigned char *img = load_image(image_path, &width, &height, &channels, 1, 1, &options->decode, 1);
+        if (img == NULL) {
+            fprintf(stderr, "Error: Could not load image %s\n", image_path);
+            return;
+        }
+        adaptive_omp(img, image_name, options->adaptive_window, options->adaptive_k, width, height,
+                     &options->encode);
+        release_image(img);
     }
+    else if (!strcmp(image_processing_algorithm, "canny"))
+    {
+        unsigned char *img = load_image(image_path, &width, &height, &channels, 1, 1, &options->decode, 1);
+        if (img == NULL) {
+            fprintf(stderr, "Error: Could not load image %s\n", image_path);
+            return;
+        }
 
-    #pragma omp parallel for schedule(dynamic) shared(file_list, folder_path)
-    for (int i = 0; i < n_files; i++) {
-        if (file_list[i]->d_type == DT_REG) {  // Regular file
-            const char *file_name = file_list[i]->d_name;
-            const char *extension = strrchr(file_name, '.');
-
-            if (extension && strcmp(extension, ".png") == 0) {
-                char full_path[1024];
-                snprintf(full_path, sizeof(full_path), "%s/%s", folder_path, file_name);
-                process_image_omp(full_path, image_processing_algorithm, otsu_threshold);
+        unsigned char *output = (unsigned char *)malloc((size_t)width * height);
+        if (output == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+        } else if (canny_edges_omp(img, output, width, height, &options->canny) == 0) {
+            if (create_parent_directories(output_dir) == 0) {
+                printf("Saving to %s\n", output_dir);
+                write_png(output_dir, width, height, 1, output, width, &options->encode, 1);
             }
         }
-
-        free(file_list[i]);  // Free memory for each directory entry
+        release_image(img);
+        free(output);
     }
+    else if (!strcmp(image_processing_algorithm, "morph"))
+    {
+        unsigned char *img = load_image(image_path, &width, &height, &channels, 1, 1, &options->decode, 1);
+        if (img == NULL) {
+            fprintf(stderr, "Error: Could not load image %s\n", image_path);
+            return;
+        }
 
-    free(file_list);  // Free memory for the file list
-}
-
-
-// Helper function which checks if a file is an image by extension
-int is_image_file(const char *filename) {
-    const char *ext = strrchr(filename, '.');
-    if (!ext) return 0;
-    return strcmp(ext, ".png") == 0 || strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0;
-}
-
-
-char **read_filenames_mpi(const char *folder, int *num_files) {
-    DIR *dir;
-    struct dirent *ent;
-    char **filenames = NULL;
-    int count = 0;
-
-    if ((dir = opendir(folder)) != NULL) {
-        // Count the number of files
-        while ((ent = readdir(dir)) != NULL) {
-            if (is_image_file(ent->d_name)) {
-                count++;
+        unsigned char *output = (unsigned char *)malloc((size_t)width * height);
+        if (output == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+        } else if (morph_gray_omp(img, output, width, height, &options->morph) == 0) {
+            if (create_parent_directories(output_dir) == 0) {
+                printf("Saving to %s\n", output_dir);
+                write_png(output_dir, width, height, 1, output, width, &options->encode, 1);
             }
         }
-        rewinddir(dir);
+        release_image(img);
+        free(output);
+    }
+    else if (!strcmp(image_processing_algorithm, "median"))
+    {
+        unsigned char *img = load_image(image_path, &width, &height, &channels, 1, 1, &options->decode, 1);
+        if (img == NULL) {
+            fprintf(stderr, "Error: Could not load image %s\n", image_path);
+            return;
+        }
 
-        filenames = (char **)malloc(count * sizeof(char *));
-        int index = 0;
-        while ((ent = readdir(dir)) != NULL) {
-            if (is_image_file(ent->d_name)) {
-                filenames[index] = strdup(ent->d_name);
-                index++;
+        unsigned char *output = (unsigned char *)malloc((size_t)width * height);
+        if (output == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+        } else if (median_filter_omp(img, output, width, height, options->median_radius) == 0) {
+            if (create_parent_directories(output_dir) == 0) {
+                printf("Saving to %s\n", output_dir);
+                write_png(output_dir, width, height, 1, output, width, &options->encode, 1);
             }
         }
-        closedir(dir);
-    } else {
-        perror("Could not open directory");
-        exit(EXIT_FAILURE);
+        release_image(img);
+        free(output);
     }
-    *num_files = count;
-    printf("Files Read\n");
-    return filenames;
-}
+    else if (!strcmp(image_processing_algorithm, "equalize"))
+    {
+        unsigned char *img = load_image(image_path, &width, &height, &channels, 1, 1, &options->decode, 1);
+        if (img == NULL) {
+            fprintf(stderr, "Error: Could not load image %s\n", image_path);
+            return;
+        }
 
+        unsigned char *output = (unsigned char *)malloc((size_t)width * height);
+        if (output == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+        } else if (equalize_image_omp(img, output, width, height, &options->contrast) == 0) {
+            if (create_parent_directories(output_dir) == 0) {
+                printf("Saving to %s\n", output_dir);
+                write_png(output_dir, width, height, 1, output, width, &options->encode, 1);
+            }
+        }
+        release_image(img);
+        free(output);
+    }
+    else if (!strcmp(image_processing_algorithm, "hough"))
+    {
+        unsigned char *img = load_image(image_path, &width, &height, &channels, 1, 1, &options->decode, 1);
+        if (img == NULL) {
+            fprintf(stderr, "Error: Could not load image %s\n", image_path);
+            return;
+        }
 
+        struct hough_result *lines = malloc(sizeof(struct hough_result));
+        if (lines != NULL && hough_lines_omp(img, width, height, &options->hough, lines) == 0) {
+            char lines_path[OUTPUT_PATH_MAX];
+            if (snprintf(lines_path, sizeof(lines_path), "%s.csv", output_dir) >= (int)sizeof(lines_path) ||
+                create_parent_directories(lines_path) != 0) {
+                fprintf(stderr, "Error: Path too long, skipping %s\n", file_name);
+            } else {
+                printf("Saving %d lines to %s\n", lines->count, lines_path);
+                write_hough_lines(lines_path, lines);
+            }
+        }
+        free(lines);
+        release_image(img);
+    }
+    else if (!strcmp(image_processing_algorithm, "blur"))
+    {
+        unsigned char *img = load_image(image_path, &width, &height, &channels, 0, 0, &options->decode, 1);
+        if (img == NULL) {
+            fprintf(stderr, "Error: Could not load image %s\n", image_path);
+            return;
+        }
 
-int read_images_from_folders_mpi(const char *folder_path, const char *image_processing_algorithm) {
-    int rank, total_processes;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &total_processes);
+        unsigned char *output = (unsigned char *)malloc((size_t)width * height * channels);
+        if (output == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+        } else if (blur_image_omp(img, output, width, height, channels, &options->blur) == 0) {
+            if (create_parent_directories(output_dir) == 0) {
+                printf("Saving to %s\n", output_dir);
+                write_png(output_dir, width, height, channels, output, width * channels, &options->encode, 1);
+            }
+        }
+        release_image(img);
+        free(output);
+    }
+    else if (!strcmp(image_processing_algorithm, "convert"))
+    {
+        unsigned char *img = load_image(image_path, &width, &height, &channels, 0, 0, &options->decode, 1);
+        if (img == NULL) {
+            fprintf(stderr, "Error: Could not load image %s\n", image_path);
+            return;
+        }
 
-    // All processes read the list of filenames
-    char **filenames = NULL;
-    int num_files = 0;
+        if (create_parent_directories(output_dir) == 0) {
+            printf("Saving to %s\n", output_dir);
+            write_png(output_dir, width, height, channels, img, width * channels, &options->encode, 1);
+        }
+        release_image(img);
+    }
+}
 
-    if (rank == 0) {
-        // Root process reads filenames
-        filenames = read_filenames_mpi(folder_path, &num_files);
+// Spawns one task per file of a directory, largest first. The per-pixel kernels
+// called inside process_image_omp split their image into tile tasks on the same
+// team, so threads that run out of files steal tiles from the images still in flight.
+static void spawn_directory_omp(struct folder_job *job, const char *relative_dir, struct schedule_plan *plan) {
+    for (int i = 0; i < plan->count; i++) {
+        char file_name[OUTPUT_PATH_MAX];
+        if (join_relative_path(file_name, sizeof(file_name), relative_dir, plan->files[i].name) != 0) {
+            fprintf(stderr, "Error: Path too long, skipping %s/%s\n", relative_dir, plan->files[i].name);
+            continue;
+        }
+        #pragma omp task firstprivate(file_name)
+        process_image_omp(job->folder_path, file_name, job->image_processing_algorithm, job->options);
     }
+}
 
-    // Broadcast the number of files to all processes
-    MPI_Bcast(&num_files, 1, MPI_INT, 0, MPI_COMM_WORLD);
+// Directory visitor of the recursive walk: files are queued as soon as their
+// directory has been scanned instead of after the whole tree is known
+static void process_directory_omp(void *ctx, const char *relative_dir, struct file_list *files) {
+    struct folder_job *job = ctx;
+    char directory[OUTPUT_PATH_MAX];
+    if (join_relative_path(directory, sizeof(directory), job->folder_path, relative_dir) != 0) {
+        fprintf(stderr, "Error: Path too long, skipping %s/%s\n", job->folder_path, relative_dir);
+        return;
+    }
 
-    if (rank != 0) {
-        // Allocate memory for filenames
-        filenames = (char **)malloc(num_files * sizeof(char *));
+    struct schedule_plan *plan = plan_schedule(directory, files->names, files->count,
+                                               job->image_processing_algorithm, &job->options->decode,
+                                               omp_get_num_threads());
+    if (plan == NULL) {
+        fprintf(stderr, "Error: Could not plan %s, skipping it\n", directory);
+        return;
     }
-    // Broadcast filenames to all processes
-    for (int i = 0; i < num_files; i++) {
-        int length;
-        if (rank == 0) {
-            length = strlen(filenames[i]) + 1;
+    spawn_directory_omp(job, relative_dir, plan);
+    if (job->tree_plan != NULL) {
+        #pragma omp critical(tree_plan)
+        {
+            for (int w = 0; w < plan->workers && w < job->tree_plan->workers; w++) {
+                job->tree_plan->loads[w] += plan->loads[w];
+            }
+            job->tree_plan->count += plan->count;
         }
-        MPI_Bcast(&length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+    free_schedule_plan(plan);
+}
 
-        if (rank != 0) {
-            filenames[i] = (char *)malloc(length * sizeof(char));
+void read_images_from_folder_omp(const char *folder_path, const char *image_processing_algorithm,
+                                 const struct run_options *options) {
+    struct folder_job job = { folder_path, image_processing_algorithm, options };
+
+    if (options->recursive) {
+        // Every directory is planned on its own as the walk finds it; the
+        // prediction is those plans stacked on the same workers
+        int workers = omp_get_max_threads();
+        struct schedule_plan tree_plan = { NULL, 0, workers, (double *)calloc(workers, sizeof(double)), 0.0 };
+        if (tree_plan.loads != NULL) job.tree_plan = &tree_plan;
+        double start = omp_get_wtime();
+        walk_directory_tree(folder_path, image_extensions, workers, process_directory_omp, &job);
+        double actual = omp_get_wtime() - start;
+        if (tree_plan.loads != NULL) {
+            for (int w = 0; w < workers; w++) {
+                if (tree_plan.loads[w] > tree_plan.makespan) tree_plan.makespan = tree_plan.loads[w];
+            }
+            print_makespan("OpenMP recursive", &tree_plan, actual);
+        } else {
+            printf("OpenMP recursive walk and processing took %lf s\n", actual);
         }
-        MPI_Bcast(filenames[i], length, MPI_CHAR, 0, MPI_COMM_WORLD);
+        free(tree_plan.loads);
+        return;
     }
 
-    // Each process processes a subset of images
-    for (int i = rank; i < num_files; i += total_processes) {
-        printf("Rank %d is assigned image: %s\n", rank, filenames[i]);
-        fflush(stdout);
-        process_image_mpi(filenames[i], folder_path);
+    struct file_list files;
+    if (scan_directory(folder_path, image_extensions, &files) != 0) {
+        perror("Error opening the directory");
+        return;
     }
 
-    // Clean up
-    for (int i = 0; i < num_files; i++) {
-        free(filenames[i]);
+    // Plan largest images first so a big file never starts last
+    struct schedule_plan *plan = plan_schedule(folder_path, files.names, files.count,
+                                               image_processing_algorithm, &options->decode, omp_get_max_threads());
+    if (plan == NULL) {
+        free_file_list(&files);
+        return;
     }
-    free(filenames);
-    if (rank == 0) return rank;
+    double start = omp_get_wtime();
+
+    #pragma omp parallel
+    #pragma omp single
+    spawn_directory_omp(&job, "", plan);
+
+    print_makespan("OpenMP", plan, omp_get_wtime() - start);
+    free_schedule_plan(plan);
+    free_file_list(&files);
 }
 
-char **read_filenames_sobel(const char *folder, int *num_files) {
-    DIR *dir;
-    struct dirent *ent;
-    char **filenames = NULL;
-    int count = 0;
 
-    if ((dir = opendir(folder)) != NULL) {
-        while ((ent = readdir(dir)) != NULL) {
-            if (is_image_file(ent->d_name)) {
-                filenames = (char **)realloc(filenames, (count + 1) * sizeof(char *));
-                filenames[count] = (char *)malloc((strlen(ent->d_name) + 1) * sizeof(char));
-                strcpy(filenames[count], ent->d_name);
-                count++;
-            }
+// Directory visitor that collects every file of the walk as a path relative to the root
+static void collect_directory(void *ctx, const char *relative_dir, struct file_list *files) {
+    struct file_list *all_files = ctx;
+    for (int i = 0; i < files->count; i++) {
+        char file_name[OUTPUT_PATH_MAX];
+        if (join_relative_path(file_name, sizeof(file_name), relative_dir, files->names[i]) != 0) {
+            fprintf(stderr, "Error: Path too long, skipping %s/%s\n", relative_dir, files->names[i]);
+            continue;
+        }
+        int appended;
+        #pragma omp critical(collect_directory)
+        appended = file_list_append(all_files, file_name);
+        if (appended != 0) {
+            fprintf(stderr, "Error allocating memory, skipping %s\n", file_name);
         }
-        closedir(dir);
-    } else {
-        perror("Could not open directory");
-        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
     }
-    *num_files = count;
-    return filenames;
 }
 
-
-int read_images_from_folders_mpi_sobel(const char *folder_path, const char *image_processing_algorithm) {
+// Root lists the folder, plans a longest-processing-time-first schedule over
+// the ranks (header-only probing) and scatters to every rank the names it owns,
+// largest first. Returns this rank's packed names buffer; *local_names points
+// into it. On root *plan_out receives the plan, on other ranks it is NULL.
+char *scatter_planned_filenames_mpi(const char *folder_path, const char *image_processing_algorithm,
+                                    const struct run_options *options, char ***local_names, int *local_count,
+                                    struct schedule_plan **plan_out) {
     int rank, size;
-    char **filenames = NULL;
-    int num_files = 0;
-
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    if (rank == 0) {
-        // Root process reads the filenames
-        filenames = read_filenames_sobel(folder_path, &num_files);
-    }
-
-    // Broadcast the number of files to all processes
-    MPI_Bcast(&num_files, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-    // Distribute filenames among processes
+    struct file_list files;
+    struct schedule_plan *plan = NULL;
     int *sendcounts = NULL;
     int *displs = NULL;
     char *all_filenames = NULL;
-    int total_length = 0;
 
     if (rank == 0) {
-        // Calculate the total length of all filenames
-        for (int i = 0; i < num_files; i++) {
-            total_length += strlen(filenames[i]) + 1; // +1 for null terminator
-        }
-
-        // Concatenate all filenames into a single buffer
-        all_filenames = (char *)malloc(total_length * sizeof(char));
-        char *ptr = all_filenames;
-        for (int i = 0; i < num_files; i++) {
-            strcpy(ptr, filenames[i]);
-            ptr += strlen(filenames[i]) + 1;
+        // Root process reads the filenames and plans the schedule
+        if (options->recursive) {
+            // Walk the tree with the rank's OpenMP threads; paths stay relative to folder_path
+            file_list_init(&files);
+            walk_directory_tree(folder_path, image_extensions, omp_get_max_threads(), collect_directory, &files);
+            if (file_list_finish(&files) != 0) {
+                fprintf(stderr, "Error allocating memory\n");
+                MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+            }
+        } else if (scan_directory(folder_path, image_extensions, &files) != 0) {
+            perror("Could not open directory");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
         }
+        printf("Files Read\n");
+        plan = plan_schedule(folder_path, files.names, files.count, image_processing_algorithm,
+                             &options->decode, size);
+        if (plan == NULL) MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
 
-        // Prepare sendcounts and displs for scattering
-        sendcounts = (int *)malloc(size * sizeof(int));
+        // Pack the names rank by rank, keeping the largest-first order inside each rank
+        sendcounts = (int *)calloc(size, sizeof(int));
         displs = (int *)malloc(size * sizeof(int));
-        int filenames_per_proc = num_files / size;
-        int remainder = num_files % size;
-        int offset = 0;
-
-        for (int i = 0; i < size; i++) {
-            int count = filenames_per_proc + (i < remainder ? 1 : 0);
-            sendcounts[i] = count;
-            displs[i] = offset;
-            offset += count;
-        }
-
-        // Adjust sendcounts and displs for character data
-        for (int i = 0; i < size; i++) {
-            int count = 0;
-            int start = displs[i];
-            int end = start + sendcounts[i];
-            for (int j = start; j < end; j++) {
-                count += strlen(filenames[j]) + 1;
-            }
-            sendcounts[i] = count;
+        int total_length = 0;
+        for (int i = 0; i < plan->count; i++) {
+            int length = strlen(plan->files[i].name) + 1; // +1 for null terminator
+            sendcounts[plan->files[i].worker] += length;
+            total_length += length;
         }
 
-        // Update displs to be in bytes
         displs[0] = 0;
         for (int i = 1; i < size; i++) {
             displs[i] = displs[i - 1] + sendcounts[i - 1];
         }
-    }
 
-    // Broadcast total_length to all processes
-    MPI_Bcast(&total_length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        all_filenames = (char *)malloc(total_length > 0 ? total_length : 1);
+        int *cursor = (int *)malloc(size * sizeof(int));
+        memcpy(cursor, displs, size * sizeof(int));
+        for (int i = 0; i < plan->count; i++) {
+            int owner = plan->files[i].worker;
+            strcpy(all_filenames + cursor[owner], plan->files[i].name);
+            cursor[owner] += strlen(plan->files[i].name) + 1;
+        }
+        free(cursor);
+    }
 
     // Each process receives its portion of filenames
     int local_filenames_length = 0;
     MPI_Scatter(sendcounts, 1, MPI_INT, &local_filenames_length, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
-    char *local_filenames = (char *)malloc(local_filenames_length * sizeof(char));
+    char *local_filenames = (char *)malloc(local_filenames_length > 0 ? local_filenames_length : 1);
     MPI_Scatterv(all_filenames, sendcounts, displs, MPI_CHAR,
                  local_filenames, local_filenames_length, MPI_CHAR, 0, MPI_COMM_WORLD);
 
     // Split local_filenames into an array
-    char **local_filename_list = NULL;
-    int local_file_count = 0;
+    int count = 0;
+    for (int i = 0; i < local_filenames_length; i++) {
+        if (local_filenames[i] == '\0') count++;
+    }
+    char **local_filename_list = (char **)malloc((count > 0 ? count : 1) * sizeof(char *));
     char *ptr = local_filenames;
-    while (ptr < local_filenames + local_filenames_length) {
-        local_filename_list = (char **)realloc(local_filename_list, (local_file_count + 1) * sizeof(char *));
-        local_filename_list[local_file_count] = ptr;
+    for (int i = 0; i < count; i++) {
+        local_filename_list[i] = ptr;
         ptr += strlen(ptr) + 1;
-        local_file_count++;
-    }
-
-    // Each process processes its assigned images
-    for (int i = 0; i < local_file_count; i++) {
-        printf("Rank %d is processing image: %s\n", rank, local_filename_list[i]);
-        fflush(stdout);
-        sobel_filter_hybrid(local_filename_list[i], folder_path ,"output_folder");
     }
 
     // Clean up
     if (rank == 0) {
-        for (int i = 0; i < num_files; i++) {
-            free(filenames[i]);
+        // The plan keeps pointers to the names, so detach them before freeing
+        for (int i = 0; i < plan->count; i++) {
+            plan->files[i].name = NULL;
         }
-        free(filenames);
+        free_file_list(&files);
         free(all_filenames);
         free(sendcounts);
         free(displs);
     }
-    free(local_filenames);
-    free(local_filename_list);
-    if (rank == 0) return rank;
-}
 
-int read_images_from_folders_mpi_negative(const char* folder_path) 
-{
-    int rank, size;
-    char **filenames = NULL;
-    int num_files = 0;
+    *local_names = local_filename_list;
+    *local_count = count;
+    *plan_out = plan;
+    return local_filenames;
+}
 
+// Gathers the slowest rank's processing time on root and compares it with the plan
+void report_makespan_mpi(struct schedule_plan *plan, double local_seconds) {
+    int rank;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    // Create output directory if it doesn't exist
+    double actual = 0.0;
+    MPI_Reduce(&local_seconds, &actual, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
     if (rank == 0) {
-        create_output_directory("output_folder/negative_mpi/");
+        print_makespan("MPI", plan, actual);
+        free_schedule_plan(plan);
     }
-    MPI_Barrier(MPI_COMM_WORLD);
+}
 
-    if (rank == 0) {
-        // Root process reads the filenames
-        filenames = read_filenames_mpi(folder_path, &num_files);
-    }
+// Per-file step of an MPI run. The driver has built both paths and created
+// the output's directories; the kernel loads the input, processes it with the
+// rank's OpenMP threads (tile tasks) and writes the result.
+typedef void (*mpi_file_kernel)(const char *input_path, const char *output_path,
+                                const struct run_options *options);
 
-    // Broadcast the number of files to all processes
-    MPI_Bcast(&num_files, 1, MPI_INT, 0, MPI_COMM_WORLD);
+// For the kernels' messages
+static int mpi_rank(void) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return rank;
+}
 
-    // Distribute filenames among processes
-    int *sendcounts = NULL;
-    int *displs = NULL;
-    char *all_filenames = NULL;
-    int total_length = 0;
+static void grayscale_file_mpi(const char *input_path, const char *output_path, const struct run_options *options) {
+    process_image_mpi(input_path, output_path, &options->decode, &options->encode);
+}
 
-    if (rank == 0) {
-        // Calculate the total length of all filenames
-        for (int i = 0; i < num_files; i++) {
-            total_length += strlen(filenames[i]) + 1; // +1 for null terminator
-        }
+static void sobel_file_mpi(const char *input_path, const char *output_path, const struct run_options *options) {
+    sobel_filter_hybrid(input_path, output_path, options->median_radius, &options->decode, &options->encode);
+}
 
-        // Concatenate all filenames into a single buffer
-        all_filenames = (char *)malloc(total_length * sizeof(char));
-        char *ptr = all_filenames;
-        for (int i = 0; i < num_files; i++) {
-            strcpy(ptr, filenames[i]);
-            ptr += strlen(filenames[i]) + 1;
-        }
+static void negative_file_mpi(const char *input_path, const char *output_path, const struct run_options *options) {
+    struct image_buffer img;
+    if (load_image_buffer(input_path, &img, 0, 0, &options->decode, 1) != 0) {
+        fprintf(stderr, "Error loading image %s\n", input_path);
+        return;
+    }
 
-        // Prepare sendcounts and displs for scattering
-        sendcounts = (int *)malloc(size * sizeof(int));
-        displs = (int *)malloc(size * sizeof(int));
-        int filenames_per_proc = num_files / size;
-        int remainder = num_files % size;
-        int offset = 0;
-
-        for (int i = 0; i < size; i++) {
-            int count = filenames_per_proc + (i < remainder ? 1 : 0);
-            sendcounts[i] = count;
-            displs[i] = offset;
-            offset += count;
-        }
-
-        // Adjust sendcounts and displs for character data
-        int *temp_sendcounts = (int *)malloc(size * sizeof(int));
-        int *temp_displs = (int *)malloc(size * sizeof(int));
-        offset = 0;
-        for (int i = 0; i < size; i++) {
-            temp_displs[i] = offset;
-            int count = 0;
-            int start = displs[i];
-            int end = start + sendcounts[i];
-            for (int j = start; j < end; j++) {
-                count += strlen(filenames[j]) + 1;
-            }
-            temp_sendcounts[i] = count;
-            offset += count;
-        }
-        free(sendcounts);
-        free(displs);
-        sendcounts = temp_sendcounts;
-        displs = temp_displs;
+    struct image_buffer negative_img;
+    if (image_alloc(&negative_img, img.width, img.height, img.channels) != 0) {
+        fprintf(stderr, "Error allocating memory\n");
+        image_free(&img);
+        return;
     }
 
-    // Broadcast total_length to all processes
-    MPI_Bcast(&total_length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    // Apply negative filter using OpenMP
+    negative_omp(&img, &negative_img);
 
-    // Each process receives its portion of filenames
-    int local_filenames_length = 0;
-    MPI_Scatter(sendcounts, 1, MPI_INT, &local_filenames_length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    // Save the negative image
+    if (!write_png(output_path, negative_img.width, negative_img.height, negative_img.channels,
+                   negative_img.data, negative_img.stride, &options->encode, 1)) {
+        fprintf(stderr, "Error writing image %s\n", output_path);
+    }
 
-    char *local_filenames = (char *)malloc(local_filenames_length * sizeof(char));
-    MPI_Scatterv(all_filenames, sendcounts, displs, MPI_CHAR,
-                 local_filenames, local_filenames_length, MPI_CHAR, 0, MPI_COMM_WORLD);
+    image_free(&img);
+    image_free(&negative_img);
+}
 
-    // Split local_filenames into an array
-    char **local_filename_list = NULL;
-    int local_file_count = 0;
-    char *ptr = local_filenames;
-    while (ptr < local_filenames + local_filenames_length) {
-        local_filename_list = (char **)realloc(local_filename_list, (local_file_count + 1) * sizeof(char *));
-        local_filename_list[local_file_count] = ptr;
-        ptr += strlen(ptr) + 1;
-        local_file_count++;
+static void otsu_file_mpi(const char *input_path, const char *output_path, const struct run_options *options) {
+    struct image_buffer img;
+    if (load_image_buffer(input_path, &img, 0, 1, &options->decode, 1) != 0) {
+        fprintf(stderr, "Rank %d: Error loading image %s\n", mpi_rank(), input_path);
+        return;
     }
 
-    // Each process processes its assigned images
-    for (int i = 0; i < local_file_count; i++) {
-        printf("Rank %d is processing image: %s\n", rank, local_filename_list[i]);
-        fflush(stdout);
+    struct otsu_stages stages = { options->median_radius, &options->contrast, &options->morph, &options->components,
+                                  &options->encode };
+    otsu_image(&img, output_path, &options->otsu, &stages, 1);
+}
 
-        // Construct input and output paths
-        char input_path[256];
-        sprintf(input_path, "%s/%s", folder_path, local_filename_list[i]);
+// The integral image build and the per-pixel pass are both split into tile tasks
+static void adaptive_file_mpi(const char *input_path, const char *output_path, const struct run_options *options) {
+    int width, height, channels;
+    unsigned char *gray_img = load_image(input_path, &width, &height, &channels, 1, 1, &options->decode, 1);
+    if (gray_img == NULL) {
+        fprintf(stderr, "Rank %d: Error loading image %s\n", mpi_rank(), input_path);
+        return;
+    }
 
-        char output_path[256];
-        sprintf(output_path, "%s/negative_mpi/%s", "output_folder/", local_filename_list[i]);
+    struct integral_image integral;
+    unsigned char *binary_img = (unsigned char *)malloc((size_t)width * height);
+    if (binary_img == NULL || build_integral_image_omp(gray_img, width, height, &integral) != 0) {
+        fprintf(stderr, "Rank %d: Error allocating memory\n", mpi_rank());
+        free(binary_img);
+        release_image(gray_img);
+        return;
+    }
+    adaptive_threshold_omp(gray_img, binary_img, &integral, options->adaptive_window, options->adaptive_k);
 
-        int width, height, channels;
-        unsigned char *img = stbi_load(input_path, &width, &height, &channels, 0);
-        if (img == NULL) {
-            fprintf(stderr, "Error loading image %s\n", input_path);
-            continue;
-        }
+    if (!write_png(output_path, width, height, 1, binary_img, width, &options->encode, 1)) {
+        fprintf(stderr, "Rank %d: Error writing image %s\n", mpi_rank(), output_path);
+    }
 
-        size_t img_size = width * height * channels;
-        unsigned char *negative_img = (unsigned char *)malloc(img_size);
-        if (negative_img == NULL) {
-            fprintf(stderr, "Error allocating memory\n");
-            stbi_image_free(img);
-            continue;
-        }
+    free_integral_image(&integral);
+    release_image(gray_img);
+    free(binary_img);
+}
 
-        // Apply negative filter using OpenMP
-        negative_omp(img, negative_img, width, height, channels);
+// Pixels unchanged, rewritten in the --format container
+static void convert_file_mpi(const char *input_path, const char *output_path, const struct run_options *options) {
+    int width, height, channels;
+    unsigned char *img = load_image(input_path, &width, &height, &channels, 0, 0, &options->decode, 1);
+    if (img == NULL) {
+        fprintf(stderr, "Rank %d: Error loading image %s\n", mpi_rank(), input_path);
+        return;
+    }
 
-        // Save the negative image
-        if (!stbi_write_png(output_path, width, height, channels, negative_img, width * channels)) {
-            fprintf(stderr, "Error writing image %s\n", output_path);
-        }
+    if (!write_png(output_path, width, height, channels, img, width * channels, &options->encode, 1)) {
+        fprintf(stderr, "Rank %d: Error writing image %s\n", mpi_rank(), output_path);
+    }
+    release_image(img);
+}
 
-        // Clean up
-        stbi_image_free(img);
-        free(negative_img);
+static void blur_file_mpi(const char *input_path, const char *output_path, const struct run_options *options) {
+    int width, height, channels;
+    unsigned char *img = load_image(input_path, &width, &height, &channels, 0, 0, &options->decode, 1);
+    if (img == NULL) {
+        fprintf(stderr, "Rank %d: Error loading image %s\n", mpi_rank(), input_path);
+        return;
     }
 
-    // Clean up
-    if (rank == 0) {
-        for (int i = 0; i < num_files; i++) {
-            free(filenames[i]);
-        }
-        free(filenames);
-        free(all_filenames);
-        free(sendcounts);
-        free(displs);
-        return rank;
+    unsigned char *blurred_img = (unsigned char *)malloc((size_t)width * height * channels);
+    if (blurred_img == NULL) {
+        fprintf(stderr, "Rank %d: Error allocating memory\n", mpi_rank());
+        release_image(img);
+        return;
     }
-    free(local_filenames);
-    free(local_filename_list);
-}
 
-int read_images_from_folders_mpi_otsu(const char *INPUT_FOLDER, const char *OUTPUT_FOLDER, int user_threshold)
-{
-    int rank, size;
-    char **filenames = NULL;
-    int num_files = 0;
+    if (blur_image_omp(img, blurred_img, width, height, channels, &options->blur) == 0 &&
+        !write_png(output_path, width, height, channels, blurred_img, width * channels, &options->encode, 1)) {
+        fprintf(stderr, "Rank %d: Error writing image %s\n", mpi_rank(), output_path);
+    }
 
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    release_image(img);
+    free(blurred_img);
+}
 
-    create_output_directory(OUTPUT_FOLDER);
-    MPI_Barrier(MPI_COMM_WORLD);
+// Filters of a luma plane into a plane of the same size, run as tile tasks
+static int canny_plane_omp(const unsigned char *in, unsigned char *out, int width, int height,
+                           const struct run_options *options) {
+    return canny_edges_omp(in, out, width, height, &options->canny);
+}
 
-    // Root process reads the filenames
-    if (rank == 0) {
-        filenames = read_filenames_mpi(INPUT_FOLDER, &num_files);
-    }
+static int morph_plane_omp(const unsigned char *in, unsigned char *out, int width, int height,
+                           const struct run_options *options) {
+    return morph_gray_omp(in, out, width, height, &options->morph);
+}
 
-    // Broadcast the number of files to all processes
-    MPI_Bcast(&num_files, 1, MPI_INT, 0, MPI_COMM_WORLD);
+static int median_plane_omp(const unsigned char *in, unsigned char *out, int width, int height,
+                            const struct run_options *options) {
+    return median_filter_omp(in, out, width, height, options->median_radius);
+}
 
-    // Distribute filenames among processes
-    int *sendcounts = NULL;
-    int *displs = NULL;
-    char *all_filenames = NULL;
-    int total_length = 0;
+static int equalize_plane_omp(const unsigned char *in, unsigned char *out, int width, int height,
+                              const struct run_options *options) {
+    return equalize_image_omp(in, out, width, height, &options->contrast);
+}
 
-    if (rank == 0) {
-        // Calculate the total length of all filenames
-        for (int i = 0; i < num_files; i++) {
-            total_length += strlen(filenames[i]) + 1; // +1 for null terminator
-        }
+static void filter_plane_file_mpi(const char *input_path, const char *output_path, const struct run_options *options,
+                                  int (*filter)(const unsigned char *, unsigned char *, int, int,
+                                                const struct run_options *)) {
+    int width, height, channels;
+    unsigned char *gray_img = load_image(input_path, &width, &height, &channels, 1, 1, &options->decode, 1);
+    if (gray_img == NULL) {
+        fprintf(stderr, "Rank %d: Error loading image %s\n", mpi_rank(), input_path);
+        return;
+    }
 
-        // Concatenate all filenames into a single buffer
-        all_filenames = (char *)malloc(total_length * sizeof(char));
-        char *ptr = all_filenames;
-        for (int i = 0; i < num_files; i++) {
-            strcpy(ptr, filenames[i]);
-            ptr += strlen(filenames[i]) + 1;
-        }
+    unsigned char *filtered_img = (unsigned char *)malloc((size_t)width * height);
+    if (filtered_img == NULL) {
+        fprintf(stderr, "Rank %d: Error allocating memory\n", mpi_rank());
+        release_image(gray_img);
+        return;
+    }
 
-        // Prepare sendcounts and displs for scattering
-        sendcounts = (int *)malloc(size * sizeof(int));
-        displs = (int *)malloc(size * sizeof(int));
-        int filenames_per_proc = num_files / size;
-        int remainder = num_files % size;
-        int offset = 0;
-
-        for (int i = 0; i < size; i++) {
-            int count = filenames_per_proc + (i < remainder ? 1 : 0);
-            sendcounts[i] = count;
-            displs[i] = offset;
-            offset += count;
-        }
-
-        // Adjust sendcounts and displs for character data
-        int *temp_sendcounts = (int *)malloc(size * sizeof(int));
-        int *temp_displs = (int *)malloc(size * sizeof(int));
-        offset = 0;
-        for (int i = 0; i < size; i++) {
-            temp_displs[i] = offset;
-            int count = 0;
-            int start = displs[i];
-            int end = start + sendcounts[i];
-            for (int j = start; j < end; j++) {
-                count += strlen(filenames[j]) + 1;
-            }
-            temp_sendcounts[i] = count;
-            offset += count;
-        }
-        free(sendcounts);
-        free(displs);
-        sendcounts = temp_sendcounts;
-        displs = temp_displs;
+    if (filter(gray_img, filtered_img, width, height, options) == 0 &&
+        !write_png(output_path, width, height, 1, filtered_img, width, &options->encode, 1)) {
+        fprintf(stderr, "Rank %d: Error writing image %s\n", mpi_rank(), output_path);
     }
 
-    // Broadcast total_length to all processes
-    MPI_Bcast(&total_length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    release_image(gray_img);
+    free(filtered_img);
+}
 
-    // Each process receives its portion of filenames
-    int local_filenames_length = 0;
-    MPI_Scatter(sendcounts, 1, MPI_INT, &local_filenames_length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+static void canny_file_mpi(const char *input_path, const char *output_path, const struct run_options *options) {
+    filter_plane_file_mpi(input_path, output_path, options, canny_plane_omp);
+}
 
-    char *local_filenames = (char *)malloc(local_filenames_length * sizeof(char));
-    MPI_Scatterv(all_filenames, sendcounts, displs, MPI_CHAR,
-                 local_filenames, local_filenames_length, MPI_CHAR, 0, MPI_COMM_WORLD);
+static void morph_file_mpi(const char *input_path, const char *output_path, const struct run_options *options) {
+    filter_plane_file_mpi(input_path, output_path, options, morph_plane_omp);
+}
 
-    // Split local_filenames into an array
-    char **local_filename_list = NULL;
-    int local_file_count = 0;
-    char *ptr = local_filenames;
-    while (ptr < local_filenames + local_filenames_length) {
-        local_filename_list = (char **)realloc(local_filename_list, (local_file_count + 1) * sizeof(char *));
-        local_filename_list[local_file_count] = ptr;
-        ptr += strlen(ptr) + 1;
-        local_file_count++;
-    }
+static void median_file_mpi(const char *input_path, const char *output_path, const struct run_options *options) {
+    filter_plane_file_mpi(input_path, output_path, options, median_plane_omp);
+}
 
-    // Each process processes its assigned images
-    for (int i = 0; i < local_file_count; i++) {
-        printf("Rank %d is processing image: %s\n", rank, local_filename_list[i]);
-        fflush(stdout);
+static void equalize_file_mpi(const char *input_path, const char *output_path, const struct run_options *options) {
+    filter_plane_file_mpi(input_path, output_path, options, equalize_plane_omp);
+}
 
-        // Construct input and output paths
-        char input_path[256];
-        sprintf(input_path, "%s/%s", INPUT_FOLDER, local_filename_list[i]);
+// Only the line parameters are saved, as output_path.csv
+static void hough_file_mpi(const char *input_path, const char *output_path, const struct run_options *options) {
+    char lines_path[OUTPUT_PATH_MAX];
+    if (snprintf(lines_path, sizeof(lines_path), "%s.csv", output_path) >= (int)sizeof(lines_path)) {
+        fprintf(stderr, "Rank %d: Output path too long: %s\n", mpi_rank(), output_path);
+        return;
+    }
 
-        char output_path[256];
-        sprintf(output_path, "%s/otsu_%s", OUTPUT_FOLDER, local_filename_list[i]);
+    int width, height, channels;
+    unsigned char *gray_img = load_image(input_path, &width, &height, &channels, 1, 1, &options->decode, 1);
+    if (gray_img == NULL) {
+        fprintf(stderr, "Rank %d: Error loading image %s\n", mpi_rank(), input_path);
+        return;
+    }
 
-        int width, height, channels;
-        unsigned char *img = stbi_load(input_path, &width, &height, &channels, 0);
-        if (img == NULL) {
-            fprintf(stderr, "Rank %d: Error loading image %s\n", rank, input_path);
-            continue;
-        }
+    struct hough_result *lines = malloc(sizeof(struct hough_result));
+    if (lines != NULL && hough_lines_omp(gray_img, width, height, &options->hough, lines) == 0 &&
+        write_hough_lines(lines_path, lines) != 0) {
+        fprintf(stderr, "Rank %d: Error writing %s\n", mpi_rank(), lines_path);
+    }
 
-        // Convert to grayscale if necessary
-        unsigned char *gray_img = NULL;
-        if (channels == 1) {
-            gray_img = img;
-        } else {
-            gray_img = (unsigned char *)malloc(width * height);
-            if (gray_img == NULL) {
-                fprintf(stderr, "Rank %d: Error allocating memory\n", rank);
-                stbi_image_free(img);
-                continue;
-            }
+    free(lines);
+    release_image(gray_img);
+}
 
-            // Parallelize the grayscale conversion
-            #pragma omp parallel for
-            for (int idx = 0; idx < width * height; idx++) {
-                int idx_img = idx * channels;
-                int r = img[idx_img];
-                int g = img[idx_img + 1];
-                int b = img[idx_img + 2];
-                gray_img[idx] = (r + g + b) / 3;
-            }
+struct mpi_algorithm {
+    const char *name;
+    const char *output_folder;
+    const char *prefix;         // prepended to the file name of each output
+    mpi_file_kernel kernel;
+};
+
+static const struct mpi_algorithm mpi_algorithms[] = {
+    { "grayscale", "output_folder/grayscale_mpi", "", grayscale_file_mpi },
+    { "sobel", "output_folder/edge_mpi", "", sobel_file_mpi },
+    { "negative", "output_folder/negative_mpi", "", negative_file_mpi },
+    { "otsu", "output_folder/mpi_otsu", "otsu_", otsu_file_mpi },
+    { "adaptive", "output_folder/mpi_adaptive", "adaptive_", adaptive_file_mpi },
+    { "blur", "output_folder/blur_mpi", "", blur_file_mpi },
+    { "canny", "output_folder/canny_mpi", "", canny_file_mpi },
+    { "morph", "output_folder/morph_mpi", "", morph_file_mpi },
+    { "median", "output_folder/median_mpi", "", median_file_mpi },
+    { "equalize", "output_folder/equalize_mpi", "", equalize_file_mpi },
+    { "hough", "output_folder/hough_mpi", "", hough_file_mpi },
+    { "convert", "output_folder/convert_mpi", "", convert_file_mpi },
+};
+
+// The MPI driver of every algorithm: scatters the planned file names, runs
+// the algorithm's kernel on each of this rank's files and reports the
+// makespan. Returns the rank, for main to print the total time once.
+int read_images_from_folders_mpi(const char *folder_path, const char *image_processing_algorithm,
+                                 const struct run_options *options) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-            stbi_image_free(img);
-        }
+    const struct mpi_algorithm *algorithm = NULL;
+    for (size_t i = 0; i < sizeof(mpi_algorithms) / sizeof(mpi_algorithms[0]); i++) {
+        if (!strcmp(mpi_algorithms[i].name, image_processing_algorithm)) algorithm = &mpi_algorithms[i];
+    }
+    if (algorithm == NULL) {
+        if (rank == 0) fprintf(stderr, "Unknown algorithm for mpi: %s\n", image_processing_algorithm);
+        return rank;
+    }
 
-        // Compute Otsu's threshold if user_threshold is 0
-        int threshold;
-        if (user_threshold == 0) {
-            threshold = compute_otsu_threshold_omp(gray_img, width, height);
-            printf("Rank %d: Computed Otsu's threshold: %d for image %s\n", rank, threshold, local_filename_list[i]);
-        } else {
-            threshold = user_threshold;
-            printf("Rank %d: Using user-provided threshold: %d for image %s\n", rank, threshold, local_filename_list[i]);
-        }
+    char **local_filename_list = NULL;
+    int local_file_count = 0;
+    struct schedule_plan *plan = NULL;
+    char *local_filenames = scatter_planned_filenames_mpi(folder_path, image_processing_algorithm, options,
+                                                          &local_filename_list, &local_file_count, &plan);
 
-        // Apply threshold
-        unsigned char *binary_img = (unsigned char *)malloc(width * height);
-        if (binary_img == NULL) {
-            fprintf(stderr, "Rank %d: Error allocating memory\n", rank);
-            if (channels != 1) free(gray_img);
-            continue;
-        }
-        apply_threshold_omp(gray_img, binary_img, width, height, threshold);
+    // Each process processes the images planned for it
+    double start = MPI_Wtime();
+    for (int i = 0; i < local_file_count; i++) {
+        printf("Rank %d is processing image: %s\n", rank, local_filename_list[i]);
+        fflush(stdout);
 
-        // Save the binary image
-        if (!stbi_write_png(output_path, width, height, 1, binary_img, width)) {
-            fprintf(stderr, "Rank %d: Error writing image %s\n", rank, output_path);
+        char input_path[OUTPUT_PATH_MAX], output_path[OUTPUT_PATH_MAX];
+        if (snprintf(input_path, sizeof(input_path), "%s/%s", folder_path, local_filename_list[i]) >=
+                (int)sizeof(input_path) ||
+            prefixed_output_path(output_path, sizeof(output_path), algorithm->output_folder, algorithm->prefix,
+                                 local_filename_list[i]) != 0 ||
+            create_parent_directories(output_path) != 0) {
+            fprintf(stderr, "Rank %d: Path too long for %s\n", rank, local_filename_list[i]);
+            continue;
         }
-
-        // Clean up
-        if (channels != 1) free(gray_img);
-        free(binary_img);
+        algorithm->kernel(input_path, output_path, options);
     }
+    report_makespan_mpi(plan, MPI_Wtime() - start);
 
     // Clean up
-    if (rank == 0) {
-        for (int i = 0; i < num_files; i++) {
-            free(filenames[i]);
-        }
-        free(filenames);
-        free(all_filenames);
-        free(sendcounts);
-        free(displs);
-    }
     free(local_filenames);
     free(local_filename_list);
-    if (rank == 0) return rank;
+    return rank;
 }
-#endif
\ No newline at end of file
+#endif
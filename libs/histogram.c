@@ -0,0 +1,167 @@
+#include "histogram.h"
+#include "tasks.h"
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#define CACHE_LINE 64
+
+// The 32-bit lanes are added into 64-bit totals after at most this many
+// pixels, so no counter wraps however large the plane is
+#define LANE_FLUSH_PIXELS (1L << 30)
+
+// Counts of one worker: HISTOGRAM_LANES interleaved copies, the 64-bit totals
+// they are flushed into and a flag telling the reduction whether this worker
+// ran any tile. Padded to whole cache lines so neighbouring workers never share one.
+struct worker_histogram {
+    unsigned int lanes[HISTOGRAM_LANES][HISTOGRAM_BINS];
+    unsigned long long total[HISTOGRAM_BINS];
+    int touched;
+} __attribute__((aligned(CACHE_LINE)));
+
+// Storage for one histogram_compute call; kept in a free list between calls
+struct histogram_workspace {
+    struct worker_histogram *workers;
+    int worker_count;
+    struct histogram_workspace *next;
+};
+
+static struct histogram_workspace *free_workspaces = NULL;
+
+static struct histogram_workspace *acquire_workspace(int worker_count) {
+    struct histogram_workspace *workspace = NULL;
+    #pragma omp critical(histogram_pool)
+    {
+        struct histogram_workspace **link = &free_workspaces;
+        while (*link != NULL && (*link)->worker_count < worker_count) link = &(*link)->next;
+        if (*link != NULL) {
+            workspace = *link;
+            *link = workspace->next;
+        }
+    }
+    if (workspace == NULL) {
+        workspace = (struct histogram_workspace *)malloc(sizeof(struct histogram_workspace));
+        if (workspace == NULL) return NULL;
+        workspace->workers = (struct worker_histogram *)aligned_alloc(
+            CACHE_LINE, worker_count * sizeof(struct worker_histogram));
+        if (workspace->workers == NULL) {
+            free(workspace);
+            return NULL;
+        }
+        workspace->worker_count = worker_count;
+    }
+    for (int i = 0; i < workspace->worker_count; i++) {
+        workspace->workers[i].touched = 0;
+    }
+    return workspace;
+}
+
+static void release_workspace(struct histogram_workspace *workspace) {
+    #pragma omp critical(histogram_pool)
+    {
+        workspace->next = free_workspaces;
+        free_workspaces = workspace;
+    }
+}
+
+// Counts rows [row_begin, row_end) into the HISTOGRAM_LANES copies of lanes
+static void count_rows(const unsigned char *data, int width, size_t stride, int row_begin, int row_end,
+                       unsigned int lanes[HISTOGRAM_LANES][HISTOGRAM_BINS]) {
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char *row = data + (size_t)y * stride;
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            lanes[0][row[x]]++;
+            lanes[1][row[x + 1]]++;
+            lanes[2][row[x + 2]]++;
+            lanes[3][row[x + 3]]++;
+        }
+        for (; x < width; x++) {
+            lanes[0][row[x]]++;
+        }
+    }
+}
+
+static void add_lanes(unsigned int lanes[HISTOGRAM_LANES][HISTOGRAM_BINS],
+                      unsigned long long total[HISTOGRAM_BINS]) {
+    #pragma omp simd
+    for (int i = 0; i < HISTOGRAM_BINS; i++) {
+        unsigned long long sum = 0;
+        for (int lane = 0; lane < HISTOGRAM_LANES; lane++) sum += lanes[lane][i];
+        total[i] += sum;
+    }
+}
+
+// count_rows in chunks of at most LANE_FLUSH_PIXELS, adding each chunk to total
+static void count_into(const unsigned char *data, int width, size_t stride, int row_begin, int row_end,
+                       unsigned int lanes[HISTOGRAM_LANES][HISTOGRAM_BINS],
+                       unsigned long long total[HISTOGRAM_BINS]) {
+    int chunk_rows = width > 0 && width < LANE_FLUSH_PIXELS ? (int)(LANE_FLUSH_PIXELS / width) : 1;
+    for (int y = row_begin; y < row_end; y += chunk_rows) {
+        int chunk_end = row_end - y > chunk_rows ? y + chunk_rows : row_end;
+        memset(lanes, 0, HISTOGRAM_LANES * HISTOGRAM_BINS * sizeof(unsigned int));
+        count_rows(data, width, stride, y, chunk_end, lanes);
+        add_lanes(lanes, total);
+    }
+}
+
+void histogram_compute_serial(const unsigned char *data, int width, int height, size_t stride,
+                              unsigned long long histogram[HISTOGRAM_BINS]) {
+    unsigned int lanes[HISTOGRAM_LANES][HISTOGRAM_BINS];
+    memset(histogram, 0, HISTOGRAM_BINS * sizeof(unsigned long long));
+    count_into(data, width, stride, 0, height, lanes, histogram);
+}
+
+struct histogram_tile_ctx {
+    const unsigned char *data;
+    int width;
+    size_t stride;
+    struct histogram_workspace *workspace;
+};
+
+static void histogram_tile(void *arg, int row_begin, int row_end) {
+    struct histogram_tile_ctx *ctx = arg;
+    struct worker_histogram *mine = &ctx->workspace->workers[tile_worker_id()];
+    if (!mine->touched) {
+        memset(mine->total, 0, sizeof(mine->total));
+        mine->touched = 1;
+    }
+    count_into(ctx->data, ctx->width, ctx->stride, row_begin, row_end, mine->lanes, mine->total);
+}
+
+void histogram_compute(const unsigned char *data, int width, int height, size_t stride,
+                       unsigned long long histogram[HISTOGRAM_BINS]) {
+    int worker_count = tile_worker_count();
+    struct histogram_workspace *workspace = acquire_workspace(worker_count);
+    if (workspace == NULL) {
+        // No room for the per-worker blocks: count on this thread instead
+        histogram_compute_serial(data, width, height, stride, histogram);
+        return;
+    }
+
+    struct histogram_tile_ctx ctx = { data, width, stride, workspace };
+    parallel_tiles(height, default_tile_rows(width), histogram_tile, &ctx);
+
+    // Every tile has flushed its lanes into the worker's totals; combine the
+    // workers pairwise: worker i absorbs worker i + step for step = 1, 2, 4, ...
+    struct worker_histogram *workers = workspace->workers;
+    for (int step = 1; step < worker_count; step *= 2) {
+        for (int w = 0; w + step < worker_count; w += 2 * step) {
+            struct worker_histogram *into = &workers[w];
+            struct worker_histogram *from = &workers[w + step];
+            if (!from->touched) continue;
+            if (!into->touched) {
+                memcpy(into->total, from->total, sizeof(into->total));
+                into->touched = 1;
+                continue;
+            }
+            #pragma omp simd
+            for (int i = 0; i < HISTOGRAM_BINS; i++) into->total[i] += from->total[i];
+        }
+    }
+
+    for (int i = 0; i < HISTOGRAM_BINS; i++) {
+        histogram[i] = workers[0].touched ? workers[0].total[i] : 0;
+    }
+    release_workspace(workspace);
+}
@@ -0,0 +1,24 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stddef.h>
+
+#define HISTOGRAM_BINS 256
+
+// Sub-histograms per worker. Consecutive pixels go to different copies, so a
+// run of equal pixels no longer serializes on one counter's store-to-load chain.
+#define HISTOGRAM_LANES 4
+
+// Histogram of a width x height 8-bit plane whose rows are stride bytes apart.
+// Single-threaded, using the interleaved sub-histograms.
+void histogram_compute_serial(const unsigned char *data, int width, int height, size_t stride,
+                              unsigned long long histogram[HISTOGRAM_BINS]);
+
+// Same, split into row tiles on the task runtime (tasks.h). Every worker counts
+// into its own cache-line aligned block; the blocks are then combined with a
+// pairwise tree reduction. The per-worker storage comes from a pool that is
+// allocated once and reused by later calls, including concurrent ones.
+void histogram_compute(const unsigned char *data, int width, int height, size_t stride,
+                       unsigned long long histogram[HISTOGRAM_BINS]);
+
+#endif
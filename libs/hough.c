@@ -0,0 +1,202 @@
+#include "hough.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "sobel.h"
+#include "tasks.h"
+
+struct vote_ctx {
+    const unsigned char *edges;
+    int width;
+    int threshold;
+    int angles;
+    int rho_bins;
+    int rho_offset;     // bin of rho = 0
+    const float *cos_table;
+    const float *sin_table;
+    unsigned int **accumulators;    // angles x rho_bins block per worker, allocated on its first tile
+    int workers;
+    int failed;
+};
+
+// Votes of rows [row_begin, row_end) into the calling worker's accumulator.
+// Only workers that run a tile get one, so an image of few tiles holds few
+// copies however many threads the team has.
+static void vote_tile(void *arg, int row_begin, int row_end) {
+    struct vote_ctx *ctx = arg;
+    unsigned int **slot = ctx->accumulators + (ctx->workers > 1 ? tile_worker_id() : 0);
+    if (*slot == NULL) {
+        *slot = calloc((size_t)ctx->angles * ctx->rho_bins, sizeof(unsigned int));
+        if (*slot == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+            ctx->failed = 1;
+            return;
+        }
+    }
+    unsigned int *accumulator = *slot;
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char *row = ctx->edges + (size_t)y * ctx->width;
+        for (int x = 0; x < ctx->width; x++) {
+            if (row[x] < ctx->threshold) continue;
+            unsigned int *votes = accumulator + ctx->rho_offset;
+            for (int a = 0; a < ctx->angles; a++, votes += ctx->rho_bins) {
+                votes[(int)lrintf(x * ctx->cos_table[a] + y * ctx->sin_table[a])]++;
+            }
+        }
+    }
+}
+
+// Adds theta rows [begin, end) of every other worker's accumulator into the first
+static void reduce_tile(void *arg, int begin, int end) {
+    struct vote_ctx *ctx = arg;
+    size_t first = (size_t)begin * ctx->rho_bins, last = (size_t)end * ctx->rho_bins;
+    for (int w = 1; w < ctx->workers; w++) {
+        if (ctx->accumulators[w] == NULL) continue;    // worker ran no tile
+        unsigned int *restrict dst = ctx->accumulators[0];
+        const unsigned int *restrict src = ctx->accumulators[w];
+        #pragma omp simd
+        for (size_t i = first; i < last; i++) dst[i] += src[i];
+    }
+}
+
+static int compare_lines(const void *a, const void *b) {
+    const struct hough_line *la = a, *lb = b;
+    if (la->votes != lb->votes) return la->votes < lb->votes ? 1 : -1;
+    if (la->theta_degrees != lb->theta_degrees) return la->theta_degrees < lb->theta_degrees ? -1 : 1;
+    return la->rho < lb->rho ? -1 : (la->rho > lb->rho);
+}
+
+// Local maxima of the summed accumulator above the vote floor, strongest
+// first. Ties inside a window keep the first cell in scan order only.
+static void extract_peaks(const unsigned int *accumulator, const struct vote_ctx *ctx,
+                          const struct hough_params *params, struct hough_result *result) {
+    unsigned int strongest = 0;
+    size_t cells = (size_t)ctx->angles * ctx->rho_bins;
+    for (size_t i = 0; i < cells; i++) {
+        if (accumulator[i] > strongest) strongest = accumulator[i];
+    }
+    unsigned int floor_votes = params->min_votes > 0 ? (unsigned int)params->min_votes : strongest / 10;
+    if (floor_votes < 1) floor_votes = 1;
+
+    int capacity = 4 * MAX_HOUGH_LINES, found = 0;
+    struct hough_line *candidates = malloc(capacity * sizeof(struct hough_line));
+    if (candidates == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        result->count = 0;
+        return;
+    }
+    int r = params->peak_radius;
+    for (int a = 0; a < ctx->angles; a++) {
+        for (int rho = 0; rho < ctx->rho_bins; rho++) {
+            unsigned int votes = accumulator[(size_t)a * ctx->rho_bins + rho];
+            if (votes < floor_votes) continue;
+            int peak = 1;
+            for (int da = -r; da <= r && peak; da++) {
+                if (a + da < 0 || a + da >= ctx->angles) continue;
+                for (int dr = -r; dr <= r; dr++) {
+                    if (rho + dr < 0 || rho + dr >= ctx->rho_bins || (da == 0 && dr == 0)) continue;
+                    unsigned int other = accumulator[(size_t)(a + da) * ctx->rho_bins + rho + dr];
+                    // Strictly greater before this cell in scan order, greater or equal after
+                    if (other > votes || (other == votes && (da < 0 || (da == 0 && dr < 0)))) {
+                        peak = 0;
+                        break;
+                    }
+                }
+            }
+            if (!peak) continue;
+            if (found == capacity) {
+                // Keep the strongest half and raise the floor to the weakest kept
+                qsort(candidates, found, sizeof(struct hough_line), compare_lines);
+                found = capacity / 2;
+                floor_votes = candidates[found - 1].votes;
+                if (votes < floor_votes) continue;
+            }
+            candidates[found++] = (struct hough_line){ rho - ctx->rho_offset, 180.0 * a / ctx->angles, votes };
+        }
+    }
+
+    qsort(candidates, found, sizeof(struct hough_line), compare_lines);
+    result->count = found < params->max_lines ? found : params->max_lines;
+    memcpy(result->lines, candidates, result->count * sizeof(struct hough_line));
+    free(candidates);
+}
+
+static int run_hough(const unsigned char *gray_image, int width, int height,
+                     const struct hough_params *params, struct hough_result *result, int parallel) {
+    result->count = 0;
+    int diagonal = (int)ceil(sqrt((double)width * width + (double)height * height));
+    int workers = parallel ? tile_worker_count() : 1;
+    unsigned char *edges = malloc((size_t)width * height);
+    float *cos_table = malloc(params->angles * sizeof(float));
+    float *sin_table = malloc(params->angles * sizeof(float));
+    struct vote_ctx ctx = { edges, width, params->edge_threshold, params->angles, 2 * diagonal + 1, diagonal,
+                            cos_table, sin_table, NULL, workers, 0 };
+    // The first block receives the sum, the others are left to the workers
+    ctx.accumulators = calloc(workers, sizeof(unsigned int *));
+    if (ctx.accumulators != NULL) {
+        ctx.accumulators[0] = calloc((size_t)params->angles * ctx.rho_bins, sizeof(unsigned int));
+    }
+
+    int status = 0;
+    if (edges == NULL || cos_table == NULL || sin_table == NULL || ctx.accumulators == NULL ||
+        ctx.accumulators[0] == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        status = -1;
+    } else {
+        for (int a = 0; a < params->angles; a++) {
+            double theta = M_PI * a / params->angles;
+            cos_table[a] = (float)cos(theta);
+            sin_table[a] = (float)sin(theta);
+        }
+        // The thresholded magnitude only feeds the votes, it is never written out
+        struct image_buffer input = image_wrap((unsigned char *)gray_image, width, height, 1, 0);
+        struct image_buffer edge_buffer = image_wrap(edges, width, height, 1, 0);
+        if (parallel) {
+            sobel_filter_omp(&input, &edge_buffer);
+            parallel_tiles(height, default_tile_rows(width), vote_tile, &ctx);
+            if (!ctx.failed) parallel_tiles(params->angles, 1 + params->angles / 64, reduce_tile, &ctx);
+        } else {
+            sobel_filter(&input, &edge_buffer);
+            vote_tile(&ctx, 0, height);
+        }
+        if (ctx.failed) status = -1;
+        else extract_peaks(ctx.accumulators[0], &ctx, params, result);
+    }
+
+    free(edges);
+    free(cos_table);
+    free(sin_table);
+    if (ctx.accumulators != NULL) {
+        for (int w = 0; w < workers; w++) free(ctx.accumulators[w]);
+        free(ctx.accumulators);
+    }
+    return status;
+}
+
+int hough_lines(const unsigned char *gray_image, int width, int height,
+                const struct hough_params *params, struct hough_result *result) {
+    return run_hough(gray_image, width, height, params, result, 0);
+}
+
+int hough_lines_omp(const unsigned char *gray_image, int width, int height,
+                    const struct hough_params *params, struct hough_result *result) {
+    return run_hough(gray_image, width, height, params, result, 1);
+}
+
+int write_hough_lines(const char *path, const struct hough_result *result) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    fprintf(file, "rho,theta,votes\n");
+    for (int i = 0; i < result->count; i++) {
+        const struct hough_line *line = &result->lines[i];
+        fprintf(file, "%.0f,%.2f,%u\n", line->rho, line->theta_degrees, line->votes);
+    }
+    int status = ferror(file) ? -1 : 0;
+    if (fclose(file) != 0) status = -1;
+    if (status != 0) fprintf(stderr, "Error writing %s\n", path);
+    return status;
+}
@@ -0,0 +1,44 @@
+#ifndef HOUGH_H
+#define HOUGH_H
+
+#include <stddef.h>
+
+#define MAX_HOUGH_ANGLES 3600
+#define MAX_HOUGH_LINES 1024
+
+struct hough_params {
+    int edge_threshold;     // Sobel magnitude (0 - 255) a pixel needs to vote
+    int angles;             // theta bins over [0, 180) degrees
+    int max_lines;          // strongest peaks reported
+    int min_votes;          // peaks below this are dropped, 0 = a tenth of the strongest
+    int peak_radius;        // a peak must be the maximum of its (2r + 1)^2 accumulator window
+};
+
+// x cos(theta) + y sin(theta) = rho, in pixels from the top-left corner
+struct hough_line {
+    double rho;
+    double theta_degrees;
+    unsigned int votes;
+};
+
+struct hough_result {
+    struct hough_line lines[MAX_HOUGH_LINES];
+    int count;
+};
+
+// Sobel magnitude of a gray image, thresholded, voting into a rho x theta
+// accumulator through precomputed sin/cos tables; the result holds the
+// strongest local maxima by votes. Returns -1 when a buffer cannot be allocated.
+int hough_lines(const unsigned char *gray_image, int width, int height,
+                const struct hough_params *params, struct hough_result *result);
+
+// Same result with the gradients and votes split into row tiles. Every worker
+// votes into its own accumulator; the accumulators are summed in parallel
+// over theta rows before the peak search.
+int hough_lines_omp(const unsigned char *gray_image, int width, int height,
+                    const struct hough_params *params, struct hough_result *result);
+
+// Writes the lines as CSV (rho, theta in degrees, votes). Returns 0 on success, -1 otherwise.
+int write_hough_lines(const char *path, const struct hough_result *result);
+
+#endif
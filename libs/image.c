@@ -2,4 +2,37 @@
 #include "stb_image_write.h"
 
 #define STB_IMAGE_IMPLEMENTATION // Need this for stb_image.h
-#include "stb_image.h" // For image reading: https://github.com/nothings/stb/blob/master/stb_image.h
\ No newline at end of file
+#include "stb_image.h" // For image reading: https://github.com/nothings/stb/blob/master/stb_image.h
+
+// image.h pulls the stb headers in again, now only for their declarations
+#undef STB_IMAGE_WRITE_IMPLEMENTATION
+#undef STB_IMAGE_IMPLEMENTATION
+#include "image.h"
+#include <stdlib.h>
+#include <string.h>
+#include "decode.h"
+
+int image_alloc(struct image_buffer *image, int width, int height, int channels) {
+    size_t row_bytes = (size_t)width * channels;
+    size_t stride = (row_bytes + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+    *image = image_wrap(NULL, width, height, channels, stride);
+    image->data = aligned_alloc(IMAGE_ALIGNMENT, stride * height);
+    if (image->data == NULL) return -1;
+    image->flags = IMAGE_OWNED;
+    if (stride > row_bytes) {
+        for (int y = 0; y < height; y++) memset(image_row(image, y) + row_bytes, 0, stride - row_bytes);
+    }
+    return 0;
+}
+
+struct image_buffer image_wrap(unsigned char *data, int width, int height, int channels, size_t stride) {
+    struct image_buffer image = { data, width, height, channels, stride ? stride : (size_t)width * channels, 0 };
+    return image;
+}
+
+void image_free(struct image_buffer *image) {
+    if (image->flags & IMAGE_OWNED) free(image->data);
+    else if (image->flags & IMAGE_LOADED) release_image(image->data);
+    image->data = NULL;
+    image->flags = 0;
+}
@@ -1,7 +1,46 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include <stddef.h>
 #include "stb_image.h"
 #include "stb_image_write.h"
 
-#endif
\ No newline at end of file
+// Base address and row alignment of buffers from image_alloc: one cache line,
+// and a whole AVX-512 register
+#define IMAGE_ALIGNMENT 64
+
+// Ownership flags of an image_buffer
+#define IMAGE_OWNED  1  // data came from image_alloc
+#define IMAGE_LOADED 2  // data came from load_image and goes back through release_image
+
+// 8-bit interleaved image: channels is 1 (gray), 2 (gray, alpha), 3 (RGB) or
+// 4 (RGBA). Row y starts stride bytes after row y - 1, so rows may be padded;
+// every offset is computed in size_t, so frames past 2^31 bytes are fine.
+struct image_buffer {
+    unsigned char *data;
+    int width;
+    int height;
+    int channels;
+    size_t stride;
+    int flags;
+};
+
+static inline unsigned char *image_row(const struct image_buffer *image, int y) {
+    return image->data + (size_t)y * image->stride;
+}
+
+static inline size_t image_row_bytes(const struct image_buffer *image) {
+    return (size_t)image->width * image->channels;
+}
+
+// Allocates an image whose base and rows are IMAGE_ALIGNMENT aligned, the
+// padding zeroed. Returns -1 when it cannot be allocated.
+int image_alloc(struct image_buffer *image, int width, int height, int channels);
+
+// Describes memory owned elsewhere; a stride of 0 means packed rows
+struct image_buffer image_wrap(unsigned char *data, int width, int height, int channels, size_t stride);
+
+// Releases data according to flags; borrowed buffers are left alone
+void image_free(struct image_buffer *image);
+
+#endif
@@ -0,0 +1,221 @@
+#include "median.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tasks.h"
+
+#define MEDIAN_BINS 256
+#define COARSE_BINS 16      // top four bits of a level
+#define STRIP_COLUMNS 256   // strip width of the parallel histogram filter
+
+static int clamp_index(int i, int size) {
+    return i < 0 ? 0 : (i >= size ? size - 1 : i);
+}
+
+static unsigned char min_u8(unsigned char a, unsigned char b) { return a < b ? a : b; }
+static unsigned char max_u8(unsigned char a, unsigned char b) { return a > b ? a : b; }
+
+struct network_ctx {
+    const unsigned char *src;
+    unsigned char *dst;
+    int width;
+    int height;
+    int failed;
+};
+
+// 3x3 median: sort every column of three once, then the median of nine is the
+// median of the largest low, the middle middle and the smallest high of three
+// neighbouring columns. Only min/max, so both loops vectorize.
+static void network_tile(void *arg, int row_begin, int row_end) {
+    struct network_ctx *ctx = arg;
+    int width = ctx->width;
+    // Sorted columns with one replicated column on each side
+    unsigned char *low = malloc(3 * (size_t)(width + 2));
+    if (low == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        ctx->failed = 1;
+        return;
+    }
+    unsigned char *mid = low + width + 2, *high = mid + width + 2;
+
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char *a = ctx->src + (size_t)clamp_index(y - 1, ctx->height) * width;
+        const unsigned char *b = ctx->src + (size_t)y * width;
+        const unsigned char *c = ctx->src + (size_t)clamp_index(y + 1, ctx->height) * width;
+        #pragma omp simd
+        for (int x = 0; x < width; x++) {
+            unsigned char lo = min_u8(a[x], b[x]), hi = max_u8(a[x], b[x]);
+            unsigned char md = max_u8(lo, min_u8(hi, c[x]));
+            low[x + 1] = min_u8(lo, c[x]);
+            high[x + 1] = max_u8(hi, c[x]);
+            mid[x + 1] = md;
+        }
+        low[0] = low[1], mid[0] = mid[1], high[0] = high[1];
+        low[width + 1] = low[width], mid[width + 1] = mid[width], high[width + 1] = high[width];
+
+        unsigned char *out = ctx->dst + (size_t)y * width;
+        #pragma omp simd
+        for (int x = 0; x < width; x++) {
+            unsigned char max_low = max_u8(max_u8(low[x], low[x + 1]), low[x + 2]);
+            unsigned char min_high = min_u8(min_u8(high[x], high[x + 1]), high[x + 2]);
+            unsigned char m0 = mid[x], m1 = mid[x + 1], m2 = mid[x + 2];
+            unsigned char mid_mid = max_u8(min_u8(m0, m1), min_u8(max_u8(m0, m1), m2));
+            // Median of max_low, mid_mid and min_high
+            unsigned char lo = min_u8(max_low, mid_mid), hi = max_u8(max_low, mid_mid);
+            out[x] = max_u8(lo, min_u8(hi, min_high));
+        }
+    }
+    free(low);
+}
+
+struct strip_ctx {
+    const unsigned char *src;
+    unsigned char *dst;
+    int width;
+    int height;
+    int radius;
+    int failed;
+};
+
+// Column histograms cover [first, last] of the strip's columns plus the
+// radius on each side; each holds fine counts and counts per coarse bin
+struct column_histograms {
+    uint16_t *fine;     // MEDIAN_BINS per column
+    uint16_t *coarse;   // COARSE_BINS per column
+    int first;
+};
+
+static void column_add(struct column_histograms *h, int x, unsigned char value, int delta) {
+    size_t column = x - h->first;
+    h->fine[column * MEDIAN_BINS + value] += delta;
+    h->coarse[column * COARSE_BINS + (value >> 4)] += delta;
+}
+
+static void histogram_add(uint16_t *restrict dst, const uint16_t *restrict src, int count) {
+    #pragma omp simd
+    for (int i = 0; i < count; i++) dst[i] += src[i];
+}
+
+static void histogram_sub(uint16_t *restrict dst, const uint16_t *restrict src, int count) {
+    #pragma omp simd
+    for (int i = 0; i < count; i++) dst[i] -= src[i];
+}
+
+// Level of rank `rank` (0-based): a coarse scan finds the 16-level block,
+// a fine scan inside it the level
+static unsigned char histogram_rank(const uint16_t *fine, const uint16_t *coarse, int rank) {
+    int block = 0;
+    while (rank >= coarse[block]) rank -= coarse[block++];
+    const uint16_t *bins = fine + block * COARSE_BINS;
+    int level = 0;
+    while (rank >= bins[level]) rank -= bins[level++];
+    return (unsigned char)(block * COARSE_BINS + level);
+}
+
+// Perreault-Hebert filter of columns [x_begin, x_end) over all rows. Every
+// row moves the column histograms down by one pixel (one removal and one
+// addition each); the window histogram then slides right by adding one
+// column histogram and subtracting another, 272 vector adds per pixel
+// whatever the radius.
+static void median_strip(void *arg, int x_begin, int x_end) {
+    struct strip_ctx *ctx = arg;
+    int width = ctx->width, height = ctx->height, radius = ctx->radius;
+    int first = x_begin - radius < 0 ? 0 : x_begin - radius;
+    int last = x_end + radius > width ? width : x_end + radius;
+    int columns = last - first;
+
+    struct column_histograms h = { calloc((size_t)columns * MEDIAN_BINS, sizeof(uint16_t)),
+                                   calloc((size_t)columns * COARSE_BINS, sizeof(uint16_t)), first };
+    uint16_t *window = malloc((MEDIAN_BINS + COARSE_BINS) * sizeof(uint16_t));
+    if (h.fine == NULL || h.coarse == NULL || window == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        ctx->failed = 1;
+        free(h.fine);
+        free(h.coarse);
+        free(window);
+        return;
+    }
+    uint16_t *window_coarse = window + MEDIAN_BINS;
+    int rank = (2 * radius + 1) * (2 * radius + 1) / 2;
+
+    for (int dy = -radius; dy <= radius; dy++) {
+        const unsigned char *row = ctx->src + (size_t)clamp_index(dy, height) * width;
+        for (int x = first; x < last; x++) column_add(&h, x, row[x], 1);
+    }
+
+    for (int y = 0; y < height; y++) {
+        if (y > 0) {
+            const unsigned char *leaving = ctx->src + (size_t)clamp_index(y - radius - 1, height) * width;
+            const unsigned char *entering = ctx->src + (size_t)clamp_index(y + radius, height) * width;
+            for (int x = first; x < last; x++) {
+                column_add(&h, x, leaving[x], -1);
+                column_add(&h, x, entering[x], 1);
+            }
+        }
+
+        memset(window, 0, (MEDIAN_BINS + COARSE_BINS) * sizeof(uint16_t));
+        for (int dx = -radius; dx <= radius; dx++) {
+            size_t column = clamp_index(x_begin + dx, width) - first;
+            histogram_add(window, h.fine + column * MEDIAN_BINS, MEDIAN_BINS);
+            histogram_add(window_coarse, h.coarse + column * COARSE_BINS, COARSE_BINS);
+        }
+
+        unsigned char *out = ctx->dst + (size_t)y * width;
+        for (int x = x_begin; x < x_end; x++) {
+            out[x] = histogram_rank(window, window_coarse, rank);
+            if (x + 1 == x_end) break;
+            size_t leaving = clamp_index(x - radius, width) - first;
+            size_t entering = clamp_index(x + radius + 1, width) - first;
+            histogram_sub(window, h.fine + leaving * MEDIAN_BINS, MEDIAN_BINS);
+            histogram_sub(window_coarse, h.coarse + leaving * COARSE_BINS, COARSE_BINS);
+            histogram_add(window, h.fine + entering * MEDIAN_BINS, MEDIAN_BINS);
+            histogram_add(window_coarse, h.coarse + entering * COARSE_BINS, COARSE_BINS);
+        }
+    }
+
+    free(h.fine);
+    free(h.coarse);
+    free(window);
+}
+
+static int run_median(const unsigned char *input_image, unsigned char *output_image,
+                      int width, int height, int radius, int parallel) {
+    if (radius <= 0) {
+        memcpy(output_image, input_image, (size_t)width * height);
+        return 0;
+    }
+    if (radius == 1) {
+        struct network_ctx ctx = { input_image, output_image, width, height, 0 };
+        if (parallel) parallel_tiles(height, default_tile_rows(width), network_tile, &ctx);
+        else network_tile(&ctx, 0, height);
+        return ctx.failed ? -1 : 0;
+    }
+    struct strip_ctx ctx = { input_image, output_image, width, height, radius, 0 };
+    if (parallel) parallel_tiles(width, STRIP_COLUMNS, median_strip, &ctx);
+    else median_strip(&ctx, 0, width);
+    return ctx.failed ? -1 : 0;
+}
+
+int median_filter(const unsigned char *input_image, unsigned char *output_image,
+                  int width, int height, int radius) {
+    return run_median(input_image, output_image, width, height, radius, 0);
+}
+
+int median_filter_omp(const unsigned char *input_image, unsigned char *output_image,
+                      int width, int height, int radius) {
+    return run_median(input_image, output_image, width, height, radius, 1);
+}
+
+int median_prefilter(unsigned char *image, int width, int height, int radius, int parallel) {
+    if (radius <= 0) return 0;
+    unsigned char *filtered = malloc((size_t)width * height);
+    if (filtered == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        return -1;
+    }
+    int status = run_median(image, filtered, width, height, radius, parallel);
+    if (status == 0) memcpy(image, filtered, (size_t)width * height);
+    free(filtered);
+    return status;
+}
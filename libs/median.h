@@ -0,0 +1,25 @@
+#ifndef MEDIAN_H
+#define MEDIAN_H
+
+#include <stddef.h>
+
+// Largest radius: the (2r + 1)^2 window count must fit the 16-bit histograms
+#define MAX_MEDIAN_RADIUS 127
+
+// Median of the (2 * radius + 1)^2 window around every pixel of an 8-bit
+// plane, replicating the border pixels. Radius 1 uses a sorting network on
+// whole rows; larger radii use the Perreault-Hebert constant-time filter with
+// one histogram per column, so the cost per pixel does not grow with the
+// radius. Both return -1 when a buffer cannot be allocated.
+int median_filter(const unsigned char *input_image, unsigned char *output_image,
+                  int width, int height, int radius);
+
+// Splits the histogram filter into vertical strips of columns (the 3x3
+// network into row tiles) handled as parallel tasks
+int median_filter_omp(const unsigned char *input_image, unsigned char *output_image,
+                      int width, int height, int radius);
+
+// Denoising pre-stage: filters image in place, doing nothing for radius 0
+int median_prefilter(unsigned char *image, int width, int height, int radius, int parallel);
+
+#endif
@@ -0,0 +1,369 @@
+#include "morphology.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tasks.h"
+
+#define WORD_BITS BITMASK_WORD_BITS
+
+int parse_morph_op(const char *name, enum morph_op *op) {
+    if (!strcmp(name, "erode")) *op = MORPH_ERODE;
+    else if (!strcmp(name, "dilate")) *op = MORPH_DILATE;
+    else if (!strcmp(name, "open")) *op = MORPH_OPEN;
+    else if (!strcmp(name, "close")) *op = MORPH_CLOSE;
+    else return -1;
+    return 0;
+}
+
+// dst[i] = a[i] op b[i] over count elements of a row
+typedef void (*row_combine)(void *dst, const void *a, const void *b, size_t count);
+
+static void min_rows(void *dst, const void *a, const void *b, size_t count) {
+    unsigned char *d = dst;
+    const unsigned char *x = a, *y = b;
+    #pragma omp simd
+    for (size_t i = 0; i < count; i++) d[i] = x[i] < y[i] ? x[i] : y[i];
+}
+
+static void max_rows(void *dst, const void *a, const void *b, size_t count) {
+    unsigned char *d = dst;
+    const unsigned char *x = a, *y = b;
+    #pragma omp simd
+    for (size_t i = 0; i < count; i++) d[i] = x[i] > y[i] ? x[i] : y[i];
+}
+
+static void and_rows(void *dst, const void *a, const void *b, size_t count) {
+    uint64_t *d = dst;
+    const uint64_t *x = a, *y = b;
+    #pragma omp simd
+    for (size_t i = 0; i < count; i++) d[i] = x[i] & y[i];
+}
+
+static void or_rows(void *dst, const void *a, const void *b, size_t count) {
+    uint64_t *d = dst;
+    const uint64_t *x = a, *y = b;
+    #pragma omp simd
+    for (size_t i = 0; i < count; i++) d[i] = x[i] | y[i];
+}
+
+struct vertical_ctx {
+    const unsigned char *src;
+    unsigned char *dst;
+    size_t row_bytes;
+    size_t count;               // elements per row handed to combine
+    int height;
+    int radius;
+    row_combine combine;
+    const unsigned char *neutral_row;
+};
+
+// van Herk/Gil-Werman down the columns for output rows [row_begin, row_end).
+// The padded source rows are cut into blocks of k = 2 * radius + 1: g runs the
+// operator forwards from each block start, h backwards from each block end,
+// and the window of k rows starting at p is h[p] op g[p + k - 1].
+static void vertical_tile(void *arg, int row_begin, int row_end) {
+    struct vertical_ctx *ctx = arg;
+    int k = 2 * ctx->radius + 1;
+    int span = row_end - row_begin + 2 * ctx->radius;
+    int length = (span + k - 1) / k * k;
+    size_t row_bytes = ctx->row_bytes;
+
+    unsigned char *g = malloc((size_t)length * row_bytes);
+    unsigned char *h = malloc((size_t)length * row_bytes);
+    if (g == NULL || h == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        free(g);
+        free(h);
+        return;
+    }
+
+    for (int p = 0; p < length; p++) {
+        int y = row_begin - ctx->radius + p;
+        const unsigned char *row = y >= 0 && y < ctx->height ? ctx->src + (size_t)y * row_bytes : ctx->neutral_row;
+        if (p % k == 0) memcpy(g + p * row_bytes, row, row_bytes);
+        else ctx->combine(g + p * row_bytes, g + (p - 1) * row_bytes, row, ctx->count);
+    }
+    for (int p = length - 1; p >= 0; p--) {
+        int y = row_begin - ctx->radius + p;
+        const unsigned char *row = y >= 0 && y < ctx->height ? ctx->src + (size_t)y * row_bytes : ctx->neutral_row;
+        if (p % k == k - 1) memcpy(h + p * row_bytes, row, row_bytes);
+        else ctx->combine(h + p * row_bytes, h + (p + 1) * row_bytes, row, ctx->count);
+    }
+    for (int y = row_begin; y < row_end; y++) {
+        int p = y - row_begin;
+        ctx->combine(ctx->dst + (size_t)y * row_bytes, h + p * row_bytes, g + (p + k - 1) * row_bytes, ctx->count);
+    }
+
+    free(g);
+    free(h);
+}
+
+// Vertical tiles pay for 2 * radius extra rows, so keep them well above that
+static int vertical_tile_rows(int width, int radius) {
+    int tile_rows = default_tile_rows(width);
+    return tile_rows < 8 * radius ? 8 * radius : tile_rows;
+}
+
+static inline unsigned char pick(unsigned char a, unsigned char b, int is_max) {
+    return is_max ? (a > b ? a : b) : (a < b ? a : b);
+}
+
+struct horizontal_ctx {
+    const unsigned char *src;
+    unsigned char *dst;
+    int width;
+    int radius;
+    int is_max;
+};
+
+// The same scheme along each row
+static void horizontal_tile(void *arg, int row_begin, int row_end) {
+    struct horizontal_ctx *ctx = arg;
+    int k = 2 * ctx->radius + 1;
+    int length = (ctx->width + 2 * ctx->radius + k - 1) / k * k;
+    unsigned char *f = malloc(3 * (size_t)length);
+    if (f == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        return;
+    }
+    unsigned char *g = f + length, *h = g + length;
+
+    for (int y = row_begin; y < row_end; y++) {
+        memset(f, ctx->is_max ? 0 : 255, length);
+        memcpy(f + ctx->radius, ctx->src + (size_t)y * ctx->width, ctx->width);
+        for (int p = 0; p < length; p++) {
+            g[p] = p % k == 0 ? f[p] : pick(g[p - 1], f[p], ctx->is_max);
+        }
+        for (int p = length - 1; p >= 0; p--) {
+            h[p] = p % k == k - 1 ? f[p] : pick(h[p + 1], f[p], ctx->is_max);
+        }
+        (ctx->is_max ? max_rows : min_rows)(ctx->dst + (size_t)y * ctx->width, h, g + k - 1, ctx->width);
+    }
+    free(f);
+}
+
+// One erosion (is_max = 0) or dilation: columns into tmp, then rows into dst
+static int morph_gray_pass(const unsigned char *src, unsigned char *dst, unsigned char *tmp,
+                           int width, int height, const struct morph_params *params, int is_max, int parallel) {
+    unsigned char *neutral_row = malloc(width);
+    if (neutral_row == NULL) return -1;
+    memset(neutral_row, is_max ? 0 : 255, width);
+
+    struct vertical_ctx vertical = { src, tmp, width, width, height, params->radius_y,
+                                     is_max ? max_rows : min_rows, neutral_row };
+    struct horizontal_ctx horizontal = { tmp, dst, width, params->radius_x, is_max };
+    if (parallel) {
+        parallel_tiles(height, vertical_tile_rows(width, params->radius_y), vertical_tile, &vertical);
+        parallel_tiles(height, default_tile_rows(width), horizontal_tile, &horizontal);
+    } else {
+        vertical_tile(&vertical, 0, height);
+        horizontal_tile(&horizontal, 0, height);
+    }
+    free(neutral_row);
+    return 0;
+}
+
+static int run_morph_gray(const unsigned char *input_image, unsigned char *output_image,
+                          int width, int height, const struct morph_params *params, int parallel) {
+    size_t pixels = (size_t)width * height;
+    unsigned char *tmp = malloc(pixels);
+    unsigned char *middle = malloc(pixels);
+    int status = tmp && middle ? 0 : -1;
+
+    if (status == 0) {
+        switch (params->op) {
+        case MORPH_ERODE:
+            status = morph_gray_pass(input_image, output_image, tmp, width, height, params, 0, parallel);
+            break;
+        case MORPH_DILATE:
+            status = morph_gray_pass(input_image, output_image, tmp, width, height, params, 1, parallel);
+            break;
+        case MORPH_OPEN:
+            status = morph_gray_pass(input_image, middle, tmp, width, height, params, 0, parallel);
+            if (status == 0) status = morph_gray_pass(middle, output_image, tmp, width, height, params, 1, parallel);
+            break;
+        case MORPH_CLOSE:
+            status = morph_gray_pass(input_image, middle, tmp, width, height, params, 1, parallel);
+            if (status == 0) status = morph_gray_pass(middle, output_image, tmp, width, height, params, 0, parallel);
+            break;
+        default:
+            memcpy(output_image, input_image, pixels);
+            break;
+        }
+    }
+
+    if (status != 0) fprintf(stderr, "Error allocating memory\n");
+    free(tmp);
+    free(middle);
+    return status;
+}
+
+int morph_gray(const unsigned char *input_image, unsigned char *output_image,
+               int width, int height, const struct morph_params *params) {
+    return run_morph_gray(input_image, output_image, width, height, params, 0);
+}
+
+int morph_gray_omp(const unsigned char *input_image, unsigned char *output_image,
+                   int width, int height, const struct morph_params *params) {
+    return run_morph_gray(input_image, output_image, width, height, params, 1);
+}
+
+struct packed_ctx {
+    uint64_t *words;
+    uint64_t *tmp;
+    int width;
+    int words_per_row;
+    int radius;
+    int is_or;
+};
+
+// dst bit x = src bit x + s; bits shifted in from past the row end are fill
+static void shift_toward_start(uint64_t *dst, const uint64_t *src, int words, int s, uint64_t fill) {
+    int ws = s / WORD_BITS, bs = s % WORD_BITS;
+    for (int i = 0; i < words; i++) {
+        uint64_t lo = i + ws < words ? src[i + ws] : fill;
+        uint64_t hi = i + ws + 1 < words ? src[i + ws + 1] : fill;
+        dst[i] = bs ? (lo >> bs) | (hi << (WORD_BITS - bs)) : lo;
+    }
+}
+
+// dst bit x = src bit x - s; bits shifted in from before the row start are fill
+static void shift_toward_end(uint64_t *dst, const uint64_t *src, int words, int s, uint64_t fill) {
+    int ws = s / WORD_BITS, bs = s % WORD_BITS;
+    for (int i = 0; i < words; i++) {
+        uint64_t hi = i - ws >= 0 ? src[i - ws] : fill;
+        uint64_t lo = i - ws - 1 >= 0 ? src[i - ws - 1] : fill;
+        dst[i] = bs ? (hi << bs) | (lo >> (WORD_BITS - bs)) : hi;
+    }
+}
+
+typedef void (*row_shift)(uint64_t *dst, const uint64_t *src, int words, int s, uint64_t fill);
+
+// dst bit x = combination of the length bits from x onwards in the direction
+// read by shift. Windows double in length with every shift, and two
+// overlapping windows of the largest power of two cover any length.
+static void packed_window(uint64_t *dst, const uint64_t *src, uint64_t *shifted, int words, int length,
+                          row_shift shift, row_combine combine, uint64_t fill) {
+    memcpy(dst, src, (size_t)words * sizeof(uint64_t));
+    int span = 1;
+    while (span * 2 <= length) {
+        shift(shifted, dst, words, span, fill);
+        combine(dst, dst, shifted, words);
+        span *= 2;
+    }
+    if (span < length) {
+        shift(shifted, dst, words, length - span, fill);
+        combine(dst, dst, shifted, words);
+    }
+}
+
+// AND (erode) or OR (dilate) over the 2 * radius + 1 bits centered on each bit
+// of the rows in tmp, written back to words: the window reaching radius bits
+// forwards combined with the one reaching radius bits backwards, each built
+// with about log2(radius) word-wide shifts
+static void packed_horizontal_tile(void *arg, int row_begin, int row_end) {
+    struct packed_ctx *ctx = arg;
+    int words = ctx->words_per_row;
+    uint64_t fill = ctx->is_or ? 0 : ~(uint64_t)0;
+    row_combine combine = ctx->is_or ? or_rows : and_rows;
+    int tail = ctx->width % WORD_BITS;
+    uint64_t valid = tail ? ((uint64_t)1 << tail) - 1 : ~(uint64_t)0;
+
+    uint64_t *scratch = malloc(2 * (size_t)words * sizeof(uint64_t));
+    if (scratch == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        return;
+    }
+    uint64_t *backward = scratch, *shifted = scratch + words;
+    for (int y = row_begin; y < row_end; y++) {
+        uint64_t *row = ctx->tmp + (size_t)y * words;
+        uint64_t *out = ctx->words + (size_t)y * words;
+        // Bits past the image width act as outside pixels
+        row[words - 1] = ctx->is_or ? row[words - 1] & valid : row[words - 1] | ~valid;
+
+        packed_window(out, row, shifted, words, ctx->radius + 1, shift_toward_start, combine, fill);
+        packed_window(backward, row, shifted, words, ctx->radius + 1, shift_toward_end, combine, fill);
+        combine(out, out, backward, words);
+        out[words - 1] &= valid;
+    }
+    free(scratch);
+}
+
+static void packed_pass(struct packed_ctx *ctx, int height, const struct morph_params *params,
+                        int is_or, const uint64_t *neutral_row, int parallel) {
+    struct vertical_ctx vertical = { (const unsigned char *)ctx->words, (unsigned char *)ctx->tmp,
+                                     ctx->words_per_row * sizeof(uint64_t), ctx->words_per_row, height,
+                                     params->radius_y, is_or ? or_rows : and_rows,
+                                     (const unsigned char *)neutral_row };
+    ctx->radius = params->radius_x;
+    ctx->is_or = is_or;
+    if (parallel) {
+        parallel_tiles(height, vertical_tile_rows(ctx->width, params->radius_y), vertical_tile, &vertical);
+        parallel_tiles(height, default_tile_rows(ctx->width), packed_horizontal_tile, ctx);
+    } else {
+        vertical_tile(&vertical, 0, height);
+        packed_horizontal_tile(ctx, 0, height);
+    }
+}
+
+static int run_morph_bitmask(struct bitmask *mask, const struct morph_params *params, int parallel) {
+    if (params->op == MORPH_NONE) return 0;
+
+    int width = mask->width, height = mask->height, words_per_row = mask->words_per_row;
+    size_t words = (size_t)words_per_row * height;
+    struct packed_ctx ctx = { mask->words, malloc(words * sizeof(uint64_t)), width, words_per_row, 0, 0 };
+    uint64_t *ones = malloc(words_per_row * sizeof(uint64_t));
+    uint64_t *zeros = calloc(words_per_row, sizeof(uint64_t));
+    if (!ctx.tmp || !ones || !zeros) {
+        fprintf(stderr, "Error allocating memory\n");
+        free(ctx.tmp);
+        free(ones);
+        free(zeros);
+        return -1;
+    }
+    memset(ones, 0xff, words_per_row * sizeof(uint64_t));
+
+    int first_or = params->op == MORPH_DILATE || params->op == MORPH_CLOSE;
+    packed_pass(&ctx, height, params, first_or, first_or ? zeros : ones, parallel);
+    if (params->op == MORPH_OPEN || params->op == MORPH_CLOSE) {
+        packed_pass(&ctx, height, params, !first_or, first_or ? ones : zeros, parallel);
+    }
+
+    free(ctx.tmp);
+    free(ones);
+    free(zeros);
+    return 0;
+}
+
+int morph_bitmask(struct bitmask *mask, const struct morph_params *params) {
+    return run_morph_bitmask(mask, params, 0);
+}
+
+int morph_bitmask_omp(struct bitmask *mask, const struct morph_params *params) {
+    return run_morph_bitmask(mask, params, 1);
+}
+
+static int run_morph_binary(unsigned char *image, int width, int height,
+                            const struct morph_params *params, int parallel) {
+    if (params->op == MORPH_NONE) return 0;
+
+    struct bitmask mask;
+    if (bitmask_alloc(&mask, width, height) != 0) {
+        fprintf(stderr, "Error allocating memory\n");
+        return -1;
+    }
+    pack_bitmask(image, &mask, parallel);
+    int status = run_morph_bitmask(&mask, params, parallel);
+    if (status == 0) unpack_bitmask(&mask, image, parallel);
+    bitmask_free(&mask);
+    return status;
+}
+
+int morph_binary(unsigned char *image, int width, int height, const struct morph_params *params) {
+    return run_morph_binary(image, width, height, params, 0);
+}
+
+int morph_binary_omp(unsigned char *image, int width, int height, const struct morph_params *params) {
+    return run_morph_binary(image, width, height, params, 1);
+}
@@ -0,0 +1,46 @@
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+#include <stddef.h>
+#include "bitmask.h"
+
+enum morph_op {
+    MORPH_NONE,
+    MORPH_ERODE,
+    MORPH_DILATE,
+    MORPH_OPEN,     // erode, then dilate: removes specks smaller than the element
+    MORPH_CLOSE     // dilate, then erode: fills holes smaller than the element
+};
+
+// Rectangular structuring element of (2 * radius_x + 1) x (2 * radius_y + 1)
+// pixels centered on the pixel. Pixels outside the image never win the min/max.
+struct morph_params {
+    enum morph_op op;
+    int radius_x;
+    int radius_y;
+};
+
+// Parses "erode", "dilate", "open" or "close". Returns 0 on success, -1 otherwise.
+int parse_morph_op(const char *name, enum morph_op *op);
+
+// Grayscale morphology (min/max filters) of an 8-bit plane with the van
+// Herk/Gil-Werman algorithm: about three comparisons per pixel and pass,
+// whatever the element size. The vertical pass works on whole rows at a time.
+// Both return -1 when a buffer cannot be allocated.
+int morph_gray(const unsigned char *input_image, unsigned char *output_image,
+               int width, int height, const struct morph_params *params);
+int morph_gray_omp(const unsigned char *input_image, unsigned char *output_image,
+                   int width, int height, const struct morph_params *params);
+
+// Binary morphology in place on a 0/255 mask (any nonzero pixel is set). The
+// mask is packed to 64 pixels per word; rows are combined with the same van
+// Herk/Gil-Werman scheme on words and each row with about 2 * log2(radius_x)
+// word-wide shifts.
+int morph_binary(unsigned char *image, int width, int height, const struct morph_params *params);
+int morph_binary_omp(unsigned char *image, int width, int height, const struct morph_params *params);
+
+// The same on a mask that is already packed, in place
+int morph_bitmask(struct bitmask *mask, const struct morph_params *params);
+int morph_bitmask_omp(struct bitmask *mask, const struct morph_params *params);
+
+#endif
@@ -1,19 +1,33 @@
 #include "negative.h"
+#include "tasks.h"
 
-// Converts an image to negative
-void negative_serial(unsigned char *input_image, unsigned char *output_image, int width, int height, int channels) 
+struct negative_tile_ctx {
+    const struct image_buffer *input;
+    struct image_buffer *output;
+};
+
+static void negative_tile(void *arg, int row_begin, int row_end)
 {
-    size_t img_size = width * height * channels;
-    for (size_t i = 0; i < img_size; i++) {
-        output_image[i] = 255 - input_image[i];
+    struct negative_tile_ctx *ctx = arg;
+    size_t row_bytes = image_row_bytes(ctx->input);
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char *input_row = image_row(ctx->input, y);
+        unsigned char *output_row = image_row(ctx->output, y);
+        for (size_t i = 0; i < row_bytes; i++) {
+            output_row[i] = 255 - input_row[i];
+        }
     }
 }
 
-void negative_omp(unsigned char *input_image, unsigned char *output_image, int width, int height, int channels)
+// Converts an image to negative
+void negative_serial(const struct image_buffer *input, struct image_buffer *output)
 {
-    size_t img_size = width * height * channels;
-    #pragma omp parallel for
-    for (size_t i = 0; i < img_size; i++) {
-        output_image[i] = 255 - input_image[i];
-    }
+    struct negative_tile_ctx ctx = { input, output };
+    negative_tile(&ctx, 0, input->height);
+}
+
+void negative_omp(const struct image_buffer *input, struct image_buffer *output)
+{
+    struct negative_tile_ctx ctx = { input, output };
+    parallel_tiles(input->height, default_tile_rows(image_row_bytes(input)), negative_tile, &ctx);
 }
@@ -2,9 +2,11 @@
 #define NEGATIVE_H
 
 #include <stddef.h>
+#include "image.h"
 
-void negative_serial(unsigned char *input_image, unsigned char *output_image, int width, int height, int channels);
+// output has the input's size and channels; either may have padded rows
+void negative_serial(const struct image_buffer *input, struct image_buffer *output);
 
-void negative_omp(unsigned char *input_image, unsigned char *output_image, int width, int height, int channels);
+void negative_omp(const struct image_buffer *input, struct image_buffer *output);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,359 @@
+#include "options.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+
+void default_options(struct run_options *options) {
+    options->recursive = 0;
+    options->decode.jpeg_scale_denom = 1;
+    options->decode.resize.scale = 1.0;
+    options->decode.resize.filter = RESIZE_AUTO;
+    options->decode.region = (struct region_params){ 0, 0, 0, 0 };
+    options->encode.format = OUTPUT_PNG;
+    options->encode.pyramid.enabled = 0;
+    options->encode.pyramid.min_size = 32;
+    options->otsu.threshold = 0;
+    options->otsu.classes = 2;
+    options->otsu.sweep_count = 0;
+    options->adaptive_window = 31;
+    options->adaptive_k = 0.2;
+    options->blur.sigma = 2.0;
+    options->blur.box_radius = 0;
+    options->blur.border = BORDER_REPLICATE;
+    options->canny.sigma = 1.4;
+    options->canny.low = 40;
+    options->canny.high = 100;
+    options->morph.op = MORPH_NONE;
+    options->morph.radius_x = 1;
+    options->morph.radius_y = 1;
+    options->components.format = COMPONENTS_NONE;
+    options->components.skip_image = 0;
+    options->median_radius = 0;
+    options->hough.edge_threshold = 128;
+    options->hough.angles = 180;
+    options->hough.max_lines = 20;
+    options->hough.min_votes = 0;
+    options->hough.peak_radius = 5;
+    options->contrast.mode = CONTRAST_NONE;
+    options->contrast.tiles_x = 8;
+    options->contrast.tiles_y = 8;
+    options->contrast.clip_limit = 2.0;
+}
+
+static int add_sweep_threshold(struct otsu_params *otsu, int threshold) {
+    if (threshold < 0 || threshold > 255) {
+        fprintf(stderr, "Invalid sweep threshold %d: use 0 - 255\n", threshold);
+        return -1;
+    }
+    for (int i = 0; i < otsu->sweep_count; i++) {
+        if (otsu->sweep[i] == threshold) return 0;
+    }
+    if (otsu->sweep_count == OTSU_MAX_SWEEP) {
+        fprintf(stderr, "Too many sweep thresholds: at most %d\n", OTSU_MAX_SWEEP);
+        return -1;
+    }
+    otsu->sweep[otsu->sweep_count++] = threshold;
+    return 0;
+}
+
+// Comma separated thresholds or first:last:step ranges, e.g. "0,60:200:20"
+static int parse_sweep(const char *list, struct otsu_params *otsu) {
+    otsu->sweep_count = 0;
+    while (*list) {
+        char *end;
+        int first = (int)strtol(list, &end, 10);
+        if (end == list) break;
+        if (*end == ':') {
+            int last = (int)strtol(end + 1, &end, 10);
+            int step = 1;
+            if (*end == ':') step = (int)strtol(end + 1, &end, 10);
+            if (step <= 0 || last < first) break;
+            for (int t = first; t <= last; t += step) {
+                if (add_sweep_threshold(otsu, t) != 0) return -1;
+            }
+        } else if (add_sweep_threshold(otsu, first) != 0) {
+            return -1;
+        }
+        list = end;
+        if (*list == ',') list++;
+        else if (*list) break;
+    }
+    if (*list || otsu->sweep_count == 0) {
+        fprintf(stderr, "Invalid --sweep list near '%s'\n", list);
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_config_file(const char *path, struct run_options *options);
+
+static int parse_option(const char *arg, struct run_options *options, int allow_config) {
+    if (!strcmp(arg, "--recursive")) {
+        options->recursive = 1;
+    } else if (!strncmp(arg, "--jpeg-scale=", 13)) {
+        options->decode.jpeg_scale_denom = atoi(arg + 13);
+        if (options->decode.jpeg_scale_denom != 1 && options->decode.jpeg_scale_denom != 2 &&
+            options->decode.jpeg_scale_denom != 4 && options->decode.jpeg_scale_denom != 8) {
+            fprintf(stderr, "Invalid --jpeg-scale %s: use 1, 2, 4 or 8\n", arg + 13);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--threshold=", 12)) {
+        options->otsu.threshold = atoi(arg + 12);
+        if (options->otsu.threshold < 0 || options->otsu.threshold > 255) {
+            fprintf(stderr, "Invalid --threshold %s: use 0 - 255 (0 = Otsu's)\n", arg + 12);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--sweep=", 8)) {
+        return parse_sweep(arg + 8, &options->otsu);
+    } else if (!strncmp(arg, "--otsu-levels=", 14)) {
+        options->otsu.classes = atoi(arg + 14);
+        if (options->otsu.classes < 2 || options->otsu.classes > OTSU_MAX_CLASSES) {
+            fprintf(stderr, "Invalid --otsu-levels %s: use 2 to %d\n", arg + 14, OTSU_MAX_CLASSES);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--window=", 9)) {
+        options->adaptive_window = atoi(arg + 9);
+        if (options->adaptive_window < 3) {
+            fprintf(stderr, "Invalid --window %s: use at least 3\n", arg + 9);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--sauvola-k=", 12)) {
+        options->adaptive_k = atof(arg + 12);
+    } else if (!strncmp(arg, "--sigma=", 8)) {
+        options->blur.sigma = atof(arg + 8);
+        if (options->blur.sigma <= 0 || ceil(3.0 * options->blur.sigma) > MAX_KERNEL_RADIUS) {
+            fprintf(stderr, "Invalid --sigma %s: use a value in (0, %d]\n", arg + 8, MAX_KERNEL_RADIUS / 3);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--box=", 6)) {
+        options->blur.box_radius = atoi(arg + 6);
+        if (options->blur.box_radius < 0 || options->blur.box_radius > MAX_BOX_RADIUS) {
+            fprintf(stderr, "Invalid --box %s: use 0 to %d\n", arg + 6, MAX_BOX_RADIUS);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--border=", 9)) {
+        if (parse_border_mode(arg + 9, &options->blur.border) != 0) {
+            fprintf(stderr, "Invalid --border %s: use zero, replicate or reflect\n", arg + 9);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--canny-sigma=", 14)) {
+        options->canny.sigma = atof(arg + 14);
+        if (options->canny.sigma < 0 || ceil(3.0 * options->canny.sigma) > MAX_KERNEL_RADIUS) {
+            fprintf(stderr, "Invalid --canny-sigma %s: use a value in [0, %d]\n", arg + 14, MAX_KERNEL_RADIUS / 3);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--low=", 6)) {
+        options->canny.low = atoi(arg + 6);
+    } else if (!strncmp(arg, "--high=", 7)) {
+        options->canny.high = atoi(arg + 7);
+    } else if (!strncmp(arg, "--morph=", 8)) {
+        if (parse_morph_op(arg + 8, &options->morph.op) != 0) {
+            fprintf(stderr, "Invalid --morph %s: use erode, dilate, open or close\n", arg + 8);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--morph-size=", 13)) {
+        // N for an N x N element, or WxH
+        int element_width = 0, element_height = 0;
+        int fields = sscanf(arg + 13, "%dx%d", &element_width, &element_height);
+        if (fields == 1) element_height = element_width;
+        if (fields < 1 || element_width < 1 || element_height < 1 ||
+            element_width % 2 == 0 || element_height % 2 == 0) {
+            fprintf(stderr, "Invalid --morph-size %s: use odd sizes, N or WxH\n", arg + 13);
+            return -1;
+        }
+        options->morph.radius_x = element_width / 2;
+        options->morph.radius_y = element_height / 2;
+    } else if (!strncmp(arg, "--components=", 13)) {
+        if (parse_component_format(arg + 13, &options->components.format) != 0) {
+            fprintf(stderr, "Invalid --components %s: use csv or bin\n", arg + 13);
+            return -1;
+        }
+    } else if (!strcmp(arg, "--no-image")) {
+        options->components.skip_image = 1;
+    } else if (!strncmp(arg, "--median=", 9)) {
+        options->median_radius = atoi(arg + 9);
+        if (options->median_radius < 0 || options->median_radius > MAX_MEDIAN_RADIUS) {
+            fprintf(stderr, "Invalid --median %s: use a radius in [0, %d]\n", arg + 9, MAX_MEDIAN_RADIUS);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--equalize=", 11)) {
+        if (parse_contrast_mode(arg + 11, &options->contrast.mode) != 0) {
+            fprintf(stderr, "Invalid --equalize %s: use global or clahe\n", arg + 11);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--clahe-tiles=", 14)) {
+        // N for an N x N grid, or NxM
+        int tiles_x = 0, tiles_y = 0;
+        int fields = sscanf(arg + 14, "%dx%d", &tiles_x, &tiles_y);
+        if (fields == 1) tiles_y = tiles_x;
+        if (fields < 1 || tiles_x < 1 || tiles_y < 1 || tiles_x > MAX_CLAHE_TILES || tiles_y > MAX_CLAHE_TILES) {
+            fprintf(stderr, "Invalid --clahe-tiles %s: use N or NxM, 1 - %d\n", arg + 14, MAX_CLAHE_TILES);
+            return -1;
+        }
+        options->contrast.tiles_x = tiles_x;
+        options->contrast.tiles_y = tiles_y;
+    } else if (!strncmp(arg, "--clip=", 7)) {
+        options->contrast.clip_limit = atof(arg + 7);
+        if (options->contrast.clip_limit < 0) {
+            fprintf(stderr, "Invalid --clip %s: use 0 (no limit) or a positive multiple of the mean bin\n", arg + 7);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--scale=", 8)) {
+        // A factor (0.5) or a fraction (1/2)
+        double numerator = 0, denominator = 1;
+        int fields = sscanf(arg + 8, "%lf/%lf", &numerator, &denominator);
+        double scale = fields >= 1 && denominator > 0 ? numerator / denominator : 0;
+        if (scale * MAX_RESIZE_FACTOR < 1.0 || scale > MAX_RESIZE_FACTOR) {
+            fprintf(stderr, "Invalid --scale %s: use a factor in [1/%d, %d], e.g. 0.5 or 1/3\n", arg + 8,
+                    MAX_RESIZE_FACTOR, MAX_RESIZE_FACTOR);
+            return -1;
+        }
+        options->decode.resize.scale = scale;
+    } else if (!strncmp(arg, "--resize-filter=", 16)) {
+        if (parse_resize_filter(arg + 16, &options->decode.resize.filter) != 0) {
+            fprintf(stderr, "Invalid --resize-filter %s: use auto, area, bilinear or lanczos\n", arg + 16);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--format=", 9)) {
+        if (parse_output_format(arg + 9, &options->encode.format) != 0) {
+            fprintf(stderr, "Invalid --format %s: use png, raw, raw-lz or tiled\n", arg + 9);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--roi=", 6)) {
+        struct region_params *roi = &options->decode.region;
+        if (sscanf(arg + 6, "%d,%d,%dx%d", &roi->x, &roi->y, &roi->width, &roi->height) != 4 ||
+            roi->x < 0 || roi->y < 0 || roi->width < 1 || roi->height < 1) {
+            fprintf(stderr, "Invalid --roi %s: use X,Y,WxH with a non-empty size\n", arg + 6);
+            return -1;
+        }
+    } else if (!strcmp(arg, "--pyramid")) {
+        options->encode.pyramid.enabled = 1;
+    } else if (!strncmp(arg, "--pyramid=", 10)) {
+        options->encode.pyramid.enabled = 1;
+        options->encode.pyramid.min_size = atoi(arg + 10);
+        if (options->encode.pyramid.min_size < 1) {
+            fprintf(stderr, "Invalid --pyramid %s: use a minimum level size of at least 1 pixel\n", arg + 10);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--hough-threshold=", 18)) {
+        options->hough.edge_threshold = atoi(arg + 18);
+        if (options->hough.edge_threshold < 1 || options->hough.edge_threshold > 255) {
+            fprintf(stderr, "Invalid --hough-threshold %s: use 1 - 255\n", arg + 18);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--hough-angles=", 15)) {
+        options->hough.angles = atoi(arg + 15);
+        if (options->hough.angles < 1 || options->hough.angles > MAX_HOUGH_ANGLES) {
+            fprintf(stderr, "Invalid --hough-angles %s: use 1 - %d\n", arg + 15, MAX_HOUGH_ANGLES);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--hough-lines=", 14)) {
+        options->hough.max_lines = atoi(arg + 14);
+        if (options->hough.max_lines < 1 || options->hough.max_lines > MAX_HOUGH_LINES) {
+            fprintf(stderr, "Invalid --hough-lines %s: use 1 - %d\n", arg + 14, MAX_HOUGH_LINES);
+            return -1;
+        }
+    } else if (!strncmp(arg, "--hough-votes=", 14)) {
+        options->hough.min_votes = atoi(arg + 14);
+        if (options->hough.min_votes < 0) {
+            fprintf(stderr, "Invalid --hough-votes %s: use 0 (a tenth of the strongest) or more\n", arg + 14);
+            return -1;
+        }
+    } else if (allow_config && !strncmp(arg, "--config=", 9)) {
+        return parse_config_file(arg + 9, options);
+    } else {
+        fprintf(stderr, "Unknown option: %s\n", arg);
+        return -1;
+    }
+    return 0;
+}
+
+// One option per line without the leading dashes ("threshold = 120"),
+// '#' starts a comment. Config files do not nest.
+static int parse_config_file(const char *path, struct run_options *options) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    char line[1024];
+    int status = 0;
+    while (status == 0 && fgets(line, sizeof(line), file)) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        // Copy as --key=value, dropping all whitespace
+        char arg[1040] = "--";
+        size_t length = 2;
+        for (char *c = line; *c && length + 1 < sizeof(arg); c++) {
+            if (!isspace((unsigned char)*c)) arg[length++] = *c;
+        }
+        arg[length] = '\0';
+        if (length == 2) continue;
+
+        status = parse_option(arg, options, 0);
+        if (status != 0) fprintf(stderr, "  in config file %s\n", path);
+    }
+    fclose(file);
+    return status;
+}
+
+int parse_options(int argc, char **argv, int first, struct run_options *options) {
+    for (int i = first; i < argc; i++) {
+        if (parse_option(argv[i], options, 1) != 0) return -1;
+    }
+    if (options->canny.low < 1 || options->canny.high < options->canny.low) {
+        fprintf(stderr, "Invalid canny thresholds: need 1 <= --low <= --high\n");
+        return -1;
+    }
+    if (options->otsu.sweep_count > 0 && options->otsu.classes > 2) {
+        fprintf(stderr, "--sweep produces binary images and cannot be combined with --otsu-levels\n");
+        return -1;
+    }
+    if (options->decode.region.width > 0 && options->decode.resize.scale != 1.0) {
+        fprintf(stderr, "--roi and --scale cannot be combined\n");
+        return -1;
+    }
+    if (options->components.skip_image && options->components.format == COMPONENTS_NONE) {
+        fprintf(stderr, "--no-image needs --components, otherwise otsu would write nothing\n");
+        return -1;
+    }
+    return 0;
+}
+
+void print_options_usage(void) {
+    printf("Options:\n");
+    printf("  --recursive      walk subdirectories and mirror them under output_folder\n");
+    printf("  --jpeg-scale=N   decode JPEG inputs at 1/N size (N = 1, 2, 4, 8) for preview runs\n");
+    printf("  --scale=S        resize every input by S (e.g. 0.5 or 1/3) before the algorithm runs\n");
+    printf("  --resize-filter=F  auto (area for 1/N, else lanczos), area, bilinear or lanczos\n");
+    printf("  --pyramid[=MIN]  also write every 2x reduction of each output down to MIN pixels (default 32)\n");
+    printf("  --format=FMT     output container: png (default), raw (mapped by the next run), raw-lz or tiled\n");
+    printf("  --roi=X,Y,WxH    process only this region of every input; tiled inputs read only the tiles under it\n");
+    printf("  --threshold=N    otsu: fixed binarization threshold (0 - 255, default 0 = Otsu's)\n");
+    printf("  --sweep=LIST     otsu: decode once and write one image per threshold, e.g. 0,60:200:20\n");
+    printf("  --otsu-levels=K  multi-level otsu: K classes (2..%d) written as evenly spaced gray levels\n", OTSU_MAX_CLASSES);
+    printf("  --window=N       adaptive: neighbourhood side in pixels (default 31)\n");
+    printf("  --sauvola-k=K    adaptive: standard deviation weight (default 0.2)\n");
+    printf("  --sigma=S        blur: Gaussian standard deviation in pixels (default 2)\n");
+    printf("  --box=R          blur: box filter of radius R instead of the Gaussian\n");
+    printf("  --border=MODE    blur: zero, replicate (default) or reflect outside the image\n");
+    printf("  --canny-sigma=S  canny: Gaussian smoothing before the gradients (default 1.4, 0 = none)\n");
+    printf("  --low=N --high=N canny: hysteresis thresholds on the gradient magnitude (default 40, 100)\n");
+    printf("  --morph=OP       morph: erode, dilate, open or close; with otsu, cleans the thresholded output\n");
+    printf("  --morph-size=N   morph: odd N x N (or WxH) rectangular element (default 3)\n");
+    printf("  --components=FMT otsu: label blobs of binary output, writing area, box and centroid as csv or bin\n");
+    printf("  --no-image       otsu with --components: write only the component sidecar, not the PNG\n");
+    printf("  --median=R       median: (2R+1)^2 window (default 1); with sobel or otsu, denoises the input first\n");
+    printf("  --hough-threshold=N  hough: Sobel magnitude an edge pixel needs to vote (default 128)\n");
+    printf("  --hough-angles=N hough: theta bins over 180 degrees (default 180)\n");
+    printf("  --hough-lines=N  hough: strongest lines written to the csv (default 20)\n");
+    printf("  --hough-votes=N  hough: minimum votes of a line (default 0 = a tenth of the strongest)\n");
+    printf("  --equalize=MODE  equalize: global or clahe (default); with otsu, normalizes contrast first\n");
+    printf("  --clahe-tiles=N  clahe: N x N (or NxM) tile grid (default 8)\n");
+    printf("  --clip=C         clahe: bin limit as a multiple of the mean bin count (default 2, 0 = none)\n");
+    printf("  --config=FILE    read options from FILE, one per line without dashes (threshold = 120)\n");
+}
@@ -0,0 +1,42 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "otsu.h"
+#include "convolve.h"
+#include "canny.h"
+#include "morphology.h"
+#include "median.h"
+#include "equalize.h"
+#include "resize.h"
+#include "decode.h"
+#include "encode.h"
+#include "hough.h"
+
+// Optional settings passed after the algorithm on the command line or read
+// from a --config file
+struct run_options {
+    int recursive;              // --recursive: also process images in subdirectories
+    struct decode_params decode;    // --jpeg-scale, --scale, --resize-filter and --roi: how every input is loaded
+    struct encode_params encode;    // --format and --pyramid: how every output is written
+    struct otsu_params otsu;    // --threshold, --sweep and --otsu-levels
+    int adaptive_window;        // --window=N: side of the adaptive threshold neighbourhood in pixels
+    double adaptive_k;          // --sauvola-k=K: weight of the local standard deviation in adaptive
+    struct blur_params blur;    // --sigma, --box and --border
+    struct canny_params canny;  // --canny-sigma, --low and --high
+    struct morph_params morph;  // --morph and --morph-size: the morph algorithm, and cleanup after otsu
+    struct component_params components; // --components and --no-image: blob statistics after otsu
+    int median_radius;          // --median=R: the median algorithm, and a denoising pre-stage for sobel and otsu
+    struct hough_params hough;  // --hough-threshold, --hough-angles, --hough-lines and --hough-votes
+    struct contrast_params contrast;    // --equalize, --clahe-tiles and --clip: the equalize algorithm, and before otsu
+};
+
+void default_options(struct run_options *options);
+
+// Parses argv[first..argc) into options, later options overriding earlier ones
+// and --config files applied at their position. Returns 0 on success, -1 on an
+// unknown or invalid option.
+int parse_options(int argc, char **argv, int first, struct run_options *options);
+
+void print_options_usage(void);
+
+#endif
@@ -2,28 +2,32 @@
 #include <stdlib.h>
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include <omp.h>
+#include "tasks.h"
+#include "utility.h"
+#include "morphology.h"
+#include "encode.h"
+#include "decode.h"
 
-#define GRAY_LEVELS 256
+#define GRAY_LEVELS HISTOGRAM_BINS
 
-int compute_otsu_threshold(const unsigned char *gray_image, int width, int height) {
-    int histogram[GRAY_LEVELS] = {0};
-    int total_pixels = width * height;
-
-    // Compute histogram
-    for (int i = 0; i < total_pixels; i++) {
-        histogram[gray_image[i]]++;
+// Otsu's threshold search over a precomputed histogram
+int otsu_threshold_from_histogram(const unsigned long long histogram[GRAY_LEVELS]) {
+    double total_pixels = 0;
+    for (int i = 0; i < GRAY_LEVELS; i++) {
+        total_pixels += histogram[i];
     }
 
     // Total mean level
     double sum = 0;
     for (int i = 0; i < GRAY_LEVELS; i++) {
-        sum += i * histogram[i];
+        sum += (double)i * histogram[i];
     }
 
     double sumB = 0;
-    int wB = 0;
-    int wF = 0;
+    double wB = 0;
+    double wF = 0;
 
     double varMax = 0;
     int threshold = 0;
@@ -35,13 +39,13 @@ int compute_otsu_threshold(const unsigned char *gray_image, int width, int heigh
         wF = total_pixels - wB;           // Weight Foreground
         if (wF == 0) break;
 
-        sumB += (double)(t * histogram[t]);
+        sumB += (double)t * histogram[t];
 
         double mB = sumB / wB;            // Mean Background
         double mF = (sum - sumB) / wF;    // Mean Foreground
 
         // Between Class Variance
-        double varBetween = (double)wB * (double)wF * (mB - mF) * (mB - mF);
+        double varBetween = wB * wF * (mB - mF) * (mB - mF);
 
         // Check if new maximum found
         if (varBetween > varMax) {
@@ -53,203 +57,469 @@ int compute_otsu_threshold(const unsigned char *gray_image, int width, int heigh
     return threshold;
 }
 
-void apply_threshold(const unsigned char *gray_image, unsigned char *binary_image,
-                     int width, int height, int threshold) {
-    int total_pixels = width * height;
+int compute_otsu_threshold(const struct image_buffer *gray_image) {
+    unsigned long long histogram[GRAY_LEVELS];
+    histogram_compute_serial(gray_image->data, gray_image->width, gray_image->height, gray_image->stride, histogram);
+    return otsu_threshold_from_histogram(histogram);
+}
 
-    for (int i = 0; i < total_pixels; i++) {
-        binary_image[i] = (gray_image[i] > threshold) ? 255 : 0;
+struct threshold_tile_ctx {
+    const struct image_buffer *gray_image;
+    struct image_buffer *binary_image;
+    int threshold;
+};
+
+static void threshold_tile(void *arg, int row_begin, int row_end) {
+    struct threshold_tile_ctx *ctx = arg;
+    int width = ctx->gray_image->width;
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char *gray = image_row(ctx->gray_image, y);
+        unsigned char *binary = image_row(ctx->binary_image, y);
+        for (int x = 0; x < width; x++) {
+            binary[x] = (gray[x] > ctx->threshold) ? 255 : 0;
+        }
     }
 }
 
-void otsu_serial(unsigned char *img, const char *filename, int user_threshold, int width, int height, int channels)
-{
-    // Convert to grayscale if necessary
-    unsigned char *gray_img = NULL;
-    if (channels == 1) {
-        gray_img = img;
-    } else {
-        gray_img = (unsigned char *)malloc(width * height);
-        if (gray_img == NULL) {
-            fprintf(stderr, "Error allocating memory\n");
-            stbi_image_free(img);
+void apply_threshold(const struct image_buffer *gray_image, struct image_buffer *binary_image, int threshold) {
+    struct threshold_tile_ctx ctx = { gray_image, binary_image, threshold };
+    threshold_tile(&ctx, 0, gray_image->height);
+}
+
+// Multi-level Otsu. With prefix sums P (pixel count) and S (gray sum) of the
+// histogram, a class covering levels [u, v] contributes (S_v - S_u-1)^2 / (P_v - P_u-1)
+// to the between-class variance. That term is tabulated once for every (u, v)
+// (O(L^2)), and the best split into c classes ending at level v is built from the
+// best split into c - 1 classes ending before u (O(classes * L^2)) instead of
+// trying all O(L^(classes - 1)) threshold combinations.
+void compute_multi_otsu_thresholds(const unsigned long long histogram[GRAY_LEVELS], int classes, int *thresholds) {
+    double P[GRAY_LEVELS + 1];
+    double S[GRAY_LEVELS + 1];
+    P[0] = S[0] = 0.0;
+    for (int i = 0; i < GRAY_LEVELS; i++) {
+        P[i + 1] = P[i] + histogram[i];
+        S[i + 1] = S[i] + (double)i * histogram[i];
+    }
+
+    // score[u][v]: contribution of a class spanning levels u..v
+    double (*score)[GRAY_LEVELS] = malloc(sizeof(double[GRAY_LEVELS][GRAY_LEVELS]));
+    for (int u = 0; u < GRAY_LEVELS; u++) {
+        for (int v = u; v < GRAY_LEVELS; v++) {
+            double count = P[v + 1] - P[u];
+            double sum = S[v + 1] - S[u];
+            score[u][v] = count > 0 ? sum * sum / count : 0.0;
         }
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                int idx = y * width + x;
-                int idx_img = idx * channels;
-                int r = img[idx_img];
-                int g = img[idx_img + 1];
-                int b = img[idx_img + 2];
-                gray_img[idx] = (r + g + b) / 3;
+    }
+
+    // best[c][v]: best score splitting levels 0..v into c + 1 classes,
+    // start[c][v]: first level of the last of those classes
+    double (*best)[GRAY_LEVELS] = malloc(sizeof(double[OTSU_MAX_CLASSES][GRAY_LEVELS]));
+    int (*start)[GRAY_LEVELS] = malloc(sizeof(int[OTSU_MAX_CLASSES][GRAY_LEVELS]));
+    for (int v = 0; v < GRAY_LEVELS; v++) {
+        best[0][v] = score[0][v];
+        start[0][v] = 0;
+    }
+    for (int c = 1; c < classes; c++) {
+        for (int v = c; v < GRAY_LEVELS; v++) {
+            double best_value = -1.0;
+            int best_start = c;
+            for (int u = c; u <= v; u++) {
+                double value = best[c - 1][u - 1] + score[u][v];
+                if (value > best_value) {
+                    best_value = value;
+                    best_start = u;
+                }
             }
+            best[c][v] = best_value;
+            start[c][v] = best_start;
         }
-        stbi_image_free(img);
     }
 
-    // Compute Otsu's threshold if user_threshold is 0
-    int threshold;
-    if (user_threshold == 0) {
-        threshold = compute_otsu_threshold(gray_img, width, height);
-        printf("Computed Otsu's threshold: %d\n", threshold);
-    } else {
-        threshold = user_threshold;
-        printf("Using user-provided threshold: %d\n", threshold);
+    // Walk the split back from the last class
+    int v = GRAY_LEVELS - 1;
+    for (int c = classes - 1; c > 0; c--) {
+        int u = start[c][v];
+        thresholds[c - 1] = u - 1;
+        v = u - 1;
     }
 
-    // Apply threshold
-    unsigned char *binary_img = (unsigned char *)malloc(width * height);
-    if (binary_img == NULL) {
-        fprintf(stderr, "Error allocating memory\n");
-        if (channels != 1) free(gray_img);
+    free(score);
+    free(best);
+    free(start);
+}
+
+// Gray level written for each class: classes spread evenly over 0..255
+static void build_label_lut(const int *thresholds, int classes, unsigned char lut[GRAY_LEVELS]) {
+    int c = 0;
+    for (int i = 0; i < GRAY_LEVELS; i++) {
+        while (c < classes - 1 && i > thresholds[c]) c++;
+        lut[i] = (unsigned char)(c * 255 / (classes - 1));
     }
-    apply_threshold(gray_img, binary_img, width, height, threshold);
-    // Save the binary image
-    char output_path[1024];
-    sprintf(output_path, "output_folder/serial_otsu%s", filename);
-    printf("Saving image to path: %s\n", output_path);
-    if (!stbi_write_png(output_path, width, height, 1, binary_img, width)) {
-        fprintf(stderr, "Error writing image %s\n", output_path);
+}
+
+struct label_tile_ctx {
+    const struct image_buffer *gray_image;
+    struct image_buffer *label_image;
+    const unsigned char *lut;
+};
+
+static void label_tile(void *arg, int row_begin, int row_end) {
+    struct label_tile_ctx *ctx = arg;
+    int width = ctx->gray_image->width;
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char *gray = image_row(ctx->gray_image, y);
+        unsigned char *label = image_row(ctx->label_image, y);
+        for (int x = 0; x < width; x++) {
+            label[x] = ctx->lut[gray[x]];
+        }
     }
+}
 
-    // Clean up
-    if (channels != 1) free(gray_img);
-    free(binary_img);
+void apply_multi_threshold(const struct image_buffer *gray_image, struct image_buffer *label_image,
+                           const int *thresholds, int classes) {
+    unsigned char lut[GRAY_LEVELS];
+    build_label_lut(thresholds, classes, lut);
+    struct label_tile_ctx ctx = { gray_image, label_image, lut };
+    label_tile(&ctx, 0, gray_image->height);
 }
 
-int compute_otsu_threshold_omp(const unsigned char *gray_image, int width, int height) {
-    int total_pixels = width * height;
-    int histogram[GRAY_LEVELS] = {0};
+void apply_multi_threshold_omp(const struct image_buffer *gray_image, struct image_buffer *label_image,
+                               const int *thresholds, int classes) {
+    unsigned char lut[GRAY_LEVELS];
+    build_label_lut(thresholds, classes, lut);
+    struct label_tile_ctx ctx = { gray_image, label_image, lut };
+    parallel_tiles(gray_image->height, default_tile_rows(gray_image->width), label_tile, &ctx);
+}
 
-    // Compute histogram with OpenMP
-    int num_threads = omp_get_max_threads();
-    int **local_histograms = (int **)malloc(num_threads * sizeof(int *));
-    for (int i = 0; i < num_threads; i++) {
-        local_histograms[i] = (int *)calloc(GRAY_LEVELS, sizeof(int));
+void print_otsu_thresholds(const char *prefix, const int *thresholds, int classes) {
+    char text[16 * OTSU_MAX_CLASSES] = "";
+    for (int c = 0; c < classes - 1; c++) {
+        char value[16];
+        snprintf(value, sizeof(value), c ? ", %d" : "%d", thresholds[c]);
+        strcat(text, value);
     }
+    printf("%sComputed %d-level Otsu thresholds: %s\n", prefix, classes, text);
+}
 
-    #pragma omp parallel
-    {
-        int thread_id = omp_get_thread_num();
-        int *local_hist = local_histograms[thread_id];
-
-        #pragma omp for nowait
-        for (int i = 0; i < total_pixels; i++) {
-            local_hist[gray_image[i]]++;
-        }
+// The median, contrast, morphology and labeling stages take packed planes, so
+// an image with padded rows goes through a packed copy
+static unsigned char *packed_plane(const struct image_buffer *image) {
+    size_t row_bytes = image_row_bytes(image);
+    if (image->stride == row_bytes) return image->data;
+    unsigned char *plane = malloc(row_bytes * image->height);
+    if (plane == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        return NULL;
+    }
+    for (int y = 0; y < image->height; y++) {
+        memcpy(plane + (size_t)y * row_bytes, image_row(image, y), row_bytes);
     }
+    return plane;
+}
 
-    // Combine local histograms
-    for (int i = 0; i < GRAY_LEVELS; i++) {
-        for (int j = 0; j < num_threads; j++) {
-            histogram[i] += local_histograms[j][i];
+// Copies a plane from packed_plane back into image (store set) and frees it
+static void release_plane(struct image_buffer *image, unsigned char *plane, int store) {
+    if (plane == image->data) return;
+    size_t row_bytes = image_row_bytes(image);
+    if (store) {
+        for (int y = 0; y < image->height; y++) {
+            memcpy(image_row(image, y), plane + (size_t)y * row_bytes, row_bytes);
         }
     }
+    free(plane);
+}
 
-    // Free local histograms
-    for (int i = 0; i < num_threads; i++) {
-        free(local_histograms[i]);
+// Morphological cleanup of a thresholded image before it is saved: bit-packed
+// binary morphology for masks, min/max filters for multi-level label images
+void clean_thresholded_image(struct image_buffer *image, int classes, const struct morph_params *cleanup,
+                             int parallel) {
+    if (cleanup == NULL || cleanup->op == MORPH_NONE) return;
+    int width = image->width, height = image->height;
+    unsigned char *plane = packed_plane(image);
+    if (plane == NULL) return;
+    if (classes <= 2) {
+        if (parallel) morph_binary_omp(plane, width, height, cleanup);
+        else morph_binary(plane, width, height, cleanup);
+        release_plane(image, plane, 1);
+        return;
     }
-    free(local_histograms);
-
-    // Total mean level
-    double sum = 0.0;
-    for (int i = 0; i < GRAY_LEVELS; i++) {
-        sum += i * histogram[i];
+    unsigned char *labels = malloc((size_t)width * height);
+    if (labels == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        release_plane(image, plane, 0);
+        return;
     }
+    memcpy(labels, plane, (size_t)width * height);
+    if (parallel) morph_gray_omp(labels, plane, width, height, cleanup);
+    else morph_gray(labels, plane, width, height, cleanup);
+    free(labels);
+    release_plane(image, plane, 1);
+}
 
-    double sumB = 0.0;
-    int wB = 0;
-    int threshold = 0;
-    double varMax = 0.0;
+void otsu_prefilter(struct image_buffer *gray_image, const struct otsu_stages *stages, int parallel) {
+    if (stages == NULL) return;
+    int contrast = stages->contrast != NULL && stages->contrast->mode != CONTRAST_NONE;
+    if (stages->median_radius <= 0 && !contrast) return;
+    unsigned char *plane = packed_plane(gray_image);
+    if (plane == NULL) return;
+    median_prefilter(plane, gray_image->width, gray_image->height, stages->median_radius, parallel);
+    contrast_prefilter(plane, gray_image->width, gray_image->height, stages->contrast, parallel);
+    release_plane(gray_image, plane, 1);
+}
 
-    // Threshold computation remains serial due to data dependencies
-    for (int t = 0; t < GRAY_LEVELS; t++) {
-        wB += histogram[t];               // Weight Background
-        if (wB == 0) continue;
+void save_thresholded_image(struct image_buffer *image, int classes, const char *output_path,
+                            const struct otsu_stages *stages, int parallel) {
+    const struct component_params *components = stages ? stages->components : NULL;
+    clean_thresholded_image(image, classes, stages ? stages->cleanup : NULL, parallel);
+
+    if (components != NULL && components->format != COMPONENTS_NONE && classes <= 2) {
+        struct component_list list;
+        unsigned char *plane = packed_plane(image);
+        int status = plane == NULL ? -1
+                   : parallel ? label_components_omp(plane, image->width, image->height, &list)
+                              : label_components(plane, image->width, image->height, &list);
+        if (plane != NULL) release_plane(image, plane, 0);
+        if (status == 0) {
+            write_component_sidecar(output_path, &list, components->format);
+            free_component_list(&list);
+        }
+    }
+    if (components != NULL && components->skip_image) return;
 
-        int wF = total_pixels - wB;       // Weight Foreground
-        if (wF == 0) break;
+    printf("Saving image to path: %s\n", output_path);
+    if (!write_png(output_path, image->width, image->height, 1, image->data, image->stride,
+                   stages ? stages->output : NULL, parallel)) {
+        fprintf(stderr, "Error writing image %s\n", output_path);
+    }
+}
+
+void save_binary_mask(struct bitmask *mask, const char *output_path, const struct otsu_stages *stages,
+                      int parallel) {
+    const struct morph_params *cleanup = stages ? stages->cleanup : NULL;
+    const struct component_params *components = stages ? stages->components : NULL;
+    if (cleanup != NULL && cleanup->op != MORPH_NONE) {
+        if (parallel) morph_bitmask_omp(mask, cleanup);
+        else morph_bitmask(mask, cleanup);
+    }
 
-        sumB += (double)(t * histogram[t]);
+    if (components != NULL && components->format != COMPONENTS_NONE) {
+        struct component_list list;
+        int status = parallel ? label_bitmask_omp(mask, &list) : label_bitmask(mask, &list);
+        if (status == 0) {
+            write_component_sidecar(output_path, &list, components->format);
+            free_component_list(&list);
+        }
+    }
+    if (components != NULL && components->skip_image) return;
 
-        double mB = sumB / wB;            // Mean Background
-        double mF = (sum - sumB) / wF;    // Mean Foreground
+    printf("Saving image to path: %s\n", output_path);
+    if (!write_png_1bit(output_path, mask, stages ? stages->output : NULL, parallel)) {
+        fprintf(stderr, "Error writing image %s\n", output_path);
+    }
+}
 
-        // Between Class Variance
-        double varBetween = (double)wB * (double)wF * (mB - mF) * (mB - mF);
+struct sweep_tile_ctx {
+    const struct image_buffer *gray_image;
+    const int *thresholds;
+    const int *requested;
+    const char *output_path;
+    const struct otsu_stages *stages;
+};
+
+static void sweep_tile(void *arg, int begin, int end) {
+    struct sweep_tile_ctx *ctx = arg;
+    struct bitmask mask;
+    if (bitmask_alloc(&mask, ctx->gray_image->width, ctx->gray_image->height) != 0) {
+        fprintf(stderr, "Error allocating memory\n");
+        return;
+    }
+    for (int i = begin; i < end; i++) {
+        char suffix[16], variant_path[OUTPUT_PATH_MAX];
+        if (ctx->requested[i] == 0) {
+            snprintf(suffix, sizeof(suffix), "_otsu");
+        } else {
+            snprintf(suffix, sizeof(suffix), "_t%d", ctx->requested[i]);
+        }
+        if (suffixed_output_path(variant_path, sizeof(variant_path), ctx->output_path, suffix) != 0) {
+            fprintf(stderr, "Output path too long: %s\n", ctx->output_path);
+            continue;
+        }
+        // Cleanup works in place, so every variant thresholds afresh
+        threshold_to_bitmask(ctx->gray_image, ctx->thresholds[i], &mask);
+        save_binary_mask(&mask, variant_path, ctx->stages, 0);
+    }
+    bitmask_free(&mask);
+}
 
-        // Check if new maximum found
-        if (varBetween > varMax) {
-            varMax = varBetween;
-            threshold = t;
+void otsu_sweep(const struct image_buffer *gray_image, const struct otsu_params *params,
+                const struct otsu_stages *stages, const char *output_path, int parallel) {
+    int thresholds[OTSU_MAX_SWEEP];
+    int otsu = -1;
+    for (int i = 0; i < params->sweep_count; i++) {
+        thresholds[i] = params->sweep[i];
+        if (thresholds[i] == 0) {
+            if (otsu < 0) {
+                otsu = parallel ? compute_otsu_threshold_omp(gray_image) : compute_otsu_threshold(gray_image);
+                printf("Computed Otsu's threshold: %d\n", otsu);
+            }
+            thresholds[i] = otsu;
         }
     }
 
-    return threshold;
+    // Thresholding is a few cycles per pixel next to PNG encoding, so in
+    // parallel every variant is one task that thresholds and encodes its own buffer
+    if (create_parent_directories(output_path) != 0) return;
+    struct sweep_tile_ctx ctx = { gray_image, thresholds, params->sweep, output_path, stages };
+    if (parallel) {
+        parallel_tiles(params->sweep_count, 1, sweep_tile, &ctx);
+    } else {
+        sweep_tile(&ctx, 0, params->sweep_count);
+    }
 }
 
-void apply_threshold_omp(const unsigned char *gray_image, unsigned char *binary_image,
-                     int width, int height, int threshold) {
-    int total_pixels = width * height;
-
-    // Apply threshold with OpenMP
-    #pragma omp parallel for
-    for (int i = 0; i < total_pixels; i++) {
-        binary_image[i] = (gray_image[i] > threshold) ? 255 : 0;
+struct gray_tile_ctx {
+    const struct image_buffer *img;
+    struct image_buffer *gray_img;
+};
+
+// Same luma as the decoders: channel 0 of gray(+alpha) rows, the
+// (77 R + 150 G + 29 B) >> 8 weights of RGB(A) rows
+static void gray_tile(void *arg, int row_begin, int row_end) {
+    struct gray_tile_ctx *ctx = arg;
+    for (int y = row_begin; y < row_end; y++) {
+        convert_channels(image_row(ctx->img, y), ctx->img->channels, image_row(ctx->gray_img, y), 1,
+                         ctx->img->width);
     }
 }
 
-void otsu_omp(unsigned char *img, const char *filename, int user_threshold, int width, int height, int channels)
-{
-    // Convert to grayscale if necessary
-    unsigned char *gray_img = NULL;
-    if (channels == 1) {
-        gray_img = img;
+int otsu_gray_plane(struct image_buffer *img, struct image_buffer *gray_img, int parallel) {
+    if (img->channels == 1) {
+        // Take the loaded plane over as it is
+        *gray_img = *img;
+        img->flags = 0;
+        return 0;
+    }
+    if (image_alloc(gray_img, img->width, img->height, 1) != 0) {
+        fprintf(stderr, "Error allocating memory\n");
+        image_free(img);
+        return -1;
+    }
+    struct gray_tile_ctx ctx = { img, gray_img };
+    if (parallel) {
+        // Parallelize the grayscale conversion
+        parallel_tiles(img->height, default_tile_rows(img->width), gray_tile, &ctx);
     } else {
-        gray_img = (unsigned char *)malloc(width * height);
-        if (gray_img == NULL) {
+        gray_tile(&ctx, 0, img->height);
+    }
+    image_free(img);
+    return 0;
+}
+
+// Thresholds the prefiltered gray plane into output_path: one binary image per
+// sweep threshold, a multi-level label image, or a single 1-bit mask
+static void otsu_threshold_plane(struct image_buffer *gray_img, const char *output_path,
+                                 const struct otsu_params *params, const struct otsu_stages *stages,
+                                 int parallel) {
+    if (params->sweep_count > 0) {
+        otsu_sweep(gray_img, params, stages, output_path, parallel);
+        return;
+    }
+
+    if (create_parent_directories(output_path) != 0) return;
+    if (params->classes > 2) {
+        // Multi-level Otsu: a label image with one gray level per class
+        struct image_buffer label_img;
+        if (image_alloc(&label_img, gray_img->width, gray_img->height, 1) != 0) {
             fprintf(stderr, "Error allocating memory\n");
-            stbi_image_free(img);
+            return;
         }
-        // Parallelize the grayscale conversion
-        #pragma omp parallel for
-        for (int idx = 0; idx < width * height; idx++) {
-            int idx_img = idx * channels;
-            int r = img[idx_img];
-            int g = img[idx_img + 1];
-            int b = img[idx_img + 2];
-            gray_img[idx] = (r + g + b) / 3;
+        unsigned long long histogram[GRAY_LEVELS];
+        int thresholds[OTSU_MAX_CLASSES - 1];
+        if (parallel) {
+            histogram_compute(gray_img->data, gray_img->width, gray_img->height, gray_img->stride, histogram);
+        } else {
+            histogram_compute_serial(gray_img->data, gray_img->width, gray_img->height, gray_img->stride, histogram);
         }
-        stbi_image_free(img);
+        compute_multi_otsu_thresholds(histogram, params->classes, thresholds);
+        print_otsu_thresholds("", thresholds, params->classes);
+        if (parallel) apply_multi_threshold_omp(gray_img, &label_img, thresholds, params->classes);
+        else apply_multi_threshold(gray_img, &label_img, thresholds, params->classes);
+        save_thresholded_image(&label_img, params->classes, output_path, stages, parallel);
+        image_free(&label_img);
+        return;
     }
 
-    // Compute Otsu's threshold if user_threshold is 0
+    // Compute Otsu's threshold if no threshold was given
     int threshold;
-    if (user_threshold == 0) {
-        threshold = compute_otsu_threshold_omp(gray_img, width, height);
+    if (params->threshold == 0) {
+        threshold = parallel ? compute_otsu_threshold_omp(gray_img) : compute_otsu_threshold(gray_img);
         printf("Computed Otsu's threshold: %d\n", threshold);
     } else {
-        threshold = user_threshold;
+        threshold = params->threshold;
         printf("Using user-provided threshold: %d\n", threshold);
     }
 
-    // Apply threshold
-    unsigned char *binary_img = (unsigned char *)malloc(width * height);
-    if (binary_img == NULL) {
+    // Threshold straight into a packed mask and save it as a 1-bit PNG
+    struct bitmask mask;
+    if (bitmask_alloc(&mask, gray_img->width, gray_img->height) != 0) {
         fprintf(stderr, "Error allocating memory\n");
-        if (channels != 1) free(gray_img);
-    }
-    apply_threshold_omp(gray_img, binary_img, width, height, threshold);
-    // Save the binary image
-    char output_path[1024];
-    sprintf(output_path, "output_folder/omp_otsu%s", filename);
-    printf("Saving image to path: %s\n", output_path);
-    if (!stbi_write_png(output_path, width, height, 1, binary_img, width)) {
-        fprintf(stderr, "Error writing image %s\n", output_path);
+        return;
     }
+    if (parallel) threshold_to_bitmask_omp(gray_img, threshold, &mask);
+    else threshold_to_bitmask(gray_img, threshold, &mask);
+    save_binary_mask(&mask, output_path, stages, parallel);
+    bitmask_free(&mask);
+}
+
+void otsu_image(struct image_buffer *img, const char *output_path, const struct otsu_params *params,
+                const struct otsu_stages *stages, int parallel) {
+    // Convert to grayscale if necessary
+    struct image_buffer gray_img;
+    if (otsu_gray_plane(img, &gray_img, parallel) != 0) return;
+
+    otsu_prefilter(&gray_img, stages, parallel);
+    otsu_threshold_plane(&gray_img, output_path, params, stages, parallel);
 
     // Clean up
-    if (channels != 1) free(gray_img);
-    free(binary_img);
-}
\ No newline at end of file
+    image_free(&gray_img);
+}
+
+void otsu_serial(struct image_buffer *img, const char *filename, const struct otsu_params *params,
+                 const struct otsu_stages *stages)
+{
+    char output_path[OUTPUT_PATH_MAX];
+    if (snprintf(output_path, sizeof(output_path), "output_folder/serial_otsu%s", filename) >=
+            (int)sizeof(output_path)) {
+        fprintf(stderr, "Output path too long for %s\n", filename);
+        image_free(img);
+        return;
+    }
+    otsu_image(img, output_path, params, stages, 0);
+}
+
+int compute_otsu_threshold_omp(const struct image_buffer *gray_image) {
+    // Compute histogram with OpenMP; the threshold search itself is 256 steps
+    // with data dependencies, so it stays serial
+    unsigned long long histogram[GRAY_LEVELS];
+    histogram_compute(gray_image->data, gray_image->width, gray_image->height, gray_image->stride, histogram);
+    return otsu_threshold_from_histogram(histogram);
+}
+
+void apply_threshold_omp(const struct image_buffer *gray_image, struct image_buffer *binary_image, int threshold) {
+    // Apply threshold with OpenMP
+    struct threshold_tile_ctx ctx = { gray_image, binary_image, threshold };
+    parallel_tiles(gray_image->height, default_tile_rows(gray_image->width), threshold_tile, &ctx);
+}
+
+void otsu_omp(struct image_buffer *img, const char *filename, const struct otsu_params *params,
+              const struct otsu_stages *stages)
+{
+    char output_path[OUTPUT_PATH_MAX];
+    if (snprintf(output_path, sizeof(output_path), "output_folder/omp_otsu%s", filename) >=
+            (int)sizeof(output_path)) {
+        fprintf(stderr, "Output path too long for %s\n", filename);
+        image_free(img);
+        return;
+    }
+    otsu_image(img, output_path, params, stages, 1);
+}
@@ -3,17 +3,99 @@
 
 #include "image.h"
 #include <stddef.h>
+#include "histogram.h"
+#include "morphology.h"
+#include "components.h"
+#include "median.h"
+#include "equalize.h"
+#include "encode.h"
 
-int compute_otsu_threshold(const unsigned char *gray_image, int width, int height);
-void apply_threshold(const unsigned char *gray_image, unsigned char *binary_image,
-                     int width, int height, int threshold);
+// Threshold maximizing the between-class variance of a 256-bin histogram
+int otsu_threshold_from_histogram(const unsigned long long histogram[HISTOGRAM_BINS]);
 
-int compute_otsu_threshold_omp(const unsigned char *gray_image, int width, int height);
-void apply_threshold_omp(const unsigned char *gray_image, unsigned char *binary_image,
-                     int width, int height, int threshold);
+// Gray planes and the 0/255 or label images made from them are 1-channel
+// image_buffers of one size; any of them may have padded rows
+int compute_otsu_threshold(const struct image_buffer *gray_image);
+void apply_threshold(const struct image_buffer *gray_image, struct image_buffer *binary_image, int threshold);
 
-void otsu_serial(unsigned char *img, const char *filename, int user_threshold, int width, int height, int channels);
+int compute_otsu_threshold_omp(const struct image_buffer *gray_image);
+void apply_threshold_omp(const struct image_buffer *gray_image, struct image_buffer *binary_image, int threshold);
 
-void otsu_omp(unsigned char *img, const char *filename, int user_threshold, int width, int height, int channels);
+// Largest number of classes the multi-level mode accepts
+#define OTSU_MAX_CLASSES 8
+
+// Multi-level Otsu: splits the histogram into classes (2..OTSU_MAX_CLASSES) and
+// writes the classes - 1 thresholds; thresholds[c] is the last gray level of class c
+void compute_multi_otsu_thresholds(const unsigned long long histogram[HISTOGRAM_BINS], int classes, int *thresholds);
+
+// Quantized label image: class c becomes gray level c * 255 / (classes - 1)
+void apply_multi_threshold(const struct image_buffer *gray_image, struct image_buffer *label_image,
+                           const int *thresholds, int classes);
+void apply_multi_threshold_omp(const struct image_buffer *gray_image, struct image_buffer *label_image,
+                               const int *thresholds, int classes);
+
+void print_otsu_thresholds(const char *prefix, const int *thresholds, int classes);
+
+// Most thresholds a single sweep run evaluates
+#define OTSU_MAX_SWEEP 64
+
+struct otsu_params {
+    int threshold;              // binary threshold, 0 = Otsu's
+    int classes;                // 2 = binary, more = multi-level label image
+    int sweep_count;            // > 0: one binary image per sweep threshold instead
+    int sweep[OTSU_MAX_SWEEP];  // 0 in the list stands for Otsu's threshold
+};
+
+// Optional stages around the threshold itself; pointer members may be NULL
+struct otsu_stages {
+    int median_radius;                          // median pre-filter of the gray plane, 0 = none
+    const struct contrast_params *contrast;     // equalization after the median
+    const struct morph_params *cleanup;         // applied before anything is saved
+    const struct component_params *components;  // labeling sidecar for binary images
+    const struct encode_params *output;         // container of the saved images, NULL = plain PNG
+};
+
+// Binarizes one gray plane at every threshold of params->sweep, writing
+// output_path with a _t<threshold> (or _otsu) suffix for each. With parallel set the
+// variants are encoded as concurrent tasks.
+void otsu_sweep(const struct image_buffer *gray_image, const struct otsu_params *params,
+                const struct otsu_stages *stages, const char *output_path, int parallel);
+
+// Applies cleanup (may be NULL or MORPH_NONE) to a thresholded image in place:
+// binary morphology when classes <= 2, grayscale on multi-level label images
+void clean_thresholded_image(struct image_buffer *image, int classes, const struct morph_params *cleanup,
+                             int parallel);
+
+// Pre-stages on the gray plane, in place: median, then contrast normalization
+void otsu_prefilter(struct image_buffer *gray_image, const struct otsu_stages *stages, int parallel);
+
+// Cleans a thresholded image, then writes the component sidecar of a binary
+// image and the PNG itself unless stages skip it
+void save_thresholded_image(struct image_buffer *image, int classes, const char *output_path,
+                            const struct otsu_stages *stages, int parallel);
+
+// Binary counterpart on a packed mask: cleanup and labeling run on the bits,
+// and the image is written as a 1-bit PNG
+void save_binary_mask(struct bitmask *mask, const char *output_path, const struct otsu_stages *stages,
+                      int parallel);
+
+// Turns a loaded image into its gray plane, which takes a 1-channel image over
+// and converts any other to luma (convert_channels: channel 0 of gray+alpha,
+// the 77/150/29 weights of RGB(A)) into a new aligned plane; img is released
+// either way. Returns -1 when the plane cannot be allocated.
+int otsu_gray_plane(struct image_buffer *img, struct image_buffer *gray_img, int parallel);
+
+// The whole pipeline on one loaded image: gray plane, prefilter, then a sweep,
+// a multi-level label image or a 1-bit mask written to output_path (whose
+// directories must exist). Releases img.
+void otsu_image(struct image_buffer *img, const char *output_path, const struct otsu_params *params,
+                const struct otsu_stages *stages, int parallel);
+
+// otsu_image into output_folder/serial_otsu<filename> (or omp_otsu); both release img
+void otsu_serial(struct image_buffer *img, const char *filename, const struct otsu_params *params,
+                 const struct otsu_stages *stages);
+
+void otsu_omp(struct image_buffer *img, const char *filename, const struct otsu_params *params,
+              const struct otsu_stages *stages);
 
 #endif
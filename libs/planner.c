@@ -0,0 +1,134 @@
+#include "planner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "decode.h"
+#include "png_decode.h"
+#include "utility.h"
+
+// Fixed cost of opening, decoding headers and writing one output file
+#define PER_FILE_SECONDS 0.0005
+
+// Rough single-thread cost per pixel of decode + kernel + PNG encode,
+// measured on the project test images
+static const struct {
+    const char *algorithm;
+    double ns_per_pixel;
+} algorithm_costs[] = {
+    { "grayscale", 120.0 },
+    { "sobel",     120.0 },
+    { "negative",  130.0 },
+    { "otsu",       35.0 },
+    { "adaptive",   60.0 },
+    { "blur",      140.0 },
+    { "canny",     180.0 },
+    { "morph",      60.0 },
+    { "median",     70.0 },
+    { "equalize",   25.0 },
+    { "hough",     150.0 },
+    { "convert",   100.0 },
+};
+
+#define DEFAULT_NS_PER_PIXEL 120.0
+
+double estimate_image_cost(const char *algorithm, int width, int height, int channels) {
+    double ns_per_pixel = DEFAULT_NS_PER_PIXEL;
+    for (size_t i = 0; i < sizeof(algorithm_costs) / sizeof(algorithm_costs[0]); i++) {
+        if (!strcmp(algorithm, algorithm_costs[i].algorithm)) {
+            ns_per_pixel = algorithm_costs[i].ns_per_pixel;
+            break;
+        }
+    }
+    // Grayscale inputs skip most of the colour work
+    if (channels == 1) ns_per_pixel *= 0.6;
+    return PER_FILE_SECONDS + (double)width * (double)height * ns_per_pixel * 1e-9;
+}
+
+static int compare_cost_desc(const void *a, const void *b) {
+    const struct planned_file *fa = a;
+    const struct planned_file *fb = b;
+    if (fa->cost < fb->cost) return 1;
+    if (fa->cost > fb->cost) return -1;
+    return strcmp(fa->name, fb->name);
+}
+
+struct schedule_plan *plan_schedule(const char *folder, char **names, int count,
+                                    const char *algorithm, const struct decode_params *decode, int workers) {
+    if (workers < 1) workers = 1;
+
+    struct schedule_plan *plan = (struct schedule_plan *)calloc(1, sizeof(struct schedule_plan));
+    if (plan != NULL) {
+        plan->files = (struct planned_file *)malloc((count > 0 ? count : 1) * sizeof(struct planned_file));
+        plan->loads = (double *)calloc(workers, sizeof(double));
+    }
+    if (plan == NULL || plan->files == NULL || plan->loads == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        free_schedule_plan(plan);
+        return NULL;
+    }
+    plan->count = count;
+    plan->workers = workers;
+    plan->makespan = 0.0;
+
+    // Header probing is I/O bound, so overlap the opens
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int i = 0; i < count; i++) {
+        struct planned_file *file = &plan->files[i];
+        char path[OUTPUT_PATH_MAX];
+        // A path that does not fit is planned as unreadable; the executor skips and reports it
+        int fits = snprintf(path, sizeof(path), "%s/%s", folder, names[i]) < (int)sizeof(path);
+
+        file->name = names[i];
+        file->worker = 0;
+        int known = fits && (is_raw_file(names[i]) ? raw_image_info(path, &file->width, &file->height, &file->channels)
+                                                   : stbi_info(path, &file->width, &file->height, &file->channels));
+        if (!known) {
+            file->width = file->height = 0;
+            file->channels = 0;
+        }
+        if (is_jpeg_file(names[i])) {
+            // JPEGs are decoded at the reduced size
+            int denom = decode->jpeg_scale_denom;
+            file->width = (file->width + denom - 1) / denom;
+            file->height = (file->height + denom - 1) / denom;
+        }
+        // cropped to --roi,
+        region_size(&decode->region, file->width, file->height, &file->width, &file->height);
+        // and the kernels then see the --scale output
+        resize_output_size(&decode->resize, file->width, file->height, &file->width, &file->height);
+        // Luma-only decodes skip the colour work
+        if (algorithm_uses_luma(algorithm) && (is_jpeg_file(names[i]) || is_png_file(names[i]))) {
+            file->channels = 1;
+        }
+        file->cost = estimate_image_cost(algorithm, file->width, file->height, file->channels);
+    }
+
+    // Longest processing time first: hand the next largest file to the least loaded worker
+    qsort(plan->files, count, sizeof(struct planned_file), compare_cost_desc);
+    for (int i = 0; i < count; i++) {
+        int best = 0;
+        for (int w = 1; w < workers; w++) {
+            if (plan->loads[w] < plan->loads[best]) best = w;
+        }
+        plan->files[i].worker = best;
+        plan->loads[best] += plan->files[i].cost;
+    }
+    for (int w = 0; w < workers; w++) {
+        if (plan->loads[w] > plan->makespan) plan->makespan = plan->loads[w];
+    }
+
+    return plan;
+}
+
+void free_schedule_plan(struct schedule_plan *plan) {
+    if (plan == NULL) return;
+    free(plan->files);
+    free(plan->loads);
+    free(plan);
+}
+
+void print_makespan(const char *label, const struct schedule_plan *plan, double actual) {
+    printf("%s makespan: predicted %lf s over %d workers, actual %lf s\n",
+           label, plan->makespan, plan->workers, actual);
+}
@@ -0,0 +1,43 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include "image.h"
+#include "decode.h"
+#include <stddef.h>
+
+// One input file together with its probed size and predicted cost
+struct planned_file {
+    char *name;        // file name relative to the input folder (owned by the caller)
+    int width;
+    int height;
+    int channels;
+    double cost;       // predicted single-thread processing time in seconds
+    int worker;        // worker (thread or rank) the file is assigned to
+};
+
+struct schedule_plan {
+    struct planned_file *files;  // sorted by decreasing cost
+    int count;
+    int workers;
+    double *loads;               // predicted busy time per worker
+    double makespan;             // predicted time of the busiest worker
+};
+
+// Predicted single-thread time in seconds to run algorithm on a width x height image
+double estimate_image_cost(const char *algorithm, int width, int height, int channels);
+
+// Reads only the image headers (stbi_info) of names inside folder, estimates the
+// per-file cost and builds a longest-processing-time-first schedule over workers.
+// Files whose header cannot be read are kept with a zero size so they still get
+// processed (and reported) by the executor. Sizes are the ones the kernels will
+// see once decode (JPEG scale, region, resize) has been applied. Returns NULL
+// if the plan cannot be allocated.
+struct schedule_plan *plan_schedule(const char *folder, char **names, int count,
+                                    const char *algorithm, const struct decode_params *decode, int workers);
+
+void free_schedule_plan(struct schedule_plan *plan);
+
+// Prints the predicted makespan next to the measured one
+void print_makespan(const char *label, const struct schedule_plan *plan, double actual);
+
+#endif
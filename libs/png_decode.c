@@ -0,0 +1,587 @@
+#include "png_decode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+#include "decode.h"
+#include "tasks.h"
+
+#define PNG_COLOR_GRAY 0
+#define PNG_COLOR_RGB 2
+#define PNG_COLOR_PALETTE 3
+#define PNG_COLOR_GRAY_ALPHA 4
+#define PNG_COLOR_RGBA 6
+
+// Streaming state of one PNG file: the current IDAT chunk is read into
+// chunk_data and handed to inflate piece by piece
+struct png_stream {
+    FILE *file;
+    unsigned char *chunk_data;
+    unsigned int chunk_capacity;
+    int finished;       // IEND seen or read error
+    z_stream zs;
+};
+
+int is_png_file(const char *path) {
+    const char *ext = strrchr(path, '.');
+    return ext && strcasecmp(ext, ".png") == 0;
+}
+
+static unsigned int read_be32(const unsigned char *p) {
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+static unsigned char luma_of(int r, int g, int b) {
+    return (unsigned char)((r * 77 + g * 150 + b * 29) >> 8);
+}
+
+// Reads the next chunk header; returns 0 at end of file
+static int read_chunk_header(FILE *file, unsigned int *length, char type[5]) {
+    unsigned char header[8];
+    if (fread(header, 1, 8, file) != 8) return 0;
+    *length = read_be32(header);
+    memcpy(type, header + 4, 4);
+    type[4] = '\0';
+    return 1;
+}
+
+// Loads the next IDAT chunk into the inflate input; returns 0 when there is none
+static int next_idat(struct png_stream *stream) {
+    while (!stream->finished) {
+        unsigned int length;
+        char type[5];
+        if (!read_chunk_header(stream->file, &length, type) || !strcmp(type, "IEND")) {
+            stream->finished = 1;
+            break;
+        }
+        if (strcmp(type, "IDAT") != 0) {
+            fseek(stream->file, (long)length + 4, SEEK_CUR); // skip data and CRC
+            continue;
+        }
+        if (length > stream->chunk_capacity) {
+            free(stream->chunk_data);
+            stream->chunk_data = (unsigned char *)malloc(length);
+            stream->chunk_capacity = stream->chunk_data != NULL ? length : 0;
+            if (stream->chunk_data == NULL) {
+                stream->finished = 1;
+                break;
+            }
+        }
+        if (fread(stream->chunk_data, 1, length, stream->file) != length) {
+            stream->finished = 1;
+            break;
+        }
+        fseek(stream->file, 4, SEEK_CUR); // CRC
+        if (length == 0) continue;
+        stream->zs.next_in = stream->chunk_data;
+        stream->zs.avail_in = length;
+        return 1;
+    }
+    return 0;
+}
+
+// Inflates exactly size bytes (one filtered scanline) into row
+static int inflate_row(struct png_stream *stream, unsigned char *row, size_t size) {
+    stream->zs.next_out = row;
+    stream->zs.avail_out = (uInt)size;
+    while (stream->zs.avail_out > 0) {
+        if (stream->zs.avail_in == 0 && !next_idat(stream)) return 0;
+        int ret = inflate(&stream->zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) return stream->zs.avail_out == 0;
+        if (ret != Z_OK && ret != Z_BUF_ERROR) return 0;
+    }
+    return 1;
+}
+
+// The Paeth predictor rearranged, as in stb_image, into comparisons that
+// compile to conditional moves instead of branches on every byte
+static unsigned char paeth(int a, int b, int c) {
+    int threshold = c * 3 - (a + b);
+    int lo = a < b ? a : b;
+    int hi = a < b ? b : a;
+    int t0 = hi <= threshold ? lo : c;
+    return (unsigned char)(threshold <= lo ? hi : t0);
+}
+
+// Reverses the PNG filter of in into row, which may be in itself; prev is the
+// previous unfiltered row (zeros for the first)
+static int unfilter_row(unsigned char filter, const unsigned char *in, unsigned char *row,
+                        const unsigned char *prev, size_t stride, int bpp) {
+    switch (filter) {
+    case 0:
+        if (row != in) memcpy(row, in, stride);
+        break;
+    case 1:
+        for (size_t i = 0; i < (size_t)bpp; i++) row[i] = in[i];
+        for (size_t i = bpp; i < stride; i++) row[i] = in[i] + row[i - bpp];
+        break;
+    case 2:
+        for (size_t i = 0; i < stride; i++) row[i] = in[i] + prev[i];
+        break;
+    case 3:
+        for (size_t i = 0; i < (size_t)bpp; i++) row[i] = in[i] + (prev[i] >> 1);
+        for (size_t i = bpp; i < stride; i++) row[i] = in[i] + ((row[i - bpp] + prev[i]) >> 1);
+        break;
+    case 4:
+        for (size_t i = 0; i < (size_t)bpp; i++) row[i] = in[i] + prev[i];
+        for (size_t i = bpp; i < stride; i++) row[i] = in[i] + paeth(row[i - bpp], prev[i], prev[i - bpp]);
+        break;
+    default:
+        return 0;
+    }
+    return 1;
+}
+
+// Converts one unfiltered scanline to luma. sample is 1 or 2 bytes; 16-bit
+// images end up with the most significant byte, as in stb_image
+static void row_to_luma(const unsigned char *row, unsigned char *luma, int width, int color_type,
+                        int sample, const unsigned char *palette_luma) {
+    switch (color_type) {
+    case PNG_COLOR_GRAY:
+    case PNG_COLOR_GRAY_ALPHA: {
+        int step = sample * (color_type == PNG_COLOR_GRAY ? 1 : 2);
+        for (int x = 0; x < width; x++) luma[x] = row[x * step];
+        break;
+    }
+    case PNG_COLOR_RGB:
+    case PNG_COLOR_RGBA: {
+        int step = sample * (color_type == PNG_COLOR_RGB ? 3 : 4);
+        if (sample == 1) {
+            for (int x = 0; x < width; x++) {
+                const unsigned char *p = row + (size_t)x * step;
+                luma[x] = luma_of(p[0], p[1], p[2]);
+            }
+        } else {
+            // stbi_load weights the full 16-bit samples (stbi__compute_y_16)
+            // and only then keeps the high byte (stbi__convert_16_to_8), so
+            // luma_of on the high bytes alone can come out one lower
+            for (int x = 0; x < width; x++) {
+                const unsigned char *p = row + (size_t)x * step;
+                int r = (p[0] << 8) | p[1];
+                int g = (p[2] << 8) | p[3];
+                int b = (p[4] << 8) | p[5];
+                luma[x] = (unsigned char)(((r * 77 + g * 150 + b * 29) >> 8) >> 8);
+            }
+        }
+        break;
+    }
+    case PNG_COLOR_PALETTE:
+        for (int x = 0; x < width; x++) luma[x] = palette_luma[row[x]];
+        break;
+    }
+}
+
+unsigned char *load_png_luma(const char *path, int *width, int *height) {
+    static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+
+    unsigned char header[8 + 8 + 13];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, signature, 8) != 0 || memcmp(header + 12, "IHDR", 4) != 0) {
+        fclose(file);
+        return NULL;
+    }
+    fseek(file, 4, SEEK_CUR); // IHDR CRC
+
+    const unsigned char *ihdr = header + 16;
+    int w = (int)read_be32(ihdr);
+    int h = (int)read_be32(ihdr + 4);
+    int depth = ihdr[8];
+    int color_type = ihdr[9];
+    int interlace = ihdr[12];
+    int channels_per_type[7] = { 1, 0, 3, 1, 2, 0, 4 };
+    if (w <= 0 || h <= 0 || interlace != 0 || color_type > 6 || channels_per_type[color_type] == 0 ||
+        (depth != 8 && depth != 16) || (color_type == PNG_COLOR_PALETTE && depth != 8)) {
+        fclose(file);
+        return NULL;
+    }
+
+    int sample = depth / 8;
+    int bpp = channels_per_type[color_type] * sample;
+    size_t stride = (size_t)w * bpp;
+
+    struct png_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.file = file;
+
+    // Ancillary chunks before the first IDAT: only PLTE matters here
+    unsigned char palette_luma[256] = { 0 };
+    for (;;) {
+        unsigned int length;
+        char type[5];
+        long chunk_start = ftell(file);
+        if (!read_chunk_header(file, &length, type) || !strcmp(type, "IEND")) {
+            fclose(file);
+            return NULL;
+        }
+        if (!strcmp(type, "IDAT")) {
+            fseek(file, chunk_start, SEEK_SET); // let next_idat consume it
+            break;
+        }
+        if (!strcmp(type, "PLTE") && length <= 768) {
+            unsigned char palette[768];
+            if (fread(palette, 1, length, file) != length) {
+                fclose(file);
+                return NULL;
+            }
+            for (unsigned int i = 0; i < length / 3; i++) {
+                palette_luma[i] = luma_of(palette[3 * i], palette[3 * i + 1], palette[3 * i + 2]);
+            }
+            fseek(file, 4, SEEK_CUR);
+        } else {
+            fseek(file, (long)length + 4, SEEK_CUR);
+        }
+    }
+
+    unsigned char *luma = (unsigned char *)malloc((size_t)w * h);
+    // Two scanlines (filter byte + data) are all the colour data ever held
+    unsigned char *rows = (unsigned char *)calloc(2, stride + 1);
+    if (luma == NULL || rows == NULL || inflateInit(&stream.zs) != Z_OK) {
+        free(luma);
+        free(rows);
+        fclose(file);
+        return NULL;
+    }
+
+    unsigned char *current = rows;
+    unsigned char *previous = rows + stride + 1;
+    int ok = 1;
+    for (int y = 0; y < h && ok; y++) {
+        ok = inflate_row(&stream, current, stride + 1) &&
+             unfilter_row(current[0], current + 1, current + 1, previous + 1, stride, bpp);
+        if (ok) {
+            row_to_luma(current + 1, luma + (size_t)y * w, w, color_type, sample, palette_luma);
+            unsigned char *swap = current;
+            current = previous;
+            previous = swap;
+        }
+    }
+
+    inflateEnd(&stream.zs);
+    free(stream.chunk_data);
+    free(rows);
+    fclose(file);
+
+    if (!ok) {
+        free(luma);
+        return NULL;
+    }
+    *width = w;
+    *height = h;
+    return luma;
+}
+
+// The whole file in memory, with the IDAT payloads in order
+struct png_file {
+    unsigned char *data;
+    int width;
+    int height;
+    int color_type;
+    int channels;
+    size_t stride;              // bytes of one unfiltered scanline
+    const unsigned char **idat;
+    unsigned int *idat_length;
+    int idat_count;
+    int piece_rows;             // rows per independent IDAT piece (dpIX), 0 without one
+};
+
+static void free_png_file(struct png_file *png) {
+    free(png->data);
+    free(png->idat);
+    free(png->idat_length);
+}
+
+// Reads and indexes a file load_png handles: 8-bit, non-interlaced, no
+// palette and no tRNS, which stb_image would turn into an alpha channel
+static int read_png_file(const char *path, struct png_file *png) {
+    static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    static const int channels_per_type[7] = { 1, 0, 3, 0, 2, 0, 4 };
+    memset(png, 0, sizeof(*png));
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return -1;
+    long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (size < 8 + 25 || fseek(file, 0, SEEK_SET) != 0 || (png->data = malloc(size)) == NULL ||
+        fread(png->data, 1, size, file) != (size_t)size) {
+        fclose(file);
+        free(png->data);
+        png->data = NULL;
+        return -1;
+    }
+    fclose(file);
+
+    const unsigned char *ihdr = png->data + 16;
+    if (memcmp(png->data, signature, 8) != 0 || memcmp(png->data + 12, "IHDR", 4) != 0) goto unsupported;
+    png->width = (int)read_be32(ihdr);
+    png->height = (int)read_be32(ihdr + 4);
+    png->color_type = ihdr[9];
+    if (png->width <= 0 || png->height <= 0 || ihdr[8] != 8 || ihdr[12] != 0 || png->color_type > 6 ||
+        channels_per_type[png->color_type] == 0) {
+        goto unsupported;
+    }
+    png->channels = channels_per_type[png->color_type];
+    png->stride = (size_t)png->width * png->channels;
+
+    for (size_t offset = 8; offset + 12 <= (size_t)size;) {
+        unsigned int length = read_be32(png->data + offset);
+        const unsigned char *type = png->data + offset + 4;
+        const unsigned char *body = png->data + offset + 8;
+        if (length > (size_t)size - offset - 12) goto unsupported;
+        if (!memcmp(type, "IEND", 4)) break;
+        if (!memcmp(type, "tRNS", 4)) goto unsupported;
+        if (!memcmp(type, "dpIX", 4) && length == 4) png->piece_rows = (int)read_be32(body);
+        if (!memcmp(type, "IDAT", 4) && length > 0) {
+            if ((png->idat_count & (png->idat_count - 1)) == 0) {
+                // Grow at every power of two
+                int capacity = png->idat_count ? 2 * png->idat_count : 1;
+                const unsigned char **idat = realloc(png->idat, capacity * sizeof(*idat));
+                if (idat != NULL) png->idat = idat;
+                unsigned int *idat_length = realloc(png->idat_length, capacity * sizeof(*idat_length));
+                if (idat_length != NULL) png->idat_length = idat_length;
+                if (idat == NULL || idat_length == NULL) goto unsupported;
+            }
+            png->idat[png->idat_count] = body;
+            png->idat_length[png->idat_count++] = length;
+        }
+        offset += (size_t)length + 12;
+    }
+    if (png->idat_count > 0) return 0;
+
+unsupported:
+    free_png_file(png);
+    return -1;
+}
+
+// The filtered rows only live for one stage or piece: each one is inflated
+// into a buffer of its own that is freed as soon as its rows are unfiltered
+struct png_decode_ctx {
+    const struct png_file *png;
+    unsigned char **stage_buffers;      // per stage, (stride + 1) bytes per row
+    unsigned char *last_row;            // last unfiltered row of the previous stage
+    const unsigned char *zeros;         // the row above the first one
+    unsigned char *pixels;
+    int out_channels;
+    int stage_rows;
+    z_stream zs;                        // sequential inflate of the whole stream
+    int next_idat;
+    int bad_filter;                     // set by concurrent pieces, hence atomic writes
+    uLong *adlers;                      // per piece
+};
+
+static void set_bad_filter(struct png_decode_ctx *ctx) {
+    #pragma omp atomic write
+    ctx->bad_filter = 1;
+}
+
+// Unfilters rows [row_begin, row_end) of filtered, the first against prev,
+// into the output: straight into it when the channels match, otherwise in
+// place and then converted. Returns the last unfiltered row, NULL on a bad
+// filter type.
+static const unsigned char *finish_rows(struct png_decode_ctx *ctx, unsigned char *filtered, int row_begin,
+                                        int row_end, const unsigned char *prev) {
+    const struct png_file *png = ctx->png;
+    size_t line = png->stride + 1;
+    size_t out_row = (size_t)png->width * ctx->out_channels;
+    int direct = ctx->out_channels == png->channels;
+    for (int y = row_begin; y < row_end; y++) {
+        unsigned char *in = filtered + (size_t)(y - row_begin) * line;
+        unsigned char *out = ctx->pixels + (size_t)y * out_row;
+        unsigned char *row = direct ? out : in + 1;
+        if (!unfilter_row(in[0], in + 1, row, prev, png->stride, png->channels)) {
+            set_bad_filter(ctx);
+            return NULL;
+        }
+        if (!direct) convert_channels(row, png->channels, out, ctx->out_channels, png->width);
+        prev = row;
+    }
+    return prev;
+}
+
+static int stage_end(const struct png_decode_ctx *ctx, int stage) {
+    int end = (stage + 1) * ctx->stage_rows;
+    return end < ctx->png->height ? end : ctx->png->height;
+}
+
+// Producer: inflates the next stage's rows from the IDAT chunks in order
+static int inflate_stage(void *arg, int stage) {
+    struct png_decode_ctx *ctx = arg;
+    size_t size = (size_t)(stage_end(ctx, stage) - stage * ctx->stage_rows) * (ctx->png->stride + 1);
+    unsigned char *filtered = malloc(size);
+    if (filtered == NULL) return -1;
+    ctx->zs.next_out = filtered;
+    ctx->zs.avail_out = (uInt)size;
+    int status = 0;
+    while (status == 0 && ctx->zs.avail_out > 0) {
+        if (ctx->zs.avail_in == 0) {
+            if (ctx->next_idat == ctx->png->idat_count) {
+                status = -1;
+                break;
+            }
+            ctx->zs.next_in = (Bytef *)ctx->png->idat[ctx->next_idat];
+            ctx->zs.avail_in = ctx->png->idat_length[ctx->next_idat++];
+        }
+        int ret = inflate(&ctx->zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) status = ctx->zs.avail_out == 0 ? 0 : -1;
+        else if (ret != Z_OK && ret != Z_BUF_ERROR) status = -1;
+    }
+    if (status != 0) {
+        free(filtered);
+        return -1;
+    }
+    ctx->stage_buffers[stage] = filtered;
+    return 0;
+}
+
+// Consumer: the stages arrive in order, so the row above is already
+// unfiltered, in the output or in last_row
+static void finish_stage(void *arg, int stage) {
+    struct png_decode_ctx *ctx = arg;
+    unsigned char *filtered = ctx->stage_buffers[stage];
+    int row_begin = stage * ctx->stage_rows;
+    const unsigned char *prev = row_begin > 0 ? ctx->last_row : ctx->zeros;
+    if (row_begin > 0 && ctx->out_channels == ctx->png->channels) {
+        prev = ctx->pixels + (size_t)(row_begin - 1) * ctx->png->stride;
+    }
+    const unsigned char *last = ctx->bad_filter ? NULL :
+                                finish_rows(ctx, filtered, row_begin, stage_end(ctx, stage), prev);
+    if (last != NULL && ctx->out_channels != ctx->png->channels) {
+        // The in-place rows go away with the buffer
+        memcpy(ctx->last_row, last, ctx->png->stride);
+    }
+    ctx->stage_buffers[stage] = NULL;
+    free(filtered);
+}
+
+// Inflates the one zlib stream in order while earlier rows are unfiltered
+// and converted as tasks behind it
+static int decode_pipelined(struct png_decode_ctx *ctx, int parallel) {
+    ctx->stage_rows = default_tile_rows((long)ctx->png->stride);
+    int stages = (ctx->png->height + ctx->stage_rows - 1) / ctx->stage_rows;
+    ctx->stage_buffers = calloc(stages, sizeof(*ctx->stage_buffers));
+    ctx->last_row = malloc(ctx->png->stride);
+    memset(&ctx->zs, 0, sizeof(ctx->zs));
+    if (ctx->stage_buffers == NULL || ctx->last_row == NULL || inflateInit(&ctx->zs) != Z_OK) {
+        free(ctx->stage_buffers);
+        free(ctx->last_row);
+        return -1;
+    }
+    ctx->next_idat = 0;
+    ctx->bad_filter = 0;
+    int produced = 0;
+    if (parallel) {
+        produced = pipeline_stages(stages, inflate_stage, finish_stage, ctx);
+    } else {
+        for (; produced < stages && inflate_stage(ctx, produced) == 0; produced++) finish_stage(ctx, produced);
+    }
+    inflateEnd(&ctx->zs);
+    free(ctx->stage_buffers);
+    free(ctx->last_row);
+    return produced == stages && !ctx->bad_filter ? 0 : -1;
+}
+
+// One dpIX piece: a raw deflate stream of its own rows, whose first row does
+// not look at the row above
+static void piece_tile(void *arg, int begin, int end) {
+    struct png_decode_ctx *ctx = arg;
+    const struct png_file *png = ctx->png;
+    size_t line = png->stride + 1;
+    for (int i = begin; i < end; i++) {
+        int row_begin = i * ctx->stage_rows;
+        size_t out_size = (size_t)(stage_end(ctx, i) - row_begin) * line;
+        unsigned char *out = malloc(out_size);
+        if (out == NULL) {
+            set_bad_filter(ctx);
+            continue;
+        }
+        const unsigned char *in = png->idat[i];
+        size_t in_size = png->idat_length[i];
+        if (i == 0) {
+            in += 2;        // zlib header
+            in_size -= 2;
+        }
+        if (i == png->idat_count - 1) in_size -= 4;     // Adler-32 of the stream
+
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        int ok = inflateInit2(&zs, -15) == Z_OK;
+        if (ok) {
+            zs.next_in = (Bytef *)in;
+            zs.avail_in = (uInt)in_size;
+            zs.next_out = out;
+            zs.avail_out = (uInt)out_size;
+            int ret = inflate(&zs, Z_SYNC_FLUSH);
+            ok = zs.avail_out == 0 && (ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR);
+            inflateEnd(&zs);
+        }
+        if (!ok || (i > 0 && out[0] > 1)) {
+            set_bad_filter(ctx);
+        } else {
+            ctx->adlers[i] = adler32(adler32(0L, Z_NULL, 0), out, out_size);
+            finish_rows(ctx, out, row_begin, stage_end(ctx, i), ctx->zeros);
+        }
+        free(out);
+    }
+}
+
+// Files from encode.c: every IDAT piece is inflated, unfiltered and converted
+// on its own, and the stream's Adler-32 is checked from the pieces' ones
+static int decode_pieces(struct png_decode_ctx *ctx, int parallel) {
+    const struct png_file *png = ctx->png;
+    ctx->stage_rows = png->piece_rows;
+    if (ctx->stage_rows <= 0 || (png->height + ctx->stage_rows - 1) / ctx->stage_rows != png->idat_count ||
+        png->idat_length[0] < 2 || png->idat_length[png->idat_count - 1] < (png->idat_count == 1 ? 6 : 4) ||
+        (png->idat[0][0] & 0x0F) != 8 || (png->idat[0][1] & 0x20)) {    // deflate, no preset dictionary
+        return -1;
+    }
+    ctx->adlers = malloc(png->idat_count * sizeof(uLong));
+    if (ctx->adlers == NULL) return -1;
+    ctx->bad_filter = 0;
+    if (parallel) parallel_tiles(png->idat_count, 1, piece_tile, ctx);
+    else piece_tile(ctx, 0, png->idat_count);
+
+    int status = ctx->bad_filter ? -1 : 0;
+    if (status == 0) {
+        size_t line = png->stride + 1;
+        uLong adler = adler32(0L, Z_NULL, 0);
+        for (int i = 0; i < png->idat_count; i++) {
+            size_t rows = (size_t)(stage_end(ctx, i) - i * ctx->stage_rows);
+            adler = adler32_combine(adler, ctx->adlers[i], (z_off_t)(rows * line));
+        }
+        const unsigned char *last = png->idat[png->idat_count - 1] + png->idat_length[png->idat_count - 1] - 4;
+        if (adler != read_be32(last)) status = -1;
+    }
+    free(ctx->adlers);
+    return status;
+}
+
+unsigned char *load_png(const char *path, int *width, int *height, int *channels, int desired_channels,
+                        int parallel) {
+    struct png_file png;
+    if (read_png_file(path, &png) != 0) return NULL;
+
+    struct png_decode_ctx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.png = &png;
+    ctx.out_channels = desired_channels ? desired_channels : png.channels;
+    ctx.zeros = calloc(png.stride, 1);
+    ctx.pixels = malloc((size_t)png.width * png.height * ctx.out_channels);
+    int status = -1;
+    if (ctx.zeros != NULL && ctx.pixels != NULL) {
+        // A dpIX the pieces do not live up to falls back to the in-order inflate
+        status = png.piece_rows > 0 ? decode_pieces(&ctx, parallel) : -1;
+        if (status != 0) status = decode_pipelined(&ctx, parallel);
+    }
+    free((void *)ctx.zeros);
+    free_png_file(&png);
+    if (status != 0) {
+        free(ctx.pixels);
+        return NULL;
+    }
+    *width = png.width;
+    *height = png.height;
+    *channels = ctx.out_channels;
+    return ctx.pixels;
+}
@@ -0,0 +1,25 @@
+#ifndef PNG_DECODE_H
+#define PNG_DECODE_H
+
+// Decodes a non-interlaced PNG straight to its luma plane. The IDAT stream
+// is inflated one scanline at a time, unfiltered against the previous row and
+// converted to luma right away, so no RGB(A) frame is ever allocated.
+// Luma uses the same integer weights as stb_image ((77 R + 150 G + 29 B) >> 8).
+// Returns NULL for files this path does not handle (interlaced, bit depth
+// below 8, corrupt); callers then fall back to stb_image.
+unsigned char *load_png_luma(const char *path, int *width, int *height);
+
+// Decodes a non-interlaced 8-bit PNG without palette or tRNS to
+// desired_channels (0 keeps the file's), converting like stb_image. The
+// zlib stream is inflated in order on the calling thread while the rows
+// already inflated are unfiltered and converted as tasks behind it when
+// parallel is set. Files written by encode.c carry a dpIX chunk marking
+// their IDAT chunks as independent pieces, which are then decoded entirely
+// in parallel. Returns NULL for anything else, like load_png_luma.
+unsigned char *load_png(const char *path, int *width, int *height, int *channels, int desired_channels,
+                        int parallel);
+
+// Returns 1 if path has a .png extension
+int is_png_file(const char *path);
+
+#endif
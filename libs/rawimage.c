@@ -0,0 +1,549 @@
+#include "rawimage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tasks.h"
+
+#define RAW_MAGIC "RAWI"
+#define RAW_VERSION 1
+#define RAW_FLAG_LZ 1
+#define RAW_FLAG_TILED 2
+
+// Uncompressed bytes per block: small enough for one block to stay in L2
+// while it is compressed, and enough blocks per image to spread over threads
+#define RAW_BLOCK_BYTES (256 * 1024)
+
+// LZ4 block format: a token with 4-bit literal and match lengths (15 meaning
+// more length bytes follow), the literals, a 16-bit offset. The last literals
+// of a block never start a match.
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+
+int is_raw_file(const char *path) {
+    const char *ext = strrchr(path, '.');
+    return ext && strcasecmp(ext, ".raw") == 0;
+}
+
+static void put_le32(unsigned char *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static void put_le64(unsigned char *p, uint64_t value) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_le64(const unsigned char *p) {
+    return (uint64_t)get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+}
+
+static size_t aligned_stride(int width, int channels) {
+    size_t row_bytes = (size_t)width * channels;
+    return (row_bytes + RAW_IMAGE_ALIGNMENT - 1) / RAW_IMAGE_ALIGNMENT * RAW_IMAGE_ALIGNMENT;
+}
+
+struct raw_header {
+    int flags;
+    int width;
+    int height;
+    int channels;
+    size_t stride;
+    int block_rows;         // rows per compressed block or tile
+    int tile_width;         // RAW_FLAG_TILED only
+    uint64_t data_size;     // bytes after the header
+};
+
+// Header layout: magic, u16 version, u16 flags, u32 width, height, channels,
+// stride, alignment, block_rows, u64 data_size, u32 tile_width, zero padding
+// to 64 bytes
+static void encode_header(unsigned char *p, const struct raw_header *header) {
+    memset(p, 0, RAW_IMAGE_HEADER_SIZE);
+    memcpy(p, RAW_MAGIC, 4);
+    p[4] = RAW_VERSION;
+    p[6] = (unsigned char)header->flags;
+    put_le32(p + 8, (uint32_t)header->width);
+    put_le32(p + 12, (uint32_t)header->height);
+    put_le32(p + 16, (uint32_t)header->channels);
+    put_le32(p + 20, (uint32_t)header->stride);
+    put_le32(p + 24, RAW_IMAGE_ALIGNMENT);
+    put_le32(p + 28, (uint32_t)header->block_rows);
+    put_le64(p + 32, header->data_size);
+    put_le32(p + 40, (uint32_t)header->tile_width);
+}
+
+static int decode_header(const unsigned char *p, struct raw_header *header) {
+    if (memcmp(p, RAW_MAGIC, 4) != 0 || p[4] != RAW_VERSION || p[5] != 0) return -1;
+    uint32_t width = get_le32(p + 8), height = get_le32(p + 12), channels = get_le32(p + 16);
+    uint32_t stride = get_le32(p + 20), block_rows = get_le32(p + 28), tile_width = get_le32(p + 40);
+    if (width == 0 || width > INT32_MAX || height == 0 || height > INT32_MAX ||
+        channels < 1 || channels > 4 || get_le32(p + 24) != RAW_IMAGE_ALIGNMENT ||
+        stride != aligned_stride((int)width, (int)channels) || block_rows > INT32_MAX || tile_width > INT32_MAX) {
+        return -1;
+    }
+    header->flags = p[6] | p[7] << 8;
+    header->width = (int)width;
+    header->height = (int)height;
+    header->channels = (int)channels;
+    header->stride = stride;
+    header->block_rows = (int)block_rows;
+    header->tile_width = (int)tile_width;
+    header->data_size = get_le64(p + 32);
+    if ((header->flags & RAW_FLAG_LZ) && header->block_rows == 0) return -1;
+    if ((header->flags & RAW_FLAG_TILED) && (!(header->flags & RAW_FLAG_LZ) || header->tile_width == 0)) return -1;
+    return 0;
+}
+
+int raw_image_info(const char *path, int *width, int *height, int *channels) {
+    unsigned char bytes[RAW_IMAGE_HEADER_SIZE];
+    struct raw_header header;
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return 0;
+    int ok = fread(bytes, 1, sizeof(bytes), file) == sizeof(bytes) && decode_header(bytes, &header) == 0;
+    fclose(file);
+    if (!ok) return 0;
+    *width = header.width;
+    *height = header.height;
+    *channels = header.channels;
+    return 1;
+}
+
+static size_t lz_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static unsigned char *put_length(unsigned char *out, size_t length) {
+    for (; length >= 255; length -= 255) *out++ = 255;
+    *out++ = (unsigned char)length;
+    return out;
+}
+
+static unsigned char *put_sequence(unsigned char *out, const unsigned char *literals, size_t literal_count) {
+    unsigned char *token = out++;
+    *token = (unsigned char)((literal_count < 15 ? literal_count : 15) << 4);
+    if (literal_count >= 15) out = put_length(out, literal_count - 15);
+    memcpy(out, literals, literal_count);
+    return out + literal_count;
+}
+
+// Greedy single-probe compressor; returns the compressed size, at most
+// lz_bound(size). Runs of misses lengthen the step, so incompressible data
+// costs little more than a copy.
+static size_t lz_compress(const unsigned char *src, size_t size, unsigned char *dst) {
+    uint32_t table[1 << LZ_HASH_BITS] = { 0 };  // position + 1 of the last sequence with each hash
+    unsigned char *out = dst;
+    size_t anchor = 0, pos = 0;
+
+    if (size >= LZ_MIN_MATCH + LZ_LAST_LITERALS) {
+        size_t last_start = size - LZ_LAST_LITERALS - LZ_MIN_MATCH;
+        size_t match_limit = size - LZ_LAST_LITERALS;
+        unsigned misses = 0;
+        while (pos <= last_start) {
+            uint32_t sequence = read32(src + pos);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+            size_t candidate = table[hash];
+            table[hash] = (uint32_t)(pos + 1);
+            if (candidate == 0 || pos - (candidate - 1) > LZ_MAX_OFFSET || read32(src + candidate - 1) != sequence) {
+                pos += 1 + (misses++ >> 6);
+                continue;
+            }
+            candidate--;
+            misses = 0;
+
+            size_t length = LZ_MIN_MATCH;
+            while (pos + length < match_limit && src[candidate + length] == src[pos + length]) length++;
+
+            unsigned char *token = out;
+            out = put_sequence(out, src + anchor, pos - anchor);
+            size_t offset = pos - candidate;
+            *out++ = (unsigned char)offset;
+            *out++ = (unsigned char)(offset >> 8);
+            size_t extra = length - LZ_MIN_MATCH;
+            *token |= (unsigned char)(extra < 15 ? extra : 15);
+            if (extra >= 15) out = put_length(out, extra - 15);
+
+            pos += length;
+            anchor = pos;
+        }
+    }
+    out = put_sequence(out, src + anchor, size - anchor);
+    return (size_t)(out - dst);
+}
+
+static int read_length(const unsigned char *src, size_t size, size_t *pos, size_t *length) {
+    unsigned char byte;
+    do {
+        if (*pos >= size) return -1;
+        byte = src[(*pos)++];
+        *length += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+// Returns -1 unless src inflates to exactly out_size bytes
+static int lz_decompress(const unsigned char *src, size_t size, unsigned char *dst, size_t out_size) {
+    size_t pos = 0, out = 0;
+    while (pos < size) {
+        unsigned token = src[pos++];
+        size_t literals = token >> 4;
+        if (literals == 15 && read_length(src, size, &pos, &literals) != 0) return -1;
+        if (literals > size - pos || literals > out_size - out) return -1;
+        memcpy(dst + out, src + pos, literals);
+        pos += literals;
+        out += literals;
+        if (pos == size) break;     // the last sequence has no match
+
+        if (size - pos < 2) return -1;
+        size_t offset = src[pos] | (size_t)src[pos + 1] << 8;
+        pos += 2;
+        size_t length = token & 15;
+        if (length == 15 && read_length(src, size, &pos, &length) != 0) return -1;
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > out || length > out_size - out) return -1;
+
+        const unsigned char *match = dst + out - offset;
+        if (offset >= length) {
+            memcpy(dst + out, match, length);
+        } else {
+            // Overlapping match: repeats the last offset bytes
+            for (size_t i = 0; i < length; i++) dst[out + i] = match[i];
+        }
+        out += length;
+    }
+    return out == out_size ? 0 : -1;
+}
+
+// Compressed files are a grid of independently compressed chunks: full-width
+// blocks of block_rows rows, or tiles when RAW_FLAG_TILED is set
+struct chunk_grid {
+    int width;      // of a full chunk
+    int height;
+    int columns;
+    int rows;
+};
+
+static void get_chunk_grid(const struct raw_header *header, struct chunk_grid *grid) {
+    grid->width = (header->flags & RAW_FLAG_TILED) ? header->tile_width : header->width;
+    grid->height = header->block_rows;
+    grid->columns = (header->width + grid->width - 1) / grid->width;
+    grid->rows = (header->height + grid->height - 1) / grid->height;
+}
+
+// Blocks keep the padded rows of the container; tiles are stored packed
+static size_t chunk_stride(const struct raw_header *header, int chunk_width) {
+    return (header->flags & RAW_FLAG_TILED) ? (size_t)chunk_width * header->channels : header->stride;
+}
+
+// The offset table leads the payload: one u64 per chunk plus the end, rising within the payload
+static int check_offsets(const unsigned char *payload, const struct raw_header *header, size_t chunks) {
+    uint64_t table_size = 8 * ((uint64_t)chunks + 1);
+    if (table_size > header->data_size) return -1;
+    uint64_t previous = table_size;
+    for (size_t i = 0; i <= chunks; i++) {
+        uint64_t offset = get_le64(payload + 8 * i);
+        if (offset < previous || offset > header->data_size) return -1;
+        previous = offset;
+    }
+    return 0;
+}
+
+struct region_ctx {
+    const unsigned char *payload;
+    const struct raw_header *header;
+    struct chunk_grid grid;
+    int x, y, width, height;            // the region
+    int first_column, first_row, columns;   // chunks overlapping it
+    unsigned char *pixels;
+    size_t stride;                      // of pixels
+    int failed;
+};
+
+// Inflates the overlapping chunks [begin, end) and copies their part of the
+// region; chunks that exactly fill whole region rows are inflated in place
+static void region_chunk_tile(void *arg, int begin, int end) {
+    struct region_ctx *ctx = arg;
+    const struct raw_header *header = ctx->header;
+    const struct chunk_grid *grid = &ctx->grid;
+    int channels = header->channels;
+    unsigned char *scratch = NULL;
+
+    for (int k = begin; k < end; k++) {
+        int column = ctx->first_column + k % ctx->columns, row = ctx->first_row + k / ctx->columns;
+        int chunk_x = column * grid->width, chunk_y = row * grid->height;
+        int chunk_width = header->width - chunk_x < grid->width ? header->width - chunk_x : grid->width;
+        int chunk_height = header->height - chunk_y < grid->height ? header->height - chunk_y : grid->height;
+        size_t stored_stride = chunk_stride(header, chunk_width);
+        size_t index = (size_t)row * grid->columns + column;
+        uint64_t from = get_le64(ctx->payload + 8 * index), to = get_le64(ctx->payload + 8 * (index + 1));
+
+        int x0 = chunk_x > ctx->x ? chunk_x : ctx->x;
+        int x1 = chunk_x + chunk_width < ctx->x + ctx->width ? chunk_x + chunk_width : ctx->x + ctx->width;
+        int y0 = chunk_y > ctx->y ? chunk_y : ctx->y;
+        int y1 = chunk_y + chunk_height < ctx->y + ctx->height ? chunk_y + chunk_height : ctx->y + ctx->height;
+        int in_place = chunk_x == ctx->x && chunk_width == ctx->width && stored_stride == ctx->stride &&
+                       y0 == chunk_y && y1 == chunk_y + chunk_height;
+
+        unsigned char *target = ctx->pixels + (size_t)(chunk_y - ctx->y) * ctx->stride;
+        if (!in_place) {
+            if (scratch == NULL) scratch = malloc((size_t)grid->height * chunk_stride(header, grid->width));
+            if (scratch == NULL) {
+                ctx->failed = 1;
+                continue;
+            }
+            target = scratch;
+        }
+        if (lz_decompress(ctx->payload + from, (size_t)(to - from), target, (size_t)chunk_height * stored_stride) != 0) {
+            ctx->failed = 1;
+            continue;
+        }
+        if (in_place) continue;
+        for (int y = y0; y < y1; y++) {
+            memcpy(ctx->pixels + (size_t)(y - ctx->y) * ctx->stride + (size_t)(x0 - ctx->x) * channels,
+                   scratch + (size_t)(y - chunk_y) * stored_stride + (size_t)(x0 - chunk_x) * channels,
+                   (size_t)(x1 - x0) * channels);
+        }
+    }
+    free(scratch);
+}
+
+// Reads a region of a mapped file into a new aligned buffer, touching only
+// the rows or chunks it overlaps
+static int read_mapped_region(const unsigned char *bytes, const struct raw_header *header, int x, int y,
+                              int width, int height, struct raw_image *image, int parallel) {
+    const unsigned char *payload = bytes + RAW_IMAGE_HEADER_SIZE;
+    int channels = header->channels;
+    size_t stride = aligned_stride(width, channels);
+    unsigned char *pixels = aligned_alloc(RAW_IMAGE_ALIGNMENT, stride * height);
+    if (pixels == NULL) return -1;
+
+    int failed = 0;
+    if (!(header->flags & RAW_FLAG_LZ)) {
+        for (int row = 0; row < height; row++) {
+            memcpy(pixels + (size_t)row * stride, payload + (size_t)(y + row) * header->stride + (size_t)x * channels,
+                   (size_t)width * channels);
+        }
+    } else {
+        struct region_ctx ctx = { payload, header };
+        get_chunk_grid(header, &ctx.grid);
+        failed = check_offsets(payload, header, (size_t)ctx.grid.columns * ctx.grid.rows) != 0;
+        if (!failed) {
+            ctx.x = x;
+            ctx.y = y;
+            ctx.width = width;
+            ctx.height = height;
+            ctx.first_column = x / ctx.grid.width;
+            ctx.first_row = y / ctx.grid.height;
+            ctx.columns = (x + width - 1) / ctx.grid.width - ctx.first_column + 1;
+            int chunks = ctx.columns * ((y + height - 1) / ctx.grid.height - ctx.first_row + 1);
+            ctx.pixels = pixels;
+            ctx.stride = stride;
+            if (parallel) parallel_tiles(chunks, 1, region_chunk_tile, &ctx);
+            else region_chunk_tile(&ctx, 0, chunks);
+            failed = ctx.failed;
+        }
+    }
+    if (failed) {
+        free(pixels);
+        return -1;
+    }
+    image->pixels = pixels;
+    image->width = width;
+    image->height = height;
+    image->channels = channels;
+    image->stride = stride;
+    image->map = NULL;
+    image->map_size = 0;
+    return 0;
+}
+
+// Maps path privately and writably, so kernels that work in place get
+// copy-on-write pages
+static int map_raw_file(const char *path, void **map, size_t *map_size, struct raw_header *header) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < RAW_IMAGE_HEADER_SIZE) {
+        close(fd);
+        return -1;
+    }
+    *map_size = (size_t)info.st_size;
+    *map = mmap(NULL, *map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (*map == MAP_FAILED) return -1;
+
+    if (decode_header(*map, header) != 0 || header->data_size > *map_size - RAW_IMAGE_HEADER_SIZE ||
+        (!(header->flags & RAW_FLAG_LZ) && header->stride * header->height > header->data_size)) {
+        munmap(*map, *map_size);
+        return -1;
+    }
+    return 0;
+}
+
+int open_raw_image(const char *path, struct raw_image *image, int parallel) {
+    void *map;
+    size_t map_size;
+    struct raw_header header;
+    if (map_raw_file(path, &map, &map_size, &header) != 0) return -1;
+
+    if (!(header.flags & RAW_FLAG_LZ)) {
+        // The mapping is page aligned and the header 64 bytes, so every row is aligned
+        image->pixels = (unsigned char *)map + RAW_IMAGE_HEADER_SIZE;
+        image->width = header.width;
+        image->height = header.height;
+        image->channels = header.channels;
+        image->stride = header.stride;
+        image->map = map;
+        image->map_size = map_size;
+        return 0;
+    }
+    int status = read_mapped_region(map, &header, 0, 0, header.width, header.height, image, parallel);
+    munmap(map, map_size);
+    return status;
+}
+
+int read_raw_region(const char *path, int x, int y, int width, int height, struct raw_image *image, int parallel) {
+    void *map;
+    size_t map_size;
+    struct raw_header header;
+    if (map_raw_file(path, &map, &map_size, &header) != 0) return -1;
+
+    int status = -1;
+    if (x >= 0 && y >= 0 && width > 0 && height > 0 && x <= header.width - width && y <= header.height - height) {
+        status = read_mapped_region(map, &header, x, y, width, height, image, parallel);
+    }
+    munmap(map, map_size);
+    return status;
+}
+
+void close_raw_image(struct raw_image *image) {
+    if (image->map != NULL) munmap(image->map, image->map_size);
+    else free(image->pixels);
+    image->pixels = NULL;
+    image->map = NULL;
+}
+
+struct deflate_ctx {
+    const unsigned char *data;
+    int stride_bytes;       // of data
+    const struct raw_header *header;
+    struct chunk_grid grid;
+    unsigned char **chunks;
+    size_t *sizes;
+    int failed;
+};
+
+static void deflate_chunk_tile(void *arg, int begin, int end) {
+    struct deflate_ctx *ctx = arg;
+    const struct raw_header *header = ctx->header;
+    const struct chunk_grid *grid = &ctx->grid;
+    unsigned char *rows = calloc((size_t)grid->height * chunk_stride(header, grid->width), 1);  // padding stays zero
+    for (int k = begin; k < end; k++) {
+        int chunk_x = k % grid->columns * grid->width, chunk_y = k / grid->columns * grid->height;
+        int chunk_width = header->width - chunk_x < grid->width ? header->width - chunk_x : grid->width;
+        int chunk_height = header->height - chunk_y < grid->height ? header->height - chunk_y : grid->height;
+        size_t stored_stride = chunk_stride(header, chunk_width);
+        size_t size = (size_t)chunk_height * stored_stride;
+        ctx->chunks[k] = malloc(lz_bound(size));
+        if (rows == NULL || ctx->chunks[k] == NULL) {
+            ctx->failed = 1;
+            continue;
+        }
+        for (int y = 0; y < chunk_height; y++) {
+            memcpy(rows + (size_t)y * stored_stride,
+                   ctx->data + (size_t)(chunk_y + y) * ctx->stride_bytes + (size_t)chunk_x * header->channels,
+                   (size_t)chunk_width * header->channels);
+        }
+        ctx->sizes[k] = lz_compress(rows, size, ctx->chunks[k]);
+    }
+    free(rows);
+}
+
+static int write_compressed(FILE *file, struct raw_header *header, const unsigned char *data, int stride_bytes,
+                            int parallel) {
+    if (header->flags & RAW_FLAG_TILED) {
+        header->tile_width = RAW_TILE_SIZE;
+        header->block_rows = RAW_TILE_SIZE;
+    } else {
+        header->block_rows = RAW_BLOCK_BYTES / header->stride > 0 ? (int)(RAW_BLOCK_BYTES / header->stride) : 1;
+    }
+    struct deflate_ctx ctx = { data, stride_bytes, header };
+    get_chunk_grid(header, &ctx.grid);
+    int count = ctx.grid.columns * ctx.grid.rows;
+    ctx.chunks = calloc(count, sizeof(unsigned char *));
+    ctx.sizes = calloc(count, sizeof(size_t));
+    unsigned char *table = malloc(8 * ((size_t)count + 1));
+    int status = ctx.chunks != NULL && ctx.sizes != NULL && table != NULL;
+
+    if (status) {
+        if (parallel) parallel_tiles(count, 1, deflate_chunk_tile, &ctx);
+        else deflate_chunk_tile(&ctx, 0, count);
+        status = !ctx.failed;
+    }
+    if (status) {
+        uint64_t offset = 8 * ((uint64_t)count + 1);
+        for (int i = 0; i < count; i++) {
+            put_le64(table + 8 * (size_t)i, offset);
+            offset += ctx.sizes[i];
+        }
+        put_le64(table + 8 * (size_t)count, offset);
+        header->data_size = offset;
+
+        unsigned char bytes[RAW_IMAGE_HEADER_SIZE];
+        encode_header(bytes, header);
+        status = fwrite(bytes, 1, sizeof(bytes), file) == sizeof(bytes) &&
+                 fwrite(table, 8, (size_t)count + 1, file) == (size_t)count + 1;
+        for (int i = 0; i < count && status; i++) {
+            status = fwrite(ctx.chunks[i], 1, ctx.sizes[i], file) == ctx.sizes[i];
+        }
+    }
+
+    for (int i = 0; ctx.chunks != NULL && i < count; i++) free(ctx.chunks[i]);
+    free(ctx.chunks);
+    free(ctx.sizes);
+    free(table);
+    return status;
+}
+
+int write_raw_image(const char *path, int width, int height, int channels, const void *data, int stride_bytes,
+                    enum raw_compression compression, int parallel) {
+    static const unsigned char padding[RAW_IMAGE_ALIGNMENT] = { 0 };
+    int flags = compression == RAW_LZ ? RAW_FLAG_LZ : compression == RAW_LZ_TILES ? RAW_FLAG_LZ | RAW_FLAG_TILED : 0;
+    struct raw_header header = { flags, width, height, channels, aligned_stride(width, channels), 0, 0, 0 };
+    size_t row_bytes = (size_t)width * channels;
+    if (stride_bytes == 0) stride_bytes = (int)row_bytes;
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) return 0;
+    int status;
+    if (compression != RAW_UNCOMPRESSED) {
+        status = write_compressed(file, &header, data, stride_bytes, parallel);
+    } else {
+        unsigned char bytes[RAW_IMAGE_HEADER_SIZE];
+        header.data_size = (uint64_t)header.stride * height;
+        encode_header(bytes, &header);
+        status = fwrite(bytes, 1, sizeof(bytes), file) == sizeof(bytes);
+        for (int y = 0; y < height && status; y++) {
+            const unsigned char *row = (const unsigned char *)data + (size_t)y * stride_bytes;
+            status = fwrite(row, 1, row_bytes, file) == row_bytes &&
+                     fwrite(padding, 1, header.stride - row_bytes, file) == header.stride - row_bytes;
+        }
+    }
+    status = fclose(file) == 0 && status;
+    return status;
+}
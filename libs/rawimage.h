@@ -0,0 +1,54 @@
+#ifndef RAWIMAGE_H
+#define RAWIMAGE_H
+
+#include <stddef.h>
+
+// Raw container for handing images between runs without PNG deflate/inflate.
+// A 64-byte little-endian header is followed by the rows, each padded to a
+// multiple of RAW_IMAGE_ALIGNMENT bytes, so a mapped file has every row
+// aligned for SIMD loads. Compressed files hold independent LZ4-style blocks
+// of block_rows rows instead, or RAW_TILE_SIZE square tiles, preceded by a
+// table of block offsets; a region read inflates only what it overlaps.
+#define RAW_IMAGE_ALIGNMENT 64
+#define RAW_IMAGE_HEADER_SIZE 64
+#define RAW_TILE_SIZE 256
+
+enum raw_compression {
+    RAW_UNCOMPRESSED,
+    RAW_LZ,
+    RAW_LZ_TILES
+};
+
+struct raw_image {
+    unsigned char *pixels;  // first row, RAW_IMAGE_ALIGNMENT aligned
+    int width;
+    int height;
+    int channels;
+    size_t stride;          // bytes between rows, a multiple of RAW_IMAGE_ALIGNMENT
+    void *map;              // the mapped file, or NULL when pixels were decompressed
+    size_t map_size;
+};
+
+// Returns 1 if path has the .raw extension
+int is_raw_file(const char *path);
+
+// Reads only the header, like stbi_info (nonzero on success)
+int raw_image_info(const char *path, int *width, int *height, int *channels);
+
+// Maps an uncompressed file privately, so pixels are the page cache until
+// written; compressed files are inflated into an aligned buffer, block by
+// block as tasks when parallel is set. Returns -1 on a missing or malformed file.
+int open_raw_image(const char *path, struct raw_image *image, int parallel);
+void close_raw_image(struct raw_image *image);
+
+// Reads the width x height region at (x, y) into a new aligned buffer. Only
+// the rows, blocks or tiles it overlaps are touched, so the cost follows the
+// region's area on tiled files. Returns -1 if the region leaves the image.
+int read_raw_region(const char *path, int x, int y, int width, int height, struct raw_image *image, int parallel);
+
+// Writes rows of stride_bytes as a raw container (nonzero on success, like
+// stbi_write_png). parallel compresses the blocks as concurrent tasks.
+int write_raw_image(const char *path, int width, int height, int channels, const void *data, int stride_bytes,
+                    enum raw_compression compression, int parallel);
+
+#endif
@@ -0,0 +1,288 @@
+#include "resize.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "tasks.h"
+
+// Fixed-point filter weights, and the fractional bits kept between the
+// vertical and horizontal passes. Lanczos lobes let the absolute weights sum
+// to about 1.3, which still keeps both passes inside 32 bits.
+#define WEIGHT_SHIFT 14
+#define WEIGHT_ONE (1 << WEIGHT_SHIFT)
+#define INTERMEDIATE_SHIFT 7
+
+#define LANCZOS_LOBES 3
+
+int parse_resize_filter(const char *name, enum resize_filter *filter) {
+    if (!strcmp(name, "auto")) *filter = RESIZE_AUTO;
+    else if (!strcmp(name, "area")) *filter = RESIZE_AREA;
+    else if (!strcmp(name, "bilinear")) *filter = RESIZE_BILINEAR;
+    else if (!strcmp(name, "lanczos")) *filter = RESIZE_LANCZOS;
+    else return -1;
+    return 0;
+}
+
+static int scaled_size(int size, double scale) {
+    int scaled = (int)ceil(size * scale - 1e-9);
+    return scaled > 0 ? scaled : 1;
+}
+
+void resize_output_size(const struct resize_params *params, int width, int height,
+                        int *out_width, int *out_height) {
+    *out_width = scaled_size(width, params->scale);
+    *out_height = scaled_size(height, params->scale);
+}
+
+// Reduction factor when 1 / scale is a whole number of at least 2, else 0
+static int integer_factor(double scale) {
+    double inverse = 1.0 / scale;
+    int factor = (int)(inverse + 0.5);
+    return factor >= 2 && fabs(inverse - factor) < 1e-6 ? factor : 0;
+}
+
+struct area_ctx {
+    const unsigned char *src;
+    unsigned char *dst;
+    int width;
+    int height;
+    int channels;
+    int factor;
+    int out_width;
+    int failed;
+};
+
+// Output rows [row_begin, row_end) of an area reduction. The rows of a block
+// are summed into one accumulator row, then each output pixel adds factor
+// neighbouring sums; the last block of a row or column may be partial.
+static void area_rows(void *arg, int row_begin, int row_end) {
+    struct area_ctx *ctx = arg;
+    int channels = ctx->channels, factor = ctx->factor;
+    size_t row_elements = (size_t)ctx->width * channels;
+    unsigned int *sums = malloc(row_elements * sizeof(unsigned int));
+    if (sums == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        ctx->failed = 1;
+        return;
+    }
+
+    for (int oy = row_begin; oy < row_end; oy++) {
+        int y0 = oy * factor;
+        int rows = ctx->height - y0 < factor ? ctx->height - y0 : factor;
+        const unsigned char *row = ctx->src + (size_t)y0 * row_elements;
+        #pragma omp simd
+        for (size_t i = 0; i < row_elements; i++) sums[i] = row[i];
+        for (int r = 1; r < rows; r++) {
+            row += row_elements;
+            #pragma omp simd
+            for (size_t i = 0; i < row_elements; i++) sums[i] += row[i];
+        }
+
+        unsigned char *out = ctx->dst + (size_t)oy * ctx->out_width * channels;
+        int full_columns = ctx->width / factor;
+        unsigned int count = (unsigned int)rows * factor;
+        for (int ox = 0; ox < full_columns; ox++) {
+            const unsigned int *block = sums + (size_t)ox * factor * channels;
+            for (int c = 0; c < channels; c++) {
+                unsigned int total = 0;
+                for (int k = 0; k < factor; k++) total += block[k * channels + c];
+                out[ox * channels + c] = (unsigned char)((total + count / 2) / count);
+            }
+        }
+        if (full_columns < ctx->out_width) {
+            int columns = ctx->width - full_columns * factor;
+            const unsigned int *block = sums + (size_t)full_columns * factor * channels;
+            count = (unsigned int)rows * columns;
+            for (int c = 0; c < channels; c++) {
+                unsigned int total = 0;
+                for (int k = 0; k < columns; k++) total += block[k * channels + c];
+                out[full_columns * channels + c] = (unsigned char)((total + count / 2) / count);
+            }
+        }
+    }
+    free(sums);
+}
+
+// Contiguous taps of one output coordinate: input positions [first, first + count)
+struct filter_axis {
+    int *first;
+    int *count;
+    int *weights;   // max_taps per output coordinate
+    int max_taps;
+};
+
+static double filter_value(enum resize_filter filter, double x) {
+    x = fabs(x);
+    if (filter == RESIZE_BILINEAR) return x < 1.0 ? 1.0 - x : 0.0;
+    if (x < 1e-9) return 1.0;
+    if (x >= LANCZOS_LOBES) return 0.0;
+    double pi_x = M_PI * x;
+    return LANCZOS_LOBES * sin(pi_x) * sin(pi_x / LANCZOS_LOBES) / (pi_x * pi_x);
+}
+
+static void free_filter_axis(struct filter_axis *axis) {
+    free(axis->first);
+    free(axis->count);
+    free(axis->weights);
+}
+
+// Weight table mapping size input samples to out_size: taps outside the
+// input are folded onto the edge sample, and every row of weights is
+// normalized to exactly WEIGHT_ONE
+static int build_filter_axis(struct filter_axis *axis, int size, int out_size, enum resize_filter filter) {
+    double scale = (double)out_size / size;
+    double stretch = scale < 1.0 ? 1.0 / scale : 1.0;  // widen the filter when reducing
+    double support = (filter == RESIZE_BILINEAR ? 1.0 : LANCZOS_LOBES) * stretch;
+    axis->max_taps = (int)ceil(2 * support) + 2;
+    if (axis->max_taps > size) axis->max_taps = size;
+    axis->first = malloc(out_size * sizeof(int));
+    axis->count = malloc(out_size * sizeof(int));
+    axis->weights = calloc((size_t)out_size * axis->max_taps, sizeof(int));
+    double *raw = malloc(axis->max_taps * sizeof(double));
+    if (axis->first == NULL || axis->count == NULL || axis->weights == NULL || raw == NULL) {
+        free(raw);
+        free_filter_axis(axis);
+        return -1;
+    }
+
+    for (int o = 0; o < out_size; o++) {
+        double center = (o + 0.5) / scale - 0.5;
+        int lo = (int)floor(center - support) + 1, hi = (int)ceil(center + support) - 1;
+        int first = lo < 0 ? 0 : lo, last = hi >= size ? size - 1 : hi;
+        int count = last - first + 1;
+
+        double total = 0;
+        for (int t = 0; t < count; t++) raw[t] = 0;
+        for (int i = lo; i <= hi; i++) {
+            int folded = i < first ? first : (i > last ? last : i);
+            double value = filter_value(filter, (i - center) / stretch);
+            raw[folded - first] += value;
+            total += value;
+        }
+        if (total == 0) {
+            raw[0] = total = 1;
+        }
+
+        // Round, then give the rounding error to the largest tap
+        int *weights = axis->weights + (size_t)o * axis->max_taps;
+        int sum = 0, largest = 0;
+        for (int t = 0; t < count; t++) {
+            weights[t] = (int)lround(raw[t] / total * WEIGHT_ONE);
+            sum += weights[t];
+            if (weights[t] > weights[largest]) largest = t;
+        }
+        weights[largest] += WEIGHT_ONE - sum;
+        axis->first[o] = first;
+        axis->count[o] = count;
+    }
+    free(raw);
+    return 0;
+}
+
+struct separable_ctx {
+    const unsigned char *src;
+    unsigned char *dst;
+    int width;
+    int channels;
+    int out_width;
+    struct filter_axis horizontal;
+    struct filter_axis vertical;
+    int failed;
+};
+
+// Output rows [row_begin, row_end): the vertical taps blend whole input rows
+// into one intermediate row, which the horizontal taps then reduce
+static void separable_rows(void *arg, int row_begin, int row_end) {
+    struct separable_ctx *ctx = arg;
+    int channels = ctx->channels;
+    size_t row_elements = (size_t)ctx->width * channels;
+    int *blended = malloc(row_elements * sizeof(int));
+    if (blended == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        ctx->failed = 1;
+        return;
+    }
+
+    for (int oy = row_begin; oy < row_end; oy++) {
+        const int *weights = ctx->vertical.weights + (size_t)oy * ctx->vertical.max_taps;
+        int first = ctx->vertical.first[oy], count = ctx->vertical.count[oy];
+        #pragma omp simd
+        for (size_t i = 0; i < row_elements; i++) blended[i] = 0;
+        for (int t = 0; t < count; t++) {
+            const unsigned char *row = ctx->src + (size_t)(first + t) * row_elements;
+            int weight = weights[t];
+            #pragma omp simd
+            for (size_t i = 0; i < row_elements; i++) blended[i] += row[i] * weight;
+        }
+        #pragma omp simd
+        for (size_t i = 0; i < row_elements; i++) {
+            blended[i] = (blended[i] + (1 << (WEIGHT_SHIFT - INTERMEDIATE_SHIFT - 1))) >>
+                         (WEIGHT_SHIFT - INTERMEDIATE_SHIFT);
+        }
+
+        unsigned char *out = ctx->dst + (size_t)oy * ctx->out_width * channels;
+        for (int ox = 0; ox < ctx->out_width; ox++) {
+            const int *taps = ctx->horizontal.weights + (size_t)ox * ctx->horizontal.max_taps;
+            const int *samples = blended + (size_t)ctx->horizontal.first[ox] * channels;
+            int taps_count = ctx->horizontal.count[ox];
+            for (int c = 0; c < channels; c++) {
+                int total = 1 << (WEIGHT_SHIFT + INTERMEDIATE_SHIFT - 1);
+                for (int t = 0; t < taps_count; t++) total += samples[t * channels + c] * taps[t];
+                total >>= WEIGHT_SHIFT + INTERMEDIATE_SHIFT;
+                out[ox * channels + c] = (unsigned char)(total < 0 ? 0 : (total > 255 ? 255 : total));
+            }
+        }
+    }
+    free(blended);
+}
+
+unsigned char *resize_image(const unsigned char *input_image, int width, int height, int channels,
+                            const struct resize_params *params, int *out_width, int *out_height,
+                            int parallel) {
+    resize_output_size(params, width, height, out_width, out_height);
+    unsigned char *output = malloc((size_t)*out_width * *out_height * channels);
+    if (output == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        return NULL;
+    }
+    int tile_rows = default_tile_rows((long)*out_width * channels);
+
+    int factor = integer_factor(params->scale);
+    enum resize_filter filter = params->filter;
+    if (filter == RESIZE_AUTO) filter = factor ? RESIZE_AREA : RESIZE_LANCZOS;
+    if (filter == RESIZE_AREA && factor) {
+        struct area_ctx ctx = { input_image, output, width, height, channels, factor, *out_width, 0 };
+        if (parallel) parallel_tiles(*out_height, tile_rows, area_rows, &ctx);
+        else area_rows(&ctx, 0, *out_height);
+        if (ctx.failed) {
+            free(output);
+            return NULL;
+        }
+        return output;
+    }
+    // Area averaging by a fractional factor is a widened box; the
+    // triangle filter is the closest separable stand-in
+    if (filter == RESIZE_AREA) filter = RESIZE_BILINEAR;
+
+    struct separable_ctx ctx = { input_image, output, width, channels, *out_width };
+    if (build_filter_axis(&ctx.horizontal, width, *out_width, filter) != 0) {
+        fprintf(stderr, "Error allocating memory\n");
+        free(output);
+        return NULL;
+    }
+    if (build_filter_axis(&ctx.vertical, height, *out_height, filter) != 0) {
+        fprintf(stderr, "Error allocating memory\n");
+        free_filter_axis(&ctx.horizontal);
+        free(output);
+        return NULL;
+    }
+    if (parallel) parallel_tiles(*out_height, tile_rows, separable_rows, &ctx);
+    else separable_rows(&ctx, 0, *out_height);
+    free_filter_axis(&ctx.horizontal);
+    free_filter_axis(&ctx.vertical);
+    if (ctx.failed) {
+        free(output);
+        return NULL;
+    }
+    return output;
+}
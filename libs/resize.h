@@ -0,0 +1,38 @@
+#ifndef RESIZE_H
+#define RESIZE_H
+
+#include <stddef.h>
+
+enum resize_filter {
+    RESIZE_AUTO,        // area for integer reduction factors, Lanczos otherwise
+    RESIZE_AREA,        // mean of each factor x factor block
+    RESIZE_BILINEAR,    // triangle filter, widened when reducing
+    RESIZE_LANCZOS      // Lanczos-3, widened when reducing
+};
+
+// Largest factor --scale accepts in either direction
+#define MAX_RESIZE_FACTOR 16
+
+struct resize_params {
+    double scale;               // output size over input size, 1 = unchanged
+    enum resize_filter filter;
+};
+
+// Parses "auto", "area", "bilinear" or "lanczos". Returns 0 on success, -1 otherwise.
+int parse_resize_filter(const char *name, enum resize_filter *filter);
+
+// Output size for an input of width x height: ceil(size * scale), at least 1
+void resize_output_size(const struct resize_params *params, int width, int height,
+                        int *out_width, int *out_height);
+
+// Resizes an interleaved 8-bit image with params->filter into a
+// malloc'ed buffer of resize_output_size. Area reduction sums whole rows of
+// each block first and then neighbouring pixels, both as flat vector loops;
+// the separable filters precompute their weight tables once per axis. With
+// parallel set, output rows are split into tiles on the task runtime.
+// Returns NULL when a buffer cannot be allocated.
+unsigned char *resize_image(const unsigned char *input_image, int width, int height, int channels,
+                            const struct resize_params *params, int *out_width, int *out_height,
+                            int parallel);
+
+#endif
@@ -4,140 +4,141 @@
 #include <mpi/mpi.h>
 #include <stdio.h>
 #include <string.h>
+#include "median.h"
+#include "encode.h"
+
+// Sobel operator kernels for horizontal and vertical edge detection:
+//   Gx = [-1 0 1; -2 0 2; -1 0 1]    Gy = [-1 -2 -1; 0 0 0; 1 2 1]
+
+// Gradient magnitude of one interior row from the rows above and below it;
+// the taps are spelled out so the x loop vectorizes
+static void sobel_row(const unsigned char *above, const unsigned char *row, const unsigned char *below,
+                      unsigned char *output, int width) {
+    output[0] = 0;
+    output[width - 1] = 0;
+    for (int x = 1; x < width - 1; x++) {
+        int sumX = (above[x + 1] - above[x - 1]) + 2 * (row[x + 1] - row[x - 1]) + (below[x + 1] - below[x - 1]);
+        int sumY = (below[x - 1] + 2 * below[x] + below[x + 1]) - (above[x - 1] + 2 * above[x] + above[x + 1]);
+
+        // Calculate the gradient magnitude
+        int magnitude = (int)sqrt((double)(sumX * sumX + sumY * sumY));
+
+        // Normalize and clamp the result to [0, 255]
+        if (magnitude > 255) {
+            magnitude = 255;
+        }
 
-// Sobel operator kernels for horizontal and vertical edge detection
-const int Gx[3][3] = {
-    {-1,  0,  1},
-    {-2,  0,  2},
-    {-1,  0,  1}
-};
+        output[x] = (unsigned char)magnitude;
+    }
+}
 
-const int Gy[3][3] = {
-    {-1, -2, -1},
-    { 0,  0,  0},
-    { 1,  2,  1}
+struct sobel_tile_ctx {
+    const struct image_buffer *input;
+    struct image_buffer *output;
 };
 
-void sobel_filter(const unsigned char *input_image, unsigned char *output_image,
-                  int width, int height) {
-    // Iterate over the image excluding the border pixels
-    for (int y = 1; y < height - 1; y++) {
-        for (int x = 1; x < width - 1; x++) {
-            int sumX = 0;
-            int sumY = 0;
-
-            // Apply the Sobel kernels to the neighborhood
-            for (int ky = -1; ky <= 1; ky++) {
-                for (int kx = -1; kx <= 1; kx++) {
-                    int pixel = input_image[(y + ky) * width + (x + kx)];
-                    sumX += pixel * Gx[ky + 1][kx + 1];
-                    sumY += pixel * Gy[ky + 1][kx + 1];
-                }
-            }
-
-            // Calculate the gradient magnitude
-            int magnitude = (int)sqrt((double)(sumX * sumX + sumY * sumY));
-
-            // Normalize and clamp the result to [0, 255]
-            if (magnitude > 255) {
-                magnitude = 255;
-            }
-
-            output_image[y * width + x] = (unsigned char)magnitude;
+static void sobel_tile(void *arg, int row_begin, int row_end) {
+    struct sobel_tile_ctx *ctx = arg;
+    const struct image_buffer *input = ctx->input;
+    int width = input->width;
+    int height = input->height;
+
+    for (int y = row_begin; y < row_end; y++) {
+        unsigned char *output = image_row(ctx->output, y);
+        // Handle the border pixels by setting them to zero
+        if (y == 0 || y == height - 1) {
+            memset(output, 0, width);
+            continue;
         }
-    }
-
-    // Handle the border pixels by setting them to zero
-    for (int x = 0; x < width; x++) {
-        output_image[0 * width + x] = 0;
-        output_image[(height - 1) * width + x] = 0;
-    }
-
-    for (int y = 0; y < height; y++) {
-        output_image[y * width + 0] = 0;
-        output_image[y * width + (width - 1)] = 0;
+        sobel_row(image_row(input, y - 1), image_row(input, y), image_row(input, y + 1), output, width);
     }
 }
 
-// OpenMP implmentation of sobel
-void sobel_filter_omp(const unsigned char *input_image, unsigned char *output_image,
-                  int width, int height) {
-    // Handle the border pixels by setting them to zero
-    // We can parallelize these loops as well
-    #pragma omp parallel for
-    for (int x = 0; x < width; x++) {
-        output_image[0 * width + x] = 0;
-        output_image[(height - 1) * width + x] = 0;
-    }
+void sobel_filter(const struct image_buffer *input, struct image_buffer *output) {
+    struct sobel_tile_ctx ctx = { input, output };
+    sobel_tile(&ctx, 0, input->height);
+}
 
-    #pragma omp parallel for
-    for (int y = 0; y < height; y++) {
-        output_image[y * width + 0] = 0;
-        output_image[y * width + (width - 1)] = 0;
-    }
+// tan(22.5 deg) and tan(67.5 deg) in Q15 for sorting gradients into four directions
+#define TAN_22_5_Q15 13573
+#define TAN_67_5_Q15 79109
+
+void sobel_gradient_rows(const struct image_buffer *input, unsigned short *magnitude, unsigned char *direction,
+                         int row_begin, int row_end) {
+    int width = input->width;
+    int height = input->height;
+    for (int y = row_begin; y < row_end; y++) {
+        size_t row = (size_t)y * width;
+        if (y == 0 || y == height - 1) {
+            memset(magnitude + row, 0, (size_t)width * sizeof(unsigned short));
+            memset(direction + row, 0, (size_t)width);
+            continue;
+        }
+        magnitude[row] = magnitude[row + width - 1] = 0;
+        direction[row] = direction[row + width - 1] = 0;
 
-    // Parallelize the main loop using OpenMP
-    #pragma omp parallel for collapse(2)
-    for (int y = 1; y < height - 1; y++) {
+        const unsigned char *above = image_row(input, y - 1);
+        const unsigned char *centre = image_row(input, y);
+        const unsigned char *below = image_row(input, y + 1);
         for (int x = 1; x < width - 1; x++) {
-            int sumX = 0;
-            int sumY = 0;
-
-            // Apply the Sobel kernels to the neighborhood
-            for (int ky = -1; ky <= 1; ky++) {
-                for (int kx = -1; kx <= 1; kx++) {
-                    int pixel = input_image[(y + ky) * width + (x + kx)];
-                    sumX += pixel * Gx[ky + 1][kx + 1];
-                    sumY += pixel * Gy[ky + 1][kx + 1];
-                }
+            int sumX = (above[x + 1] - above[x - 1]) + 2 * (centre[x + 1] - centre[x - 1]) + (below[x + 1] - below[x - 1]);
+            int sumY = (below[x - 1] + 2 * below[x] + below[x + 1]) - (above[x - 1] + 2 * above[x] + above[x + 1]);
+            magnitude[row + x] = (unsigned short)sqrt((double)(sumX * sumX + sumY * sumY));
+
+            long ax = abs(sumX), ay = abs(sumY);
+            if (ay * 32768 <= ax * TAN_22_5_Q15) {
+                direction[row + x] = SOBEL_DIRECTION_HORIZONTAL;
+            } else if (ay * 32768 >= ax * TAN_67_5_Q15) {
+                direction[row + x] = SOBEL_DIRECTION_VERTICAL;
+            } else if ((sumX > 0) == (sumY > 0)) {
+                direction[row + x] = SOBEL_DIRECTION_DIAGONAL;
+            } else {
+                direction[row + x] = SOBEL_DIRECTION_ANTIDIAGONAL;
             }
-
-            // Calculate the gradient magnitude
-            int magnitude = (int)sqrt((double)(sumX * sumX + sumY * sumY));
-
-            // Normalize and clamp the result to [0, 255]
-            if (magnitude > 255) {
-                magnitude = 255;
-            }
-
-            output_image[y * width + x] = (unsigned char)magnitude;
         }
     }
 }
 
+// OpenMP implmentation of sobel
+// Rows are split into tiles that run as tasks, so a large image can be shared
+// by every thread in the team instead of opening a nested parallel region.
+void sobel_filter_omp(const struct image_buffer *input, struct image_buffer *output) {
+    struct sobel_tile_ctx ctx = { input, output };
+    parallel_tiles(input->height, default_tile_rows(input->width), sobel_tile, &ctx);
+}
 
-void sobel_filter_hybrid(const char *filename, const char *input_folder, unsigned char *output_folder) {
-    char input_path[256];
-    sprintf(input_path, "%s/%s", input_folder, filename);
 
+void sobel_filter_hybrid(const char *input_path, const char *output_path, int median_radius,
+                         const struct decode_params *decode, const struct encode_params *encode) {
     int width, height, channels;
-    unsigned char *img = stbi_load(input_path, &width, &height, &channels, 1); // Load as grayscale
+    struct region_params roi;
+    unsigned char *img = load_image_region(input_path, 1 + median_radius, &width, &height, &channels, 1, 1,
+                                           decode, &roi, 1); // Load as grayscale
     if (img == NULL) {
         fprintf(stderr, "Error loading image %s\n", input_path);
         return;
     }
 
     // Allocate memory for the edge-detected image
-    unsigned char *edge_img = (unsigned char *)malloc(width * height);
-    if (edge_img == NULL) {
+    struct image_buffer edge_img;
+    if (image_alloc(&edge_img, width, height, 1) != 0) {
         fprintf(stderr, "Error allocating memory\n");
-        stbi_image_free(img);
+        release_image(img);
         return;
     }
 
     // Apply the Sobel filter (parallelized with OpenMP)
-    sobel_filter_omp(img, edge_img, width, height);
+    median_prefilter(img, width, height, median_radius, 1);
+    struct image_buffer input = image_wrap(img, width, height, 1, 0);
+    sobel_filter_omp(&input, &edge_img);
 
     // Save the edge-detected image
-    char output_path[256];
-    sprintf(output_path, "%s/edge_mpi", output_folder);
-    create_output_directory(output_path);
-    sprintf(output_path, "%s/edge_mpi/%s", output_folder, filename);
-    if (!stbi_write_png(output_path, width, height, 1, edge_img, width)) {
+    if (!write_png(output_path, roi.width, roi.height, 1, image_row(&edge_img, roi.y) + roi.x, edge_img.stride,
+                   encode, 1)) {
         fprintf(stderr, "Error saving image %s\n", output_path);
     }
 
     // Clean up
-    stbi_image_free(img);
-    free(edge_img);
+    release_image(img);
+    image_free(&edge_img);
 }
\ No newline at end of file
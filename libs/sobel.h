@@ -5,14 +5,31 @@
 #include <stddef.h>
 #include <omp.h>
 #include "utility.h"
+#include "tasks.h"
+#include "decode.h"
+#include "encode.h"
 
-// Function to perform Sobel edge detection on a grayscale image
-void sobel_filter(const unsigned char *input_image, unsigned char *output_image,
-                  int width, int height);
+// Function to perform Sobel edge detection on a grayscale image; output has
+// the input's size, and either may have padded rows
+void sobel_filter(const struct image_buffer *input, struct image_buffer *output);
 
-void sobel_filter_omp(const unsigned char *input_image, unsigned char *output_image,
-                  int width, int height);
+void sobel_filter_omp(const struct image_buffer *input, struct image_buffer *output);
 
-void sobel_filter_hybrid(const char *filename, const char *input_folder, unsigned char *output_image);
+// Gradient direction sorted into four sectors, named by the axis the gradient
+// runs along (image y grows downwards)
+#define SOBEL_DIRECTION_HORIZONTAL   0   // compare with left and right neighbours
+#define SOBEL_DIRECTION_DIAGONAL     1   // top-left and bottom-right
+#define SOBEL_DIRECTION_VERTICAL     2   // above and below
+#define SOBEL_DIRECTION_ANTIDIAGONAL 3   // top-right and bottom-left
+
+// Rows [row_begin, row_end) of the unclamped gradient magnitude and its
+// direction sector into packed width x height planes; border pixels are zero
+void sobel_gradient_rows(const struct image_buffer *input, unsigned short *magnitude, unsigned char *direction,
+                         int row_begin, int row_end);
+
+// Loads input_path as luma, filters it with tile tasks and writes the edges
+// to output_path; median_radius > 0 median-filters the input before the gradients
+void sobel_filter_hybrid(const char *input_path, const char *output_path, int median_radius,
+                         const struct decode_params *decode, const struct encode_params *encode);
 
 #endif // SOBEL_H
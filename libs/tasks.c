@@ -0,0 +1,68 @@
+#include "tasks.h"
+
+int default_tile_rows(long row_elements) {
+    if (row_elements <= 0) return 1;
+    long rows = TILE_PIXELS / row_elements;
+    return rows < 1 ? 1 : (int)rows;
+}
+
+void parallel_tiles(int rows, int tile_rows, tile_kernel kernel, void *ctx) {
+    if (rows <= 0) return;
+    if (tile_rows < 1) tile_rows = 1;
+    int tiles = (rows + tile_rows - 1) / tile_rows;
+
+    if (omp_in_parallel()) {
+        // Already inside the task runtime: split into stealable subtasks.
+        // The implicit taskgroup of taskloop waits for all tiles before returning.
+        #pragma omp taskloop grainsize(1) firstprivate(kernel, ctx, rows, tile_rows)
+        for (int t = 0; t < tiles; t++) {
+            int row_begin = t * tile_rows;
+            int row_end = row_begin + tile_rows < rows ? row_begin + tile_rows : rows;
+            kernel(ctx, row_begin, row_end);
+        }
+    } else {
+        #pragma omp parallel for schedule(dynamic)
+        for (int t = 0; t < tiles; t++) {
+            int row_begin = t * tile_rows;
+            int row_end = row_begin + tile_rows < rows ? row_begin + tile_rows : rows;
+            kernel(ctx, row_begin, row_end);
+        }
+    }
+}
+
+static int run_pipeline(int stages, stage_producer produce, stage_consumer consume, void *ctx) {
+    int produced = 0;
+    char order;         // dependence token serializing the consumer tasks
+    (void)order;        // only its address is used, by the depend clause
+    #pragma omp taskgroup
+    {
+        for (; produced < stages && produce(ctx, produced) == 0; produced++) {
+            int stage = produced;
+            #pragma omp task depend(inout: order) firstprivate(stage, consume, ctx)
+            consume(ctx, stage);
+            // Drain the consumers now and then, so stage buffers do not pile up
+            // when the producer outruns them (always, on a single thread)
+            if ((stage + 1) % PIPELINE_WINDOW == 0) {
+                #pragma omp taskwait
+            }
+        }
+    }
+    return produced;
+}
+
+int pipeline_stages(int stages, stage_producer produce, stage_consumer consume, void *ctx) {
+    if (omp_in_parallel()) return run_pipeline(stages, produce, consume, ctx);
+    int produced = 0;
+    #pragma omp parallel
+    #pragma omp single
+    produced = run_pipeline(stages, produce, consume, ctx);
+    return produced;
+}
+
+int tile_worker_count(void) {
+    return omp_in_parallel() ? omp_get_num_threads() : omp_get_max_threads();
+}
+
+int tile_worker_id(void) {
+    return omp_get_thread_num();
+}
@@ -0,0 +1,42 @@
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <omp.h>
+
+// Target number of pixels handled by a single tile task
+#define TILE_PIXELS (64 * 1024)
+
+// Most stages pipeline_stages lets the producer run ahead of its consumers
+#define PIPELINE_WINDOW 8
+
+// A tile kernel processes rows [row_begin, row_end) of an image described by ctx
+typedef void (*tile_kernel)(void *ctx, int row_begin, int row_end);
+
+// Number of rows per tile for an image row of the given width (in elements)
+int default_tile_rows(long row_elements);
+
+// Runs kernel over rows [0, rows) in tiles of tile_rows.
+// When called from inside a parallel region (e.g. a per-file task) the tiles are
+// spawned as tasks, so idle threads in the team can steal them once the file
+// queue drains. Outside a parallel region a team is started just for this call.
+void parallel_tiles(int rows, int tile_rows, tile_kernel kernel, void *ctx);
+
+// Stages of a two-step pipeline: a producer returns 0 when stage is ready
+// for the consumer
+typedef int (*stage_producer)(void *ctx, int stage);
+typedef void (*stage_consumer)(void *ctx, int stage);
+
+// Runs produce for stages 0, 1, ... on the calling thread and hands every
+// produced stage to consume as a task, so consuming overlaps the next
+// produce calls. Consumer tasks run one at a time, in stage order, and at most
+// PIPELINE_WINDOW stages wait for theirs. Stops at the first stage produce
+// fails; returns the number of stages produced.
+int pipeline_stages(int stages, stage_producer produce, stage_consumer consume, void *ctx);
+
+// Number of threads that may run tiles of the current parallel_tiles call
+int tile_worker_count(void);
+
+// Index of the calling thread in [0, tile_worker_count())
+int tile_worker_id(void);
+
+#endif
@@ -1,4 +1,7 @@
 #include "utility.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
 
 // Courtesy of stack overflow: https://stackoverflow.com/a/7430262
 void create_output_directory(const char *output_dir_name) {
@@ -8,4 +11,55 @@ void create_output_directory(const char *output_dir_name) {
         mkdir(output_dir_name, 0700);
     }
 
-}
\ No newline at end of file
+}
+
+int create_parent_directories(const char *file_path) {
+    char path[OUTPUT_PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s", file_path) >= (int)sizeof(path)) {
+        fprintf(stderr, "Output path too long: %.64s...\n", file_path);
+        return -1;
+    }
+
+    char *slash = strrchr(path, '/');
+    if (slash == NULL || slash == path) return 0;
+    *slash = '\0';
+
+    // Common case: the directory already exists or only its last level is missing
+    if (mkdir(path, 0700) == 0 || errno == EEXIST) return 0;
+    if (errno != ENOENT) return 0;
+
+    for (char *p = path + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(path, 0700);
+            *p = '/';
+        }
+    }
+    mkdir(path, 0700);
+    return 0;
+}
+
+int prefixed_output_path(char *output_path, size_t size, const char *folder,
+                         const char *prefix, const char *relative_path) {
+    const char *file_name = strrchr(relative_path, '/');
+    int length;
+    if (file_name == NULL) {
+        length = snprintf(output_path, size, "%s/%s%s", folder, prefix, relative_path);
+    } else {
+        int dir_length = (int)(file_name - relative_path);
+        length = snprintf(output_path, size, "%s/%.*s/%s%s", folder, dir_length, relative_path, prefix, file_name + 1);
+    }
+    return length < 0 || (size_t)length >= size ? -1 : 0;
+}
+
+int suffixed_output_path(char *output_path, size_t size, const char *path, const char *suffix) {
+    const char *file_name = strrchr(path, '/');
+    const char *extension = strrchr(file_name ? file_name : path, '.');
+    int length;
+    if (extension == NULL) {
+        length = snprintf(output_path, size, "%s%s", path, suffix);
+    } else {
+        length = snprintf(output_path, size, "%.*s%s%s", (int)(extension - path), path, suffix, extension);
+    }
+    return length < 0 || (size_t)length >= size ? -1 : 0;
+}
@@ -4,7 +4,24 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+// Room for any path the output helpers build. A path that does not fit is
+// rejected instead of being truncated to a different one.
+#define OUTPUT_PATH_MAX 4096
+
 // Create a directory if not already created
 void create_output_directory(const char *output_dir_name);
 
-#endif
\ No newline at end of file
+// Create every missing directory leading up to file_path (mkdir -p of its dirname).
+// Returns -1, creating nothing, when file_path is OUTPUT_PATH_MAX or longer.
+int create_parent_directories(const char *file_path);
+
+// Builds folder/<dirs of relative_path>/<prefix><file name of relative_path>
+// (-1 if it does not fit in size)
+int prefixed_output_path(char *output_path, size_t size, const char *folder,
+                          const char *prefix, const char *relative_path);
+
+// Inserts suffix between the file name of path and its extension: a/b.png -> a/b<suffix>.png
+// (-1 if it does not fit in size)
+int suffixed_output_path(char *output_path, size_t size, const char *path, const char *suffix);
+
+#endif
@@ -0,0 +1,70 @@
+#include "walk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "utility.h"
+
+struct walk_ctx {
+    const char *root;
+    const char *const *extensions;
+    directory_visitor visit;
+    void *ctx;
+};
+
+int join_relative_path(char *output, size_t size, const char *relative_dir, const char *name) {
+    int length = relative_dir[0] == '\0' ? snprintf(output, size, "%s", name)
+                                         : snprintf(output, size, "%s/%s", relative_dir, name);
+    return length < 0 || (size_t)length >= size ? -1 : 0;
+}
+
+// Scans one directory, spawns a task per subdirectory and then hands the files
+// to the visitor. Takes ownership of relative_dir.
+static void walk_task(const struct walk_ctx *walk, char *relative_dir) {
+    char path[OUTPUT_PATH_MAX];
+    int length = relative_dir[0] == '\0' ? snprintf(path, sizeof(path), "%s", walk->root)
+                                         : snprintf(path, sizeof(path), "%s/%s", walk->root, relative_dir);
+    if (length >= (int)sizeof(path)) {
+        fprintf(stderr, "Path too long, skipping %s/%s\n", walk->root, relative_dir);
+        free(relative_dir);
+        return;
+    }
+
+    struct file_list files, subdirs;
+    if (scan_directory_entries(path, walk->extensions, &files, &subdirs) != 0) {
+        fprintf(stderr, "Error reading the directory %s\n", path);
+        free(relative_dir);
+        return;
+    }
+
+    // Queue the subdirectories first so idle threads can keep walking
+    // while this thread feeds the files it found into the processing queue
+    for (int i = 0; i < subdirs.count; i++) {
+        char child[OUTPUT_PATH_MAX];
+        if (join_relative_path(child, sizeof(child), relative_dir, subdirs.names[i]) != 0) {
+            fprintf(stderr, "Path too long, skipping %s/%s\n", relative_dir, subdirs.names[i]);
+            continue;
+        }
+        char *child_dir = strdup(child);
+        #pragma omp task firstprivate(child_dir)
+        walk_task(walk, child_dir);
+    }
+
+    if (files.count > 0) {
+        walk->visit(walk->ctx, relative_dir, &files);
+    }
+
+    free_file_list(&files);
+    free_file_list(&subdirs);
+    free(relative_dir);
+}
+
+void walk_directory_tree(const char *root, const char *const *extensions, int threads,
+                         directory_visitor visit, void *ctx) {
+    struct walk_ctx walk = { root, extensions, visit, ctx };
+    if (threads < 1) threads = 1;
+
+    #pragma omp parallel num_threads(threads)
+    #pragma omp single
+    walk_task(&walk, strdup(""));
+}
@@ -0,0 +1,23 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include "dirscan.h"
+
+// Called once per directory that holds matching files. relative_dir is "" for
+// the root, otherwise the directory path below the root ("2023/05/17").
+// files only lives for the duration of the call.
+typedef void (*directory_visitor)(void *ctx, const char *relative_dir, struct file_list *files);
+
+// Recursively walks root. Every directory is scanned by its own OpenMP task on a
+// team of at most threads workers (the bounded pool), and visit is called as
+// soon as that directory has been scanned, so processing can start long before
+// the walk completes. Tasks spawned by visit run on the same team; the call
+// returns once the walk and all of those tasks are done.
+void walk_directory_tree(const char *root, const char *const *extensions, int threads,
+                         directory_visitor visit, void *ctx);
+
+// Joins relative_dir and name into a path relative to the walk root
+// (-1 if it does not fit in size)
+int join_relative_path(char *output, size_t size, const char *relative_dir, const char *name);
+
+#endif
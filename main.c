@@ -5,9 +5,17 @@
 #include <time.h>
 
 int main(int argc, char** argv) {
-    if (argc != 4) {
-        printf("No image folder provided: ./main <image folder path> serial | omp | mpi <algorithm>\n");
-        printf("Possible image processing algorithms are:\n1. sobel\n2. grayscale\n3. negative\n4. otsu\n");
+    if (argc < 4) {
+        printf("No image folder provided: ./main <image folder path> serial | omp | mpi <algorithm> [options]\n");
+        printf("Possible image processing algorithms are:\n1. sobel\n2. grayscale\n3. negative\n4. otsu\n5. adaptive\n6. blur\n7. canny\n8. morph\n9. median\n10. equalize\n11. hough\n12. convert\n");
+        print_options_usage();
+        return 1;
+    }
+
+    struct run_options options;
+    default_options(&options);
+    if (parse_options(argc, argv, 4, &options) != 0) {
+        print_options_usage();
         return 1;
     }
 
@@ -18,17 +26,16 @@ int main(int argc, char** argv) {
     const char *folder_path = argv[1];
     const char *execution_type = argv[2];
     const char *image_processing_algorithm = argv[3];
-
-    int otsu_threshold = 0;
-    if (!strcmp(image_processing_algorithm, "otsu") && strcmp(execution_type, "mpi"))
-    {
-        printf("Please provide a threshold for otsu binarization (0 - 255): ");
-        scanf("%d", &otsu_threshold);
-        if (otsu_threshold < 0 || otsu_threshold > 255)
-        {
-            printf("Invalid value range. Image should be between 0 - 255. Current value provided: %d\n", otsu_threshold);
-            return 1;
-        }
+    // The morph algorithm opens unless told otherwise; for otsu --morph stays opt-in
+    if (!strcmp(image_processing_algorithm, "morph") && options.morph.op == MORPH_NONE) {
+        options.morph.op = MORPH_OPEN;
+    }
+    // Likewise a 3x3 median for the median algorithm, no pre-filter elsewhere
+    if (!strcmp(image_processing_algorithm, "median") && options.median_radius == 0) {
+        options.median_radius = 1;
+    }
+    if (!strcmp(image_processing_algorithm, "equalize") && options.contrast.mode == CONTRAST_NONE) {
+        options.contrast.mode = CONTRAST_CLAHE;
     }
 
     printf("The image path provided is: %s\n", folder_path);
@@ -36,7 +43,7 @@ int main(int argc, char** argv) {
     if (strcmp(execution_type, "serial") == 0) 
     {
         start = clock();
-        read_images_from_folder_serial(folder_path, image_processing_algorithm, otsu_threshold);
+        read_images_from_folder_serial(folder_path, image_processing_algorithm, &options);
         finish = clock();
 
         serial_processing_time = (double)(finish - start) / CLOCKS_PER_SEC;
@@ -46,7 +53,7 @@ int main(int argc, char** argv) {
     {
         omp_start = omp_get_wtime();
 
-        read_images_from_folder_omp(folder_path, image_processing_algorithm, otsu_threshold);
+        read_images_from_folder_omp(folder_path, image_processing_algorithm, &options);
 
         omp_finish = omp_get_wtime();
 
@@ -56,65 +63,18 @@ int main(int argc, char** argv) {
     else if (strcmp(execution_type, "mpi") == 0) 
     {
         // Initialize MPI
-        if (!strcmp(image_processing_algorithm, "grayscale"))
-        {
-            MPI_Init(&argc, &argv);
-            
-            mpi_start = MPI_Wtime();
-
-            int rank = read_images_from_folders_mpi(folder_path, image_processing_algorithm);
-
-            mpi_finish = MPI_Wtime();
-
-            MPI_Finalize();
-
-            mpi_processing_time = mpi_finish - mpi_start;
-            printf("Total time taken to apply %s on 100 images using %s method: %lf\n", image_processing_algorithm, execution_type, mpi_processing_time);
-        }
-        else if (!strcmp(image_processing_algorithm, "sobel"))
-        {
-            MPI_Init(&argc, &argv);
-            
-            mpi_start = MPI_Wtime();
-            int rank = read_images_from_folders_mpi_sobel(folder_path, image_processing_algorithm);
-
-            mpi_finish = MPI_Wtime();
-            MPI_Finalize();
-
-            mpi_processing_time = mpi_finish - mpi_start;
+        MPI_Init(&argc, &argv);
+        MPI_Barrier(MPI_COMM_WORLD);
+        mpi_start = MPI_Wtime();
+        int rank = read_images_from_folders_mpi(folder_path, image_processing_algorithm, &options);
+        MPI_Barrier(MPI_COMM_WORLD);
+        mpi_finish = MPI_Wtime();
+        MPI_Finalize();
+
+        mpi_processing_time = mpi_finish - mpi_start;
+        if (rank == 0) {
             printf("Total time taken to apply %s on 100 images using %s method: %lf\n", image_processing_algorithm, execution_type, mpi_processing_time);
         }
-        else if (!strcmp(image_processing_algorithm, "negative"))
-        {
-            MPI_Init(&argc, &argv);
-            
-            MPI_Barrier(MPI_COMM_WORLD);
-            mpi_start = MPI_Wtime();
-            int rank = read_images_from_folders_mpi_negative(folder_path);
-            MPI_Barrier(MPI_COMM_WORLD);
-            mpi_finish = MPI_Wtime();
-            MPI_Finalize();
-
-            mpi_processing_time = mpi_finish - mpi_start;
-            if (rank == 0) {
-                printf("Total time taken to apply %s on 100 images using %s method: %lf\n", image_processing_algorithm, execution_type, mpi_processing_time);
-            }
-        }
-        else if (!strcmp(image_processing_algorithm, "otsu"))
-        {
-            MPI_Init(&argc, &argv);
-            MPI_Barrier(MPI_COMM_WORLD);
-            mpi_start = MPI_Wtime();
-            int rank = read_images_from_folders_mpi_otsu(folder_path, "output_folder/mpi_otsu", 0);
-            MPI_Barrier(MPI_COMM_WORLD);
-            mpi_finish = MPI_Wtime();
-            MPI_Finalize();
-
-            mpi_processing_time = mpi_finish - mpi_start;
-            if (rank == 0) {
-                printf("Total time taken to apply %s on 100 images using %s method: %lf\n", image_processing_algorithm, execution_type, mpi_processing_time);
-            }
-        }
     }
     return 0;
 }
\ No newline at end of file
@@ -3,23 +3,25 @@
 echo "Choose method of program execution";
 
 if [[ -z $1 || -z $2 ]]; then
-    echo "Provide image folder: ./run.sh <image_path> serial | omp | mpi <algorithm> <mpi_procs>";
-    printf "Possible image processing algorithms are: grayscale, sobel, otsu, negative\n";
+    echo "Provide image folder: ./run.sh <image_path> serial | omp | mpi <algorithm> <mpi_procs> [options]";
+    printf "Possible image processing algorithms are: grayscale, sobel, otsu, negative, adaptive, blur, canny, morph, median, equalize, hough, convert\n";
     exit 1;
 fi
 
+SOURCES="main.c libs/grayscale.c libs/sobel.c libs/image.c libs/utility.c libs/negative.c libs/otsu.c libs/tasks.c libs/planner.c libs/dirscan.c libs/walk.c libs/options.c libs/decode.c libs/png_decode.c libs/histogram.c libs/adaptive.c libs/convolve.c libs/canny.c libs/morphology.c libs/components.c libs/median.c libs/equalize.c libs/resize.c libs/encode.c libs/hough.c libs/bitmask.c libs/rawimage.c"
+
 if [[ $2 == 'serial' ]]; then
-    mpicc main.c libs/grayscale.c libs/sobel.c libs/image.c libs/utility.c libs/negative.c libs/otsu.c -o build/main_serial -lm -fopenmp
-    ./build/main_serial $1 serial $3
+    mpicc $SOURCES -o build/main_serial -lm -ljpeg -lz -fopenmp
+    ./build/main_serial $1 serial $3 "${@:4}"
     exit 0;
 elif [[ $2 == 'omp' ]]; then
-    mpicc main.c libs/grayscale.c libs/sobel.c libs/image.c libs/utility.c libs/negative.c libs/otsu.c -o build/main_omp -lm -fopenmp
-    ./build/main_omp $1 omp $3
+    mpicc $SOURCES -o build/main_omp -lm -ljpeg -lz -fopenmp
+    ./build/main_omp $1 omp $3 "${@:4}"
     exit 0;
 elif [[ $2 == 'mpi' ]]; then
-    mpicc main.c libs/grayscale.c libs/sobel.c libs/image.c libs/utility.c libs/negative.c libs/otsu.c -o build/main_mpi -lm -fopenmp
+    mpicc $SOURCES -o build/main_mpi -lm -ljpeg -lz -fopenmp
 
-    mpirun -np $4 ./build/main_mpi $1 mpi $3
+    mpirun -np $4 ./build/main_mpi $1 mpi $3 "${@:5}"
     exit 0;
 else
     echo "Incorrect last argument: serial | omp | mpi";